@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * find_many.cpp -- this simple benchmark is used to compare lookup
+ * throughput of concurrent_hash_map::find_many() and
+ * concurrent_map::find_many() with a loop of find() calls. The keys are
+ * looked up in random order, in batches of the given size, so that almost
+ * every lookup misses the CPU cache.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include "../measure.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#define CREATE_MODE_RW (S_IWUSR | S_IRUSR)
+
+#else
+
+#include <windows.h>
+#define CREATE_MODE_RW (S_IWRITE | S_IREAD)
+
+#endif
+
+static const std::string LAYOUT = "find_many";
+
+using key_type = pmem::obj::p<int>;
+using value_type = pmem::obj::p<int>;
+
+using persistent_map_type =
+	pmem::obj::concurrent_hash_map<key_type, value_type>;
+
+using persistent_sorted_map_type =
+	pmem::obj::experimental::concurrent_map<key_type, value_type>;
+
+struct root {
+	pmem::obj::persistent_ptr<persistent_map_type> pptr;
+	pmem::obj::persistent_ptr<persistent_sorted_map_type> sorted_pptr;
+};
+
+size_t
+lookup_find(persistent_map_type &map, const std::vector<key_type> &keys,
+	    size_t batch)
+{
+	size_t found = 0;
+
+	for (size_t first = 0; first < keys.size(); first += batch) {
+		size_t last = (std::min)(first + batch, keys.size());
+
+		for (size_t i = first; i < last; ++i) {
+			persistent_map_type::const_accessor acc;
+			if (map.find(acc, keys[i]))
+				++found;
+		}
+	}
+
+	return found;
+}
+
+size_t
+lookup_find_many(persistent_map_type &map, const std::vector<key_type> &keys,
+		 size_t batch)
+{
+	size_t found = 0;
+
+	for (size_t first = 0; first < keys.size(); first += batch) {
+		size_t n = (std::min)(batch, keys.size() - first);
+
+		found += map.find_many(
+			keys.data() + first, n,
+			[](size_t, const persistent_map_type::value_type &) {
+			});
+	}
+
+	return found;
+}
+
+size_t
+lookup_find(persistent_sorted_map_type &map,
+	    const std::vector<key_type> &keys, size_t batch)
+{
+	size_t found = 0;
+
+	for (size_t first = 0; first < keys.size(); first += batch) {
+		size_t last = (std::min)(first + batch, keys.size());
+
+		for (size_t i = first; i < last; ++i) {
+			if (map.find(keys[i]) != map.end())
+				++found;
+		}
+	}
+
+	return found;
+}
+
+size_t
+lookup_find_many(persistent_sorted_map_type &map,
+		 const std::vector<key_type> &keys, size_t batch)
+{
+	std::vector<persistent_sorted_map_type::iterator> results(batch);
+	size_t found = 0;
+
+	for (size_t first = 0; first < keys.size(); first += batch) {
+		size_t n = (std::min)(batch, keys.size() - first);
+
+		map.find_many(keys.data() + first, n, results.data());
+
+		for (size_t i = 0; i < n; ++i) {
+			if (results[i] != map.end())
+				++found;
+		}
+	}
+
+	return found;
+}
+
+void
+print(const char *name, size_t n_elements, std::chrono::microseconds::rep us)
+{
+	std::cout << name << ": " << us / 1000 << "ms, "
+		  << static_cast<double>(n_elements) /
+			static_cast<double>(us ? us : 1)
+		  << " Mops/s" << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	pmem::obj::pool<root> pop;
+	try {
+		if (argc < 4) {
+			std::cerr << "usage: " << argv[0]
+				  << " file-name n_elements batch_size"
+				  << std::endl;
+			return 1;
+		}
+
+		const char *path = argv[1];
+		size_t n_elements = std::stoull(argv[2]);
+		size_t batch = std::stoull(argv[3]);
+
+		if (n_elements == 0 || batch == 0) {
+			std::cerr << "n_elements and batch_size must be > 0"
+				  << std::endl;
+			return 1;
+		}
+
+		try {
+			auto pool_size = n_elements * sizeof(int) * 130 +
+				20 * PMEMOBJ_MIN_POOL;
+
+			pop = pmem::obj::pool<root>::create(
+				path, LAYOUT, pool_size, CREATE_MODE_RW);
+			pmem::obj::transaction::run(pop, [&] {
+				pop.root()->pptr = pmem::obj::make_persistent<
+					persistent_map_type>();
+				pop.root()->sorted_pptr =
+					pmem::obj::make_persistent<
+						persistent_sorted_map_type>();
+			});
+			pop.root()->pptr->runtime_initialize();
+		} catch (pmem::pool_error &pe) {
+			std::cerr << "!pool::create: " << pe.what()
+				  << std::endl;
+			return 1;
+		}
+
+		auto &map = *pop.root()->pptr;
+		auto &sorted_map = *pop.root()->sorted_pptr;
+
+		std::vector<key_type> keys;
+		for (size_t i = 0; i < n_elements; ++i) {
+			int k = static_cast<int>(i);
+			map.insert(persistent_map_type::value_type(k, k));
+			sorted_map.emplace(k, k);
+			keys.emplace_back(k);
+		}
+
+		std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+
+		size_t found[4] = {0, 0, 0, 0};
+
+		auto us_find = measure<std::chrono::microseconds>(
+			[&] { found[0] = lookup_find(map, keys, batch); });
+		auto us_find_many = measure<std::chrono::microseconds>(
+			[&] { found[1] = lookup_find_many(map, keys, batch); });
+		auto us_sorted_find = measure<std::chrono::microseconds>([&] {
+			found[2] = lookup_find(sorted_map, keys, batch);
+		});
+		auto us_sorted_find_many =
+			measure<std::chrono::microseconds>([&] {
+				found[3] = lookup_find_many(sorted_map, keys,
+							    batch);
+			});
+
+		for (auto f : found) {
+			if (f != n_elements) {
+				std::cerr << "not all elements found"
+					  << std::endl;
+				return 1;
+			}
+		}
+
+		print("concurrent_hash_map::find()", n_elements, us_find);
+		print("concurrent_hash_map::find_many()", n_elements,
+		      us_find_many);
+		print("concurrent_map::find()", n_elements, us_sorted_find);
+		print("concurrent_map::find_many()", n_elements,
+		      us_sorted_find_many);
+
+		pop.close();
+	} catch (const std::logic_error &e) {
+		std::cerr << "!pool::close: " << e.what() << std::endl;
+		return 1;
+	} catch (const std::exception &e) {
+		std::cerr << "!exception: " << e.what() << std::endl;
+		try {
+			pop.close();
+		} catch (const std::logic_error &e) {
+			std::cerr << "!exception: " << e.what() << std::endl;
+		}
+		return 1;
+	}
+	return 0;
+}
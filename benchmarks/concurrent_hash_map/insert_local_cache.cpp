@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * insert_local_cache.cpp -- this simple benchmark is used to measure insert
+ * throughput of concurrent_hash_map. It is built twice: with and without
+ * the thread_local cache of enumerable_thread_specific::local() results
+ * (LIBPMEMOBJ_CPP_ETS_LOCAL_CACHE), which is used on every insert to update
+ * the per-thread size difference.
+ */
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include "../measure.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#define CREATE_MODE_RW (S_IWUSR | S_IRUSR)
+
+#else
+
+#include <windows.h>
+#define CREATE_MODE_RW (S_IWRITE | S_IREAD)
+
+#endif
+
+static const std::string LAYOUT = "insert_local_cache";
+
+using key_type = pmem::obj::p<int>;
+using value_type = pmem::obj::p<int>;
+
+using persistent_map_type =
+	pmem::obj::concurrent_hash_map<key_type, value_type>;
+
+struct root {
+	pmem::obj::persistent_ptr<persistent_map_type> pptr;
+};
+
+void
+insert(pmem::obj::pool<root> &pop, size_t n_inserts, size_t n_threads)
+{
+	auto map = pop.root()->pptr;
+
+	assert(map != nullptr);
+
+	std::vector<std::thread> v;
+	for (size_t i = 0; i < n_threads; i++) {
+		v.emplace_back(
+			[&](size_t tid) {
+				int begin = static_cast<int>(tid * n_inserts);
+				int end = begin + static_cast<int>(n_inserts);
+				for (int i = begin; i < end; ++i) {
+					persistent_map_type::value_type val(i,
+									    i);
+					map->insert(val);
+				}
+			},
+			i);
+	}
+
+	for (auto &t : v)
+		t.join();
+
+	assert(map->size() == n_inserts * n_threads);
+}
+
+int
+main(int argc, char *argv[])
+{
+	pmem::obj::pool<root> pop;
+	try {
+		if (argc < 4) {
+			std::cerr << "usage: " << argv[0]
+				  << " file-name n_inserts n_threads"
+				  << std::endl;
+			return 1;
+		}
+
+		const char *path = argv[1];
+		size_t n_inserts = std::stoull(argv[2]);
+		size_t n_threads = std::stoull(argv[3]);
+
+		if (n_inserts * n_threads == 0) {
+			std::cerr << "n_inserts and n_threads must be > 0"
+				  << std::endl;
+			return 1;
+		}
+
+		try {
+			auto pool_size = n_inserts * n_threads * sizeof(int) *
+					65 +
+				20 * PMEMOBJ_MIN_POOL;
+
+			pop = pmem::obj::pool<root>::create(
+				path, LAYOUT, pool_size, CREATE_MODE_RW);
+			pmem::obj::transaction::run(pop, [&] {
+				pop.root()->pptr = pmem::obj::make_persistent<
+					persistent_map_type>();
+			});
+			pop.root()->pptr->runtime_initialize();
+		} catch (pmem::pool_error &pe) {
+			std::cerr << "!pool::create: " << pe.what()
+				  << std::endl;
+			return 1;
+		}
+
+		auto us = measure<std::chrono::microseconds>(
+			[&] { insert(pop, n_inserts, n_threads); });
+
+		std::cout << "local() cache: "
+			  << (LIBPMEMOBJ_CPP_ETS_LOCAL_CACHE ? "on" : "off")
+			  << std::endl;
+		std::cout << us / 1000 << "ms" << std::endl;
+		std::cout << static_cast<double>(n_inserts * n_threads) /
+				static_cast<double>(us ? us : 1)
+			  << " Mops/s" << std::endl;
+
+		pop.close();
+	} catch (const std::logic_error &e) {
+		std::cerr << "!pool::close: " << e.what() << std::endl;
+		return 1;
+	} catch (const std::exception &e) {
+		std::cerr << "!exception: " << e.what() << std::endl;
+		try {
+			pop.close();
+		} catch (const std::logic_error &e) {
+			std::cerr << "!exception: " << e.what() << std::endl;
+		}
+		return 1;
+	}
+	return 0;
+}
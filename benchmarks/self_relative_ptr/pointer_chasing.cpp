@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * pointer_chasing.cpp -- this simple benchmark is used to compare the cost
+ * of dereferencing persistent_ptr, persistent_pool_ptr and
+ * self_relative_ptr. Every type of the pointer is used to link the same
+ * number of nodes in random order, and the lists are traversed.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <libpmemobj++/detail/persistent_pool_ptr.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include "../measure.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#define CREATE_MODE_RW (S_IWUSR | S_IRUSR)
+
+#else
+
+#include <windows.h>
+#define CREATE_MODE_RW (S_IWRITE | S_IREAD)
+
+#endif
+
+static const std::string LAYOUT = "pointer_chasing";
+
+template <template <typename> class Ptr>
+struct node {
+	Ptr<node> next;
+	pmem::obj::p<uint64_t> value;
+};
+
+using pptr_node = node<pmem::obj::persistent_ptr>;
+using pool_ptr_node = node<pmem::detail::persistent_pool_ptr>;
+using self_relative_node = node<pmem::obj::experimental::self_relative_ptr>;
+
+struct root {
+	pmem::obj::persistent_ptr<pptr_node[]> pptr_nodes;
+	pmem::obj::persistent_ptr<pool_ptr_node[]> pool_ptr_nodes;
+	pmem::obj::persistent_ptr<self_relative_node[]> self_relative_nodes;
+};
+
+pptr_node *
+follow(const pmem::obj::persistent_ptr<pptr_node> &ptr, uint64_t)
+{
+	return ptr.get();
+}
+
+pool_ptr_node *
+follow(const pmem::detail::persistent_pool_ptr<pool_ptr_node> &ptr,
+       uint64_t pool_uuid)
+{
+	return ptr.get(pool_uuid);
+}
+
+self_relative_node *
+follow(const pmem::obj::experimental::self_relative_ptr<self_relative_node>
+	       &ptr,
+       uint64_t)
+{
+	return ptr.get();
+}
+
+/*
+ * link -- links the nodes in the given order, returns the first node
+ */
+template <typename Node>
+Node *
+link(pmem::obj::pool<root> &pop, pmem::obj::persistent_ptr<Node[]> nodes,
+     const std::vector<size_t> &order)
+{
+	for (size_t i = 0; i < order.size(); ++i) {
+		Node &n = nodes[static_cast<std::ptrdiff_t>(order[i])];
+
+		n.value = order[i];
+		if (i + 1 < order.size())
+			n.next = pmem::obj::persistent_ptr<Node>(
+				&nodes[static_cast<std::ptrdiff_t>(
+					order[i + 1])]);
+		else
+			n.next = nullptr;
+	}
+
+	pop.persist(nodes.get(), sizeof(Node) * order.size());
+
+	return &nodes[static_cast<std::ptrdiff_t>(order[0])];
+}
+
+/*
+ * traverse -- follows the list starting from the first node, returns the
+ * sum of the values
+ */
+template <typename Node>
+uint64_t
+traverse(Node *first, uint64_t pool_uuid)
+{
+	uint64_t sum = 0;
+
+	for (Node *n = first; n != nullptr; n = follow(n->next, pool_uuid))
+		sum += n->value;
+
+	return sum;
+}
+
+template <typename Node>
+void
+run(const std::string &name, Node *first, uint64_t pool_uuid,
+    size_t n_nodes, size_t iterations)
+{
+	uint64_t expected = n_nodes * (n_nodes - 1) / 2;
+	uint64_t sum = 0;
+
+	auto us = measure<std::chrono::microseconds>([&] {
+		for (size_t i = 0; i < iterations; ++i)
+			sum += traverse(first, pool_uuid);
+	});
+
+	if (sum != expected * iterations)
+		throw std::runtime_error("invalid sum of " + name + " list");
+
+	auto steps = static_cast<double>(n_nodes * iterations);
+
+	std::cout << name << ": " << us / 1000 << "ms, "
+		  << static_cast<double>(us) * 1000 / steps << " ns/step"
+		  << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	pmem::obj::pool<root> pop;
+	try {
+		if (argc < 3) {
+			std::cerr << "usage: " << argv[0]
+				  << " file-name n_nodes [iterations]"
+				  << std::endl;
+			return 1;
+		}
+
+		const char *path = argv[1];
+		size_t n_nodes = std::stoull(argv[2]);
+		size_t iterations = argc > 3 ? std::stoull(argv[3]) : 1;
+
+		if (n_nodes == 0 || iterations == 0) {
+			std::cerr << "n_nodes and iterations must be > 0"
+				  << std::endl;
+			return 1;
+		}
+
+		try {
+			auto pool_size = n_nodes *
+					(sizeof(pptr_node) +
+					 sizeof(pool_ptr_node) +
+					 sizeof(self_relative_node)) *
+					2 +
+				20 * PMEMOBJ_MIN_POOL;
+
+			pop = pmem::obj::pool<root>::create(
+				path, LAYOUT, pool_size, CREATE_MODE_RW);
+		} catch (pmem::pool_error &pe) {
+			std::cerr << "!pool::create: " << pe.what()
+				  << std::endl;
+			return 1;
+		}
+
+		auto r = pop.root();
+		pmem::obj::transaction::run(pop, [&] {
+			r->pptr_nodes =
+				pmem::obj::make_persistent<pptr_node[]>(
+					n_nodes);
+			r->pool_ptr_nodes =
+				pmem::obj::make_persistent<pool_ptr_node[]>(
+					n_nodes);
+			r->self_relative_nodes = pmem::obj::make_persistent<
+				self_relative_node[]>(n_nodes);
+		});
+
+		std::vector<size_t> order(n_nodes);
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), std::mt19937(0));
+
+		uint64_t pool_uuid = r.raw().pool_uuid_lo;
+
+		auto pptr_first = link(pop, r->pptr_nodes, order);
+		auto pool_ptr_first = link(pop, r->pool_ptr_nodes, order);
+		auto self_relative_first =
+			link(pop, r->self_relative_nodes, order);
+
+		run("persistent_ptr", pptr_first, pool_uuid, n_nodes,
+		    iterations);
+		run("persistent_pool_ptr", pool_ptr_first, pool_uuid, n_nodes,
+		    iterations);
+		run("self_relative_ptr", self_relative_first, pool_uuid,
+		    n_nodes, iterations);
+
+		pop.close();
+	} catch (const std::logic_error &e) {
+		std::cerr << "!pool::close: " << e.what() << std::endl;
+		return 1;
+	} catch (const std::exception &e) {
+		std::cerr << "!exception: " << e.what() << std::endl;
+		try {
+			pop.close();
+		} catch (const std::logic_error &e) {
+			std::cerr << "!exception: " << e.what() << std::endl;
+		}
+		return 1;
+	}
+	return 0;
+}
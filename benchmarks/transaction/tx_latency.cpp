@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * tx_latency.cpp -- this simple benchmark measures the latency of empty and
+ * small transactions started with transaction::run. For comparison, the
+ * same transactions are also started with a closure converted to
+ * std::function, which has to allocate memory for big captures.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include "../measure.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#define CREATE_MODE_RW (S_IWUSR | S_IRUSR)
+
+#else
+
+#include <windows.h>
+#define CREATE_MODE_RW (S_IWRITE | S_IREAD)
+
+#endif
+
+static const std::string LAYOUT = "tx_latency";
+
+struct root {
+	pmem::obj::p<uint64_t> counter;
+};
+
+/* captures more than fits in the small buffer of std::function */
+struct big_capture {
+	uint64_t padding[4];
+};
+
+template <typename F>
+void
+run(const std::string &name, size_t iterations, F &&tx)
+{
+	auto us = measure<std::chrono::microseconds>([&] {
+		for (size_t i = 0; i < iterations; ++i)
+			tx();
+	});
+
+	std::cout << name << ": " << us / 1000 << "ms, "
+		  << static_cast<double>(us) * 1000 /
+			static_cast<double>(iterations)
+		  << " ns/tx" << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+	pmem::obj::pool<root> pop;
+	try {
+		if (argc < 2) {
+			std::cerr << "usage: " << argv[0]
+				  << " file-name [iterations]" << std::endl;
+			return 1;
+		}
+
+		const char *path = argv[1];
+		size_t iterations = argc > 2 ? std::stoull(argv[2]) : 1000000;
+
+		if (iterations == 0) {
+			std::cerr << "iterations must be > 0" << std::endl;
+			return 1;
+		}
+
+		try {
+			pop = pmem::obj::pool<root>::create(
+				path, LAYOUT, PMEMOBJ_MIN_POOL, CREATE_MODE_RW);
+		} catch (pmem::pool_error &pe) {
+			std::cerr << "!pool::create: " << pe.what()
+				  << std::endl;
+			return 1;
+		}
+
+		auto r = pop.root();
+		big_capture capture = {{1, 2, 3, 4}};
+
+		run("empty", iterations,
+		    [&] { pmem::obj::transaction::run(pop, [] {}); });
+
+		run("small", iterations, [&] {
+			pmem::obj::transaction::run(pop, [&, capture] {
+				r->counter = r->counter + capture.padding[0];
+			});
+		});
+
+		run("small with callback", iterations, [&] {
+			pmem::obj::transaction::run(pop, [&] {
+				r->counter = r->counter + 1;
+				pmem::obj::transaction::register_callback(
+					pmem::obj::transaction::stage::oncommit,
+					[] {});
+			});
+		});
+
+		run("small std::function", iterations, [&] {
+			std::function<void()> tx = [&, capture] {
+				r->counter = r->counter + capture.padding[0];
+			};
+			pmem::obj::transaction::run(pop, tx);
+		});
+
+		if (r->counter != 3 * iterations)
+			throw std::runtime_error("invalid counter value");
+
+		pop.close();
+	} catch (const std::logic_error &e) {
+		std::cerr << "!pool::close: " << e.what() << std::endl;
+		return 1;
+	} catch (const std::exception &e) {
+		std::cerr << "!exception: " << e.what() << std::endl;
+		try {
+			pop.close();
+		} catch (const std::logic_error &e) {
+			std::cerr << "!exception: " << e.what() << std::endl;
+		}
+		return 1;
+	}
+	return 0;
+}
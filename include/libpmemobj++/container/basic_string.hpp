@@ -23,6 +23,7 @@
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pext.hpp>
 #include <libpmemobj++/slice.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj++/transaction.hpp>
 
 namespace pmem
@@ -150,6 +151,7 @@ public:
 	void shrink_to_fit();
 	void clear();
 	void free_data();
+	memory_usage_stats memory_usage() const noexcept;
 
 	/* Modifiers */
 	basic_string &erase(size_type index = 0, size_type count = npos);
@@ -3706,6 +3708,31 @@ basic_string<CharT, Traits>::shrink_to_fit()
 	}
 }
 
+/**
+ * Returns memory used by the string. The terminating null character is
+ * counted as metadata. Slack is the unused capacity, either of the
+ * inline buffer or of the underlying array.
+ *
+ * @return memory_usage_stats struct.
+ */
+template <typename CharT, typename Traits>
+memory_usage_stats
+basic_string<CharT, Traits>::memory_usage() const noexcept
+{
+	memory_usage_stats usage;
+	usage.data = size() * sizeof(CharT);
+
+	if (is_sso_used()) {
+		usage.slack = (sso_capacity - size()) * sizeof(CharT);
+		usage.metadata = sizeof(*this) - usage.data - usage.slack;
+	} else {
+		usage.slack = non_sso_data().memory_usage().slack;
+		usage.metadata = sizeof(*this) + sizeof(CharT);
+	}
+
+	return usage;
+}
+
 /**
  * Remove all characters from the string transactionally.
  * All pointers, references, and iterators are invalidated.
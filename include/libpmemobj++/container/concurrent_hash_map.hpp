@@ -11,11 +11,15 @@
 #define PMEMOBJ_CONCURRENT_HASH_MAP_HPP
 
 #include <libpmemobj++/detail/atomic_backoff.hpp>
+#include <libpmemobj++/detail/bloom_filter.hpp>
 #include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/lazy_init_state.hpp>
 #include <libpmemobj++/detail/pair.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/template_helpers.hpp>
 
 #include <libpmemobj++/defrag.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj++/make_persistent.hpp>
 #include <libpmemobj++/mutex.hpp>
 #include <libpmemobj++/p.hpp>
@@ -29,6 +33,7 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstring>
 #include <functional>
 #include <initializer_list>
 #include <iterator> // for std::distance
@@ -224,11 +229,30 @@ public:
 };
 }
 
+/**
+ * Locking policy of concurrent_hash_map, in which every node has its own
+ * mutex. Accessors lock only the node, so accessors to different elements
+ * never block each other. This is the default policy.
+ */
+struct hash_map_node_lock {
+};
+
+/**
+ * Locking policy of concurrent_hash_map, in which nodes have no mutex.
+ * An accessor holds the lock of the bucket containing the element instead,
+ * which saves sizeof(MutexType) bytes of persistent memory per element
+ * (64 bytes for pmem::obj::shared_mutex), at the cost of blocking writers
+ * of other elements in the same bucket.
+ */
+struct hash_map_bucket_lock {
+};
+
 template <typename Key, typename T, typename Hash = std::hash<Key>,
 	  typename KeyEqual = std::equal_to<Key>,
 	  typename MutexType = pmem::obj::shared_mutex,
 	  typename ScopedLockType = concurrent_hash_map_internal::
-		  shared_mutex_scoped_lock<MutexType>>
+		  shared_mutex_scoped_lock<MutexType>,
+	  typename LockPolicy = hash_map_node_lock>
 class concurrent_hash_map;
 
 /** @cond INTERNAL */
@@ -249,6 +273,12 @@ using transparent_key_equal = typename Hash::transparent_key_equal;
 template <typename Hash>
 using has_transparent_key_equal = detail::supports<Hash, transparent_key_equal>;
 
+template <typename Hash>
+using cache_hash_code = typename Hash::cache_hash_code;
+
+template <typename Hash>
+using has_cache_hash_code = detail::supports<Hash, cache_hash_code>;
+
 template <typename Hash, typename Pred,
 	  bool = has_transparent_key_equal<Hash>::value>
 struct key_equal_type {
@@ -273,7 +303,8 @@ assert_not_locked(Mutex &mtx)
 #endif
 }
 
-template <typename Key, typename T, typename MutexType, typename ScopedLockType>
+template <typename Key, typename T, typename MutexType, typename ScopedLockType,
+	  bool CachedHash = false>
 struct hash_map_node {
 	/**Mutex type. */
 	using mutex_t = MutexType;
@@ -331,6 +362,204 @@ struct hash_map_node {
 	hash_map_node &operator=(const hash_map_node &) = delete;
 }; /* struct node */
 
+/**
+ * Node which additionally stores the hash code of the key. It is used when
+ * Hash defines cache_hash_code member type.
+ */
+template <typename Key, typename T, typename MutexType, typename ScopedLockType>
+struct hash_map_node<Key, T, MutexType, ScopedLockType, true> {
+	/**Mutex type. */
+	using mutex_t = MutexType;
+
+	/** Scoped lock type for mutex. */
+	using scoped_t = ScopedLockType;
+
+	using value_type = detail::pair<const Key, T>;
+
+	/** Persistent pointer type for next. */
+	using node_ptr_t = detail::persistent_pool_ptr<
+		hash_map_node<Key, T, mutex_t, scoped_t, true>>;
+
+	/** Next node in chain. */
+	node_ptr_t next;
+
+	/** Node mutex. */
+	mutex_t mutex;
+
+	/** Hash code of the key. */
+	p<std::size_t> hash;
+
+	/** Item stored in node */
+	value_type item;
+
+	hash_map_node(const node_ptr_t &_next, std::size_t h, const Key &key)
+	    : next(_next),
+	      hash(h),
+	      item(std::piecewise_construct, std::forward_as_tuple(key),
+		   std::forward_as_tuple())
+	{
+	}
+
+	hash_map_node(const node_ptr_t &_next, std::size_t h, const Key &key,
+		      const T &t)
+	    : next(_next), hash(h), item(key, t)
+	{
+	}
+
+	hash_map_node(const node_ptr_t &_next, std::size_t h, value_type &&i)
+	    : next(_next), hash(h), item(std::move(i))
+	{
+	}
+
+	template <typename... Args>
+	hash_map_node(const node_ptr_t &_next, std::size_t h, Args &&... args)
+	    : next(_next), hash(h), item(std::forward<Args>(args)...)
+	{
+	}
+
+	hash_map_node(const node_ptr_t &_next, std::size_t h,
+		      const value_type &i)
+	    : next(_next), hash(h), item(i)
+	{
+	}
+
+	/** Copy constructor is deleted */
+	hash_map_node(const hash_map_node &) = delete;
+
+	/** Assignment operator is deleted */
+	hash_map_node &operator=(const hash_map_node &) = delete;
+}; /* struct node with hash */
+
+/**
+ * Node without a mutex, used with the hash_map_bucket_lock policy.
+ * Elements are protected by the locks of the buckets.
+ */
+template <typename Key, typename T, typename MutexType, typename ScopedLockType,
+	  bool CachedHash = false>
+struct hash_map_lockless_node {
+	/** Mutex type of the bucket. */
+	using mutex_t = MutexType;
+
+	/** Scoped lock type for mutex of the bucket. */
+	using scoped_t = ScopedLockType;
+
+	using value_type = detail::pair<const Key, T>;
+
+	/** Persistent pointer type for next. */
+	using node_ptr_t = detail::persistent_pool_ptr<
+		hash_map_lockless_node<Key, T, mutex_t, scoped_t>>;
+
+	/** Next node in chain. */
+	node_ptr_t next;
+
+	/** Item stored in node */
+	value_type item;
+
+	hash_map_lockless_node(const node_ptr_t &_next, const Key &key)
+	    : next(_next),
+	      item(std::piecewise_construct, std::forward_as_tuple(key),
+		   std::forward_as_tuple())
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, const Key &key,
+			       const T &t)
+	    : next(_next), item(key, t)
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, value_type &&i)
+	    : next(_next), item(std::move(i))
+	{
+	}
+
+	template <typename... Args>
+	hash_map_lockless_node(const node_ptr_t &_next, Args &&... args)
+	    : next(_next), item(std::forward<Args>(args)...)
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, const value_type &i)
+	    : next(_next), item(i)
+	{
+	}
+
+	/** Copy constructor is deleted */
+	hash_map_lockless_node(const hash_map_lockless_node &) = delete;
+
+	/** Assignment operator is deleted */
+	hash_map_lockless_node &
+	operator=(const hash_map_lockless_node &) = delete;
+}; /* struct lockless node */
+
+/**
+ * Node without a mutex, which stores the hash code of the key.
+ */
+template <typename Key, typename T, typename MutexType, typename ScopedLockType>
+struct hash_map_lockless_node<Key, T, MutexType, ScopedLockType, true> {
+	/** Mutex type of the bucket. */
+	using mutex_t = MutexType;
+
+	/** Scoped lock type for mutex of the bucket. */
+	using scoped_t = ScopedLockType;
+
+	using value_type = detail::pair<const Key, T>;
+
+	/** Persistent pointer type for next. */
+	using node_ptr_t = detail::persistent_pool_ptr<
+		hash_map_lockless_node<Key, T, mutex_t, scoped_t, true>>;
+
+	/** Next node in chain. */
+	node_ptr_t next;
+
+	/** Hash code of the key. */
+	p<std::size_t> hash;
+
+	/** Item stored in node */
+	value_type item;
+
+	hash_map_lockless_node(const node_ptr_t &_next, std::size_t h,
+			       const Key &key)
+	    : next(_next),
+	      hash(h),
+	      item(std::piecewise_construct, std::forward_as_tuple(key),
+		   std::forward_as_tuple())
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, std::size_t h,
+			       const Key &key, const T &t)
+	    : next(_next), hash(h), item(key, t)
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, std::size_t h,
+			       value_type &&i)
+	    : next(_next), hash(h), item(std::move(i))
+	{
+	}
+
+	template <typename... Args>
+	hash_map_lockless_node(const node_ptr_t &_next, std::size_t h,
+			       Args &&... args)
+	    : next(_next), hash(h), item(std::forward<Args>(args)...)
+	{
+	}
+
+	hash_map_lockless_node(const node_ptr_t &_next, std::size_t h,
+			       const value_type &i)
+	    : next(_next), hash(h), item(i)
+	{
+	}
+
+	/** Copy constructor is deleted */
+	hash_map_lockless_node(const hash_map_lockless_node &) = delete;
+
+	/** Assignment operator is deleted */
+	hash_map_lockless_node &
+	operator=(const hash_map_lockless_node &) = delete;
+}; /* struct lockless node with hash */
+
 /**
  * The class provides the way to access certain properties of segments
  * used by hash map
@@ -749,13 +978,256 @@ private:
 	segment_index_t my_seg;
 }; /* End of class segment_facade_impl */
 
+/**
+ * Size-bounded cache of copies of elements, which resides in DRAM. Used by
+ * concurrent_hash_map::find_cached() to serve lookups of hot keys without
+ * accessing persistent memory.
+ *
+ * The cache is direct-mapped: an element with hash code h can only be
+ * stored in the slot h & mask. Every slot is protected by a sequence lock
+ * (its version is odd while the slot is being written), so readers never
+ * block writers and do not write to the slot on a hit, except for setting
+ * the reference bit once. Admission follows the CLOCK policy: if the slot
+ * is occupied by an element which was read since it was stored, the
+ * element gets a second chance and the new one is not admitted.
+ *
+ * Key and T are copied bitwise by readers, so they must be trivially
+ * destructible and must not own any resources.
+ */
+template <typename Key, typename T>
+class hot_cache {
+public:
+	using size_type = size_t;
+	using hashcode_type = size_t;
+
+	/** Construct cache with capacity rounded up to a power of 2. */
+	explicit hot_cache(size_type capacity)
+	    : my_mask(slots_for(capacity) - 1), my_slots(new slot[my_mask + 1])
+	{
+	}
+
+	hot_cache(const hot_cache &) = delete;
+	hot_cache &operator=(const hot_cache &) = delete;
+
+	size_type
+	capacity() const noexcept
+	{
+		return my_mask + 1;
+	}
+
+	/**
+	 * Copies the value of the element with the given key to result.
+	 *
+	 * @returns true if the element was found in the cache.
+	 */
+	template <typename K, typename KeyEqual>
+	bool
+	find(const K &key, hashcode_type h, T &result, const KeyEqual &eq)
+	{
+		slot &s = my_slots[h & my_mask];
+		slot_data data;
+
+		for (detail::atomic_backoff backoff;; backoff.pause()) {
+			uint64_t v = s.version.load(std::memory_order_acquire);
+			if (v & 1)
+				continue;
+
+			std::memcpy(&data, &s.data, sizeof(data));
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (s.version.load(std::memory_order_relaxed) == v)
+				break;
+		}
+
+		counter &c = my_counters[stripe()];
+
+		if (!data.valid || data.hash != h ||
+		    !eq(*reinterpret_cast<const Key *>(&data.key), key)) {
+			c.misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		if (!s.referenced.load(std::memory_order_relaxed))
+			s.referenced.store(true, std::memory_order_relaxed);
+
+		c.hits.fetch_add(1, std::memory_order_relaxed);
+		result = *reinterpret_cast<const T *>(&data.value);
+
+		return true;
+	}
+
+	/**
+	 * Offers a copy of the element to the cache. The element must be
+	 * locked (at least for read) by the caller, so that no other thread
+	 * modifies it in the meantime.
+	 */
+	void
+	admit(hashcode_type h, const Key &key, const T &value)
+	{
+		slot &s = my_slots[h & my_mask];
+
+		uint64_t v = s.version.load(std::memory_order_relaxed);
+
+		/* Another thread writes the slot, do not wait for it */
+		if ((v & 1) ||
+		    !s.version.compare_exchange_strong(
+			    v, v + 1, std::memory_order_acquire))
+			return;
+
+		std::atomic_thread_fence(std::memory_order_release);
+
+		if (s.data.valid &&
+		    s.referenced.load(std::memory_order_relaxed)) {
+			/* second chance for the current element */
+			s.referenced.store(false, std::memory_order_relaxed);
+			s.version.store(v, std::memory_order_release);
+
+			return;
+		}
+
+		new (&s.data.key) Key(key);
+		new (&s.data.value) T(value);
+		s.data.hash = h;
+		s.data.valid = true;
+		s.referenced.store(false, std::memory_order_relaxed);
+
+		s.version.store(v + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Drops the copy of the element with the given hash code, if any.
+	 * Must be called after the element is modified or removed, before
+	 * the lock of the element is released.
+	 */
+	void
+	invalidate(hashcode_type h) noexcept
+	{
+		slot &s = my_slots[h & my_mask];
+
+		uint64_t v = lock(s);
+
+		if (s.data.valid && s.data.hash == h) {
+			s.data.valid = false;
+			v += 2;
+		}
+
+		s.version.store(v, std::memory_order_release);
+	}
+
+	/**
+	 * Drops all elements. Not thread safe.
+	 */
+	void
+	clear() noexcept
+	{
+		for (size_type i = 0; i <= my_mask; ++i) {
+			my_slots[i].data.valid = false;
+			my_slots[i].referenced.store(false,
+						     std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @returns sum of the hit and miss counters of all threads.
+	 */
+	cache_stats
+	stats() const noexcept
+	{
+		cache_stats result = {0, 0};
+
+		for (auto &c : my_counters) {
+			result.hits += c.hits.load(std::memory_order_relaxed);
+			result.misses +=
+				c.misses.load(std::memory_order_relaxed);
+		}
+
+		return result;
+	}
+
+private:
+	struct slot_data {
+		bool valid;
+		hashcode_type hash;
+		typename std::aligned_storage<sizeof(Key), alignof(Key)>::type
+			key;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type
+			value;
+	};
+
+	struct slot {
+		slot() : version(0), referenced(false)
+		{
+			data.valid = false;
+		}
+
+		std::atomic<uint64_t> version;
+		std::atomic<bool> referenced;
+		slot_data data;
+	};
+
+	/* Hit and miss counters, padded to avoid false sharing */
+	struct counter {
+		std::atomic<size_type> hits{0};
+		std::atomic<size_type> misses{0};
+		std::aligned_storage<64 - 2 * sizeof(size_type), 8>::type
+			padding;
+	};
+
+	/* Number of counters, threads are assigned to them by their ids */
+	static constexpr size_type counter_stripes = 16;
+
+	static size_type
+	slots_for(size_type capacity)
+	{
+		size_type n = 1;
+		while (n < capacity)
+			n <<= 1;
+
+		return n;
+	}
+
+	static size_type
+	stripe()
+	{
+		static thread_local size_type index =
+			std::hash<std::thread::id>{}(
+				std::this_thread::get_id()) %
+			counter_stripes;
+
+		return index;
+	}
+
+	/* Locks the slot for writing, returns the version before locking */
+	static uint64_t
+	lock(slot &s) noexcept
+	{
+		for (detail::atomic_backoff backoff;; backoff.pause()) {
+			uint64_t v = s.version.load(std::memory_order_relaxed);
+			if (!(v & 1) &&
+			    s.version.compare_exchange_weak(
+				    v, v + 1, std::memory_order_acquire)) {
+				std::atomic_thread_fence(
+					std::memory_order_release);
+				return v;
+			}
+		}
+	}
+
+	const size_type my_mask;
+	std::unique_ptr<slot[]> my_slots;
+	counter my_counters[counter_stripes];
+}; /* End of class hot_cache */
+
 /**
  * Base class of concurrent_hash_map.
  * Implements logic not dependent to Key/Value types.
  * MutexType - type of mutex used by buckets.
  * ScopedLockType - type of scoped lock for mutex.
+ * LockPolicy - hash_map_node_lock or hash_map_bucket_lock.
+ * CachedHash - true if nodes store hash codes of the keys.
  */
-template <typename Key, typename T, typename MutexType, typename ScopedLockType>
+template <typename Key, typename T, typename MutexType, typename ScopedLockType,
+	  typename LockPolicy, bool CachedHash>
 class hash_map_base {
 public:
 	using mutex_t = MutexType;
@@ -767,8 +1239,18 @@ public:
 	/** Type of a hash code. */
 	using hashcode_type = size_t;
 
+	/** True if nodes have no mutex and accessors lock buckets. */
+	static constexpr bool bucket_lock_policy =
+		std::is_same<LockPolicy, hash_map_bucket_lock>::value;
+
+	/** True if nodes store hash codes of the keys. */
+	static constexpr bool cached_hash = CachedHash;
+
 	/** Node base type. */
-	using node = hash_map_node<Key, T, mutex_t, scoped_t>;
+	using node = typename std::conditional<
+		bucket_lock_policy,
+		hash_map_lockless_node<Key, T, mutex_t, scoped_t, cached_hash>,
+		hash_map_node<Key, T, mutex_t, scoped_t, cached_hash>>::type;
 
 	/** Node base pointer. */
 	using node_ptr_t = detail::persistent_pool_ptr<node>;
@@ -858,8 +1340,17 @@ public:
 
 	using tls_t = detail::enumerable_thread_specific<tls_data_t>;
 
+	/** Type of the DRAM cache of elements. */
+	using hot_cache_t = hot_cache<Key, T>;
+
 	enum feature_flags : uint32_t { FEATURE_CONSISTENT_SIZE = 1 };
 
+	/** Incompat feature set for layouts with nodes without a mutex */
+	enum incompat_feature_flags : uint32_t {
+		FEATURE_LOCKLESS_NODES = 1,
+		FEATURE_CACHED_HASH = 2
+	};
+
 	/** Compat and incompat features of a layout */
 	struct features {
 		p<uint32_t> compat;
@@ -914,8 +1405,22 @@ public:
 	 */
 	p<size_t> on_init_size;
 
+	/**
+	 * Pointer to the cache of elements in DRAM, or null if it is not
+	 * enabled. Owned by the current open of the pool, which frees it on
+	 * close. Not valid after restart, reset in runtime_initialize().
+	 */
+	hot_cache_t *my_cache;
+
+	/**
+	 * Pointer to the filter of hash codes in DRAM, or null if it is not
+	 * enabled. Owned by the current open of the pool, which frees it on
+	 * close. Not valid after restart, reset in runtime_initialize().
+	 */
+	detail::bloom_filter *my_filter;
+
 	/** Reserved for future use */
-	std::aligned_storage<40, 8>::type reserved;
+	std::aligned_storage<24, 8>::type reserved;
 
 	/** Segment mutex used to enable new segment. */
 	segment_enable_mutex_t my_segment_enable_mutex;
@@ -929,7 +1434,9 @@ public:
 	static constexpr features
 	header_features()
 	{
-		return {FEATURE_CONSISTENT_SIZE, 0};
+		return {FEATURE_CONSISTENT_SIZE,
+			(bucket_lock_policy ? FEATURE_LOCKLESS_NODES : 0u) |
+				(cached_hash ? FEATURE_CACHED_HASH : 0u)};
 	}
 
 	const std::atomic<hashcode_type> &
@@ -1000,7 +1507,7 @@ public:
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 		VALGRIND_HG_DISABLE_CHECKING(&my_mask, sizeof(my_mask));
 #endif
-		layout_features = {0, 0};
+		layout_features = {0, header_features().incompat};
 
 		PMEMoid oid = pmemobj_oid(this);
 
@@ -1024,6 +1531,10 @@ public:
 		value_size = 0;
 
 		this->tls_ptr = nullptr;
+
+		detail::forget_container_state(this);
+
+		init_volatile_data();
 	}
 
 	/*
@@ -1045,6 +1556,75 @@ public:
 		}
 	}
 
+	/**
+	 * Volatile state of the map in the current open of the pool, nullptr
+	 * for pools opened with the C API.
+	 */
+	detail::lazy_init_state *
+	init_state()
+	{
+		return detail::container_state<detail::lazy_init_state>(this);
+	}
+
+	/**
+	 * Forget the DRAM cache and filter of the previous run, pointers
+	 * stored in the pool are not valid anymore.
+	 */
+	void
+	init_volatile_data() noexcept
+	{
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&my_cache, sizeof(my_cache));
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&my_filter, sizeof(my_filter));
+#endif
+		my_cache = nullptr;
+		my_filter = nullptr;
+	}
+
+	/**
+	 * Free the DRAM cache and filter if they were allocated in the
+	 * current open of the pool, otherwise only forget the pointers.
+	 */
+	void
+	release_volatile_data() noexcept
+	{
+		auto pop = get_pool_base().handle();
+
+		/* only memory of the current open is registered in pool_data */
+		detail::release_now(pop, &my_cache);
+		detail::release_now(pop, &my_filter);
+
+		init_volatile_data();
+	}
+
+	/** Free the DRAM cache of elements, if any. */
+	void
+	free_cache() noexcept
+	{
+		if (!my_cache)
+			return;
+
+		detail::cancel_release_on_close(get_pool_base().handle(),
+						&my_cache);
+
+		delete my_cache;
+		my_cache = nullptr;
+	}
+
+	/** Free the DRAM filter of hash codes, if any. */
+	void
+	free_filter() noexcept
+	{
+		if (!my_filter)
+			return;
+
+		detail::cancel_release_on_close(get_pool_base().handle(),
+						&my_filter);
+
+		delete my_filter;
+		my_filter = nullptr;
+	}
+
 	/**
 	 * Re-calculate mask value on each process restart.
 	 */
@@ -1322,7 +1902,9 @@ public:
 	 * @throws std::transaction_error in case of PMDK transaction failed
 	 */
 	void
-	internal_swap(hash_map_base<Key, T, mutex_t, scoped_t> &table)
+	internal_swap(
+		hash_map_base<Key, T, mutex_t, scoped_t, LockPolicy,
+			      CachedHash> &table)
 	{
 		pool_base p = get_pool_base();
 		{
@@ -1409,10 +1991,14 @@ public:
 
 	friend class hash_map_iterator<map_type, true>;
 
+	template <typename C, bool M>
+	friend class hash_map_range;
+
 #if !defined(_MSC_VER) || defined(__INTEL_COMPILER)
 private:
 	template <typename Key, typename T, typename Hash, typename KeyEqual,
-		  typename MutexType, typename ScopedLockType>
+		  typename MutexType, typename ScopedLockType,
+		  typename LockPolicy>
 	friend class ::pmem::obj::concurrent_hash_map;
 #else
 public: /* workaround */
@@ -1568,6 +2154,119 @@ operator!=(const hash_map_iterator<Container, M> &i,
 {
 	return i.my_node != j.my_node || i.my_map != j.my_map;
 }
+
+/**
+ * Range of buckets of concurrent_hash_map, which can be recursively split
+ * into subranges. Meets requirements of the TBB Range concept, so it can be
+ * used with tbb::parallel_for as well as with
+ * pmem::obj::experimental::parallel_for_each.
+ *
+ * Like iterators, ranges are not thread safe with respect to concurrent
+ * insert and erase operations.
+ * @ingroup containers
+ */
+template <typename Container, bool is_const>
+class hash_map_range {
+public:
+	using map_type = Container;
+	using size_type = typename map_type::size_type;
+	using iterator = hash_map_iterator<map_type, is_const>;
+	using value_type = typename iterator::value_type;
+	using reference = typename iterator::reference;
+	using map_ptr = typename iterator::map_ptr;
+
+#if !defined(_MSC_VER) || defined(__INTEL_COMPILER)
+private:
+	template <typename Key, typename T, typename Hash, typename KeyEqual,
+		  typename MutexType, typename ScopedLockType,
+		  typename LockPolicy>
+	friend class ::pmem::obj::concurrent_hash_map;
+#else
+public: /* workaround */
+#endif
+	hash_map_range(map_ptr map, size_type begin, size_type end,
+		       size_type grainsize)
+	    : my_map(map),
+	      my_begin(begin),
+	      my_end(end),
+	      my_grainsize(grainsize ? grainsize : 1)
+	{
+	}
+
+public:
+	/**
+	 * Splitting constructor. Moves the second half of buckets of r to
+	 * the new range. Split is a tag type (e.g. tbb::split).
+	 */
+	template <typename Split>
+	hash_map_range(hash_map_range &r, Split)
+	    : my_map(r.my_map),
+	      my_begin(r.my_begin + (r.my_end - r.my_begin) / 2),
+	      my_end(r.my_end),
+	      my_grainsize(r.my_grainsize)
+	{
+		assert(r.is_divisible());
+
+		r.my_end = my_begin;
+	}
+
+	/** Copy constructor for const range from non-const range */
+	template <typename U = void,
+		  typename = typename std::enable_if<is_const, U>::type>
+	hash_map_range(const hash_map_range<map_type, false> &other)
+	    : my_map(other.my_map),
+	      my_begin(other.my_begin),
+	      my_end(other.my_end),
+	      my_grainsize(other.my_grainsize)
+	{
+	}
+
+	/** @return true if the range contains no buckets. */
+	bool
+	empty() const
+	{
+		return my_begin == my_end;
+	}
+
+	/** @return true if the range contains more buckets than grainsize. */
+	bool
+	is_divisible() const
+	{
+		return my_end - my_begin > my_grainsize;
+	}
+
+	/** @return an iterator to the first element in the range. */
+	iterator
+	begin() const
+	{
+		return iterator(my_map, my_begin);
+	}
+
+	/** @return an iterator past the last element in the range. */
+	iterator
+	end() const
+	{
+		return iterator(my_map, my_end);
+	}
+
+	/** @return minimal number of buckets in a range which is split. */
+	size_type
+	grainsize() const
+	{
+		return my_grainsize;
+	}
+
+private:
+	friend class hash_map_range<map_type, true>;
+
+	map_ptr my_map;
+
+	/* Indexes of the first and past the last bucket in the range */
+	size_type my_begin;
+	size_type my_end;
+
+	size_type my_grainsize;
+};
 } /* namespace concurrent_hash_map_internal */
 /** @endcond */
 
@@ -1583,7 +2282,10 @@ operator!=(const hash_map_iterator<Container, M> &i,
  *
  * Each time, the pool with concurrent_hash_map is being opened, the
  * concurrent_hash_map requires runtime_initialize() to be called (in order to
- * recalculate mask and restore the size).
+ * recalculate mask and restore the size). If the pool was opened with
+ * pmem::obj::pool::open(), runtime_initialize() is called automatically
+ * (in a thread-safe way) on the first access to the map, so calling it
+ * explicitly only moves that cost out of the first access.
  *
  * find(), insert(), erase() (and all overloads) are guaranteed to be
  * thread-safe.
@@ -1609,6 +2311,24 @@ operator!=(const hash_map_iterator<Container, M> &i,
  * improve performance if MutexType supports efficient upgrading and
  * downgrading operations.
  *
+ * LockPolicy defines how elements are locked by accessors. With the default
+ * hash_map_node_lock, every node contains a MutexType object. With
+ * hash_map_bucket_lock, nodes contain only the next pointer and the element
+ * (24 bytes for 8-byte key and value, instead of 88 bytes with
+ * pmem::obj::shared_mutex), and an accessor holds the lock of the bucket
+ * instead. In this mode, a thread holding an accessor must not call any other
+ * method of the map which locks buckets (find, insert, erase, iterating), as
+ * the bucket may be the same or may have to be rehashed from the locked one.
+ * The policy is stored in the layout, and opening a map with a different
+ * policy throws pmem::layout_error from runtime_initialize().
+ *
+ * If Hash defines cache_hash_code member type, every node additionally stores
+ * the hash code of its key (8 bytes). Keys are then compared only for nodes
+ * with a matching hash code, and rehashing of buckets never reads the keys.
+ * It is worth enabling for keys which are expensive to hash or compare, like
+ * long pmem::obj::string. As with the LockPolicy, the choice is stored in the
+ * layout and must not change between runs.
+ *
  * Testing note:
  * In some case, helgrind and drd might report lock ordering errors for
  * concurrent_hash_map. This might happen when calling find, insert or erase
@@ -1618,23 +2338,23 @@ operator!=(const hash_map_iterator<Container, M> &i,
  * @snippet doc_snippets/concurrent_hash_map.cpp concurrent_hash_map_example
  */
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 class concurrent_hash_map
-    : protected concurrent_hash_map_internal::hash_map_base<Key, T, MutexType,
-							    ScopedLockType> {
+    : protected concurrent_hash_map_internal::hash_map_base<
+	      Key, T, MutexType, ScopedLockType, LockPolicy,
+	      concurrent_hash_map_internal::has_cache_hash_code<Hash>::value> {
 	template <typename Container, bool is_const>
 	friend class concurrent_hash_map_internal::hash_map_iterator;
 
+	template <typename Container, bool is_const>
+	friend class concurrent_hash_map_internal::hash_map_range;
+
 public:
-	using size_type = typename concurrent_hash_map_internal::hash_map_base<
-		Key, T, MutexType, ScopedLockType>::size_type;
-	using hashcode_type =
-		typename concurrent_hash_map_internal::hash_map_base<
-			Key, T, MutexType, ScopedLockType>::hashcode_type;
+	using size_type = size_t;
+	using hashcode_type = size_t;
 	using key_type = Key;
 	using mapped_type = T;
-	using value_type = typename concurrent_hash_map_internal::hash_map_base<
-		Key, T, MutexType, ScopedLockType>::node::value_type;
+	using value_type = detail::pair<const Key, T>;
 	using difference_type = ptrdiff_t;
 	using pointer = value_type *;
 	using const_pointer = const value_type *;
@@ -1644,6 +2364,10 @@ public:
 		concurrent_hash_map, false>;
 	using const_iterator = concurrent_hash_map_internal::hash_map_iterator<
 		concurrent_hash_map, true>;
+	using range_type = concurrent_hash_map_internal::hash_map_range<
+		concurrent_hash_map, false>;
+	using const_range_type = concurrent_hash_map_internal::hash_map_range<
+		concurrent_hash_map, true>;
 	using hasher = Hash;
 	using key_equal = typename concurrent_hash_map_internal::key_equal_type<
 		Hash, KeyEqual>::type;
@@ -1654,9 +2378,12 @@ protected:
 	/*
 	 * Explicitly use methods and types from template base class
 	 */
-	using hash_map_base =
-		concurrent_hash_map_internal::hash_map_base<Key, T, mutex_t,
-							    scoped_t>;
+	using hash_map_base = concurrent_hash_map_internal::hash_map_base<
+		Key, T, mutex_t, scoped_t, LockPolicy,
+		concurrent_hash_map_internal::has_cache_hash_code<
+			Hash>::value>;
+	using hash_map_base::bucket_lock_policy;
+	using hash_map_base::cached_hash;
 	using hash_map_base::calculate_mask;
 	using hash_map_base::check_growth;
 	using hash_map_base::check_mask_race;
@@ -1671,6 +2398,7 @@ protected:
 	using hash_map_base::mask;
 	using hash_map_base::reserve;
 	using tls_t = typename hash_map_base::tls_t;
+	using hot_cache_t = typename hash_map_base::hot_cache_t;
 	using node = typename hash_map_base::node;
 	using node_mutex_t = typename node::mutex_t;
 	using node_ptr_t = typename hash_map_base::node_ptr_t;
@@ -1693,9 +2421,37 @@ protected:
 				.get_persistent_ptr(this->my_pool_uuid));
 	}
 
+	using cached_hash_type = std::integral_constant<bool, cached_hash>;
+
+	/*
+	 * Checks if the node contains the key with the hash code h.
+	 */
+	template <typename K>
+	bool
+	node_has_key(const node *n, const K &key, hashcode_type h,
+		     std::false_type) const
+	{
+		(void)h;
+
+		return key_equal{}(key, n->item.first);
+	}
+
+	/*
+	 * With cached hash codes, keys are compared only if the hash codes
+	 * match, so most of the nodes on a chain are skipped without reading
+	 * their keys.
+	 */
+	template <typename K>
+	bool
+	node_has_key(const node *n, const K &key, hashcode_type h,
+		     std::true_type) const
+	{
+		return n->hash.get_ro() == h && key_equal{}(key, n->item.first);
+	}
+
 	template <typename K>
 	persistent_node_ptr_t
-	search_bucket(const K &key, bucket *b) const
+	search_bucket(const K &key, hashcode_type h, bucket *b) const
 	{
 		assert(b->is_rehashed(std::memory_order_relaxed));
 
@@ -1704,8 +2460,8 @@ protected:
 				b->node_list);
 
 		while (n &&
-		       !key_equal{}(key,
-				    n.get(this->my_pool_uuid)->item.first)) {
+		       !node_has_key(n.get(this->my_pool_uuid), key, h,
+				     cached_hash_type{})) {
 			n = detail::static_persistent_pool_pointer_cast<node>(
 				n.get(this->my_pool_uuid)->next);
 		}
@@ -1713,11 +2469,39 @@ protected:
 		return n;
 	}
 
+	/*
+	 * Creates a new node in the bucket b. The hash code h is stored in the
+	 * node only if hash codes are cached.
+	 */
+	template <typename... Args>
+	size_type
+	create_node(bucket *b, persistent_node_ptr_t &n, hashcode_type h,
+		    std::false_type, Args &&... args)
+	{
+		if (this->my_filter)
+			this->my_filter->add(h);
+
+		return insert_new_node(b, n, std::forward<Args>(args)...);
+	}
+
+	template <typename... Args>
+	size_type
+	create_node(bucket *b, persistent_node_ptr_t &n, hashcode_type h,
+		    std::true_type, Args &&... args)
+	{
+		if (this->my_filter)
+			this->my_filter->add(h);
+
+		return insert_new_node(b, n, h, std::forward<Args>(args)...);
+	}
+
 	/**
 	 * Bucket accessor is to find, rehash, acquire a lock, and access a
 	 * bucket
 	 */
 	class bucket_accessor : public bucket_lock_type {
+		friend class concurrent_hash_map;
+
 		bucket *my_b;
 
 	public:
@@ -1858,7 +2642,7 @@ protected:
 	};
 
 	hashcode_type
-	get_hash_code(node_ptr_t &n)
+	get_hash_code(node_ptr_t &n, std::false_type)
 	{
 		return hasher{}(
 			detail::static_persistent_pool_pointer_cast<node>(n)(
@@ -1866,6 +2650,23 @@ protected:
 				->item.first);
 	}
 
+	/*
+	 * With cached hash codes, the key does not have to be read.
+	 */
+	hashcode_type
+	get_hash_code(node_ptr_t &n, std::true_type)
+	{
+		return detail::static_persistent_pool_pointer_cast<node>(n)(
+			       this->my_pool_uuid)
+			->hash.get_ro();
+	}
+
+	hashcode_type
+	get_hash_code(node_ptr_t &n)
+	{
+		return get_hash_code(n, cached_hash_type{});
+	}
+
 	template <bool serial>
 	void
 	rehash_bucket(bucket *b_new, const hashcode_type h)
@@ -1972,7 +2773,8 @@ public:
 	class const_accessor
 	    : protected node::scoped_t /*which derived from no_copy*/ {
 		friend class concurrent_hash_map<Key, T, Hash, KeyEqual,
-						 mutex_t, scoped_t>;
+						 mutex_t, scoped_t,
+						 LockPolicy>;
 		friend class accessor;
 		using node_ptr_t = pmem::obj::persistent_ptr<node>;
 		using node::scoped_t::try_acquire;
@@ -2006,6 +2808,7 @@ public:
 			concurrent_hash_map_internal::check_outside_tx();
 
 			if (my_node) {
+				invalidate_cache();
 				node::scoped_t::release();
 				my_node = 0;
 			}
@@ -2034,7 +2837,8 @@ public:
 		 *
 		 * Cannot be used in a transaction.
 		 */
-		const_accessor() : my_node(OID_NULL), my_hash()
+		const_accessor()
+		    : my_node(OID_NULL), my_hash(), my_cache(nullptr)
 		{
 			concurrent_hash_map_internal::check_outside_tx();
 		}
@@ -2044,14 +2848,32 @@ public:
 		 */
 		~const_accessor()
 		{
+			invalidate_cache();
 			my_node = OID_NULL; // scoped lock's release() is called
 					    // in its destructor
 		}
 
 	protected:
+		/*
+		 * Drops the cached copy of the element, which might have been
+		 * modified through this accessor. Must be called before the
+		 * element is unlocked.
+		 */
+		void
+		invalidate_cache() noexcept
+		{
+			if (my_cache) {
+				my_cache->invalidate(my_hash);
+				my_cache = nullptr;
+			}
+		}
+
 		node_ptr_t my_node;
 
 		hashcode_type my_hash;
+
+		/* Cache to invalidate on release, set for write access */
+		hot_cache_t *my_cache;
 	};
 
 	/**
@@ -2159,13 +2981,15 @@ public:
 
 		calculate_mask();
 
+		this->release_volatile_data();
+
 		/*
 		 * Handle case where hash_map was created without
 		 * FEATURE_CONSISTENT_SIZE.
 		 */
 		if (!(layout_features.compat & FEATURE_CONSISTENT_SIZE)) {
-			auto actual_size =
-				std::distance(this->begin(), this->end());
+			auto actual_size = std::distance(
+				iterator(this, 0), iterator(this, mask() + 1));
 			assert(actual_size >= 0);
 
 			this->my_size = static_cast<size_t>(actual_size);
@@ -2185,8 +3009,13 @@ public:
 			this->tls_restore();
 		}
 
-		assert(this->size() ==
-		       size_type(std::distance(this->begin(), this->end())));
+		assert(hash_map_base::size() ==
+		       size_type(std::distance(iterator(this, 0),
+					       iterator(this, mask() + 1))));
+
+		auto state = this->init_state();
+		if (state)
+			state->mark();
 	}
 
 	[[deprecated(
@@ -2197,16 +3026,23 @@ public:
 
 		calculate_mask();
 
+		this->release_volatile_data();
+
 		if (!graceful_shutdown) {
-			auto actual_size =
-				std::distance(this->begin(), this->end());
+			auto actual_size = std::distance(
+				iterator(this, 0), iterator(this, mask() + 1));
 			assert(actual_size >= 0);
 			this->my_size = static_cast<size_type>(actual_size);
 		} else {
-			assert(this->size() ==
-			       size_type(std::distance(this->begin(),
-						       this->end())));
+			assert(hash_map_base::size() ==
+			       size_type(std::distance(
+				       iterator(this, 0),
+				       iterator(this, mask() + 1))));
 		}
+
+		auto state = this->init_state();
+		if (state)
+			state->mark();
 	}
 
 	/**
@@ -2264,6 +3100,39 @@ public:
 	 */
 	void rehash(size_type n = 0);
 
+	/**
+	 * Reduces the number of buckets to the smallest power of 2, which
+	 * is not lower than n and is big enough for the current number of
+	 * elements (so that the table does not grow on the next insert).
+	 * Buckets of the removed segments are merged into their parent
+	 * buckets and the segments are freed. The first block of buckets is
+	 * never freed, use clear() for that.
+	 *
+	 * Buckets are merged in a series of small transactions. After each
+	 * of them the merged buckets are marked as not rehashed, so the
+	 * table is consistent if the operation is interrupted, and calling
+	 * it again completes the shrinking.
+	 * Not thread safe.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 */
+	void rehash_down(size_type n = 0);
+
+	/**
+	 * Reduces the number of buckets to the minimum required by the
+	 * current number of elements. Equivalent to rehash_down(0).
+	 * Not thread safe.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 */
+	void
+	shrink_to_fit()
+	{
+		rehash_down(0);
+	}
+
 	/**
 	 * Clear hash map content
 	 * Not thread safe.
@@ -2287,8 +3156,17 @@ public:
 	void
 	free_data()
 	{
-		if (!this->tls_ptr)
+		/* already freed, possibly in an earlier open of the pool, in
+		 * which case it cannot be initialized anymore */
+		if (!this->tls_ptr) {
+			this->release_volatile_data();
 			return;
+		}
+
+		lazy_initialize();
+
+		this->free_cache();
+		this->free_filter();
 
 		auto pop = get_pool_base();
 
@@ -2328,6 +3206,8 @@ public:
 	iterator
 	begin()
 	{
+		lazy_initialize();
+
 		return iterator(this, 0);
 	}
 
@@ -2338,6 +3218,8 @@ public:
 	iterator
 	end()
 	{
+		lazy_initialize();
+
 		return iterator(this, mask() + 1);
 	}
 
@@ -2348,6 +3230,8 @@ public:
 	const_iterator
 	begin() const
 	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
 		return const_iterator(this, 0);
 	}
 
@@ -2358,15 +3242,45 @@ public:
 	const_iterator
 	end() const
 	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
 		return const_iterator(this, mask() + 1);
 	}
 
+	/**
+	 * @returns a range of all buckets, which can be split into
+	 * subranges of at least grainsize buckets and processed in parallel.
+	 * Not thread safe.
+	 */
+	range_type
+	range(size_type grainsize = 1)
+	{
+		lazy_initialize();
+
+		return range_type(this, 0, mask() + 1, grainsize);
+	}
+
+	/**
+	 * @returns a range of all buckets, which can be split into
+	 * subranges of at least grainsize buckets and processed in parallel.
+	 * Not thread safe.
+	 */
+	const_range_type
+	range(size_type grainsize = 1) const
+	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
+		return const_range_type(this, 0, mask() + 1, grainsize);
+	}
+
 	/**
 	 * @returns number of items in table.
 	 */
 	size_type
 	size() const
 	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
 		return hash_map_base::size();
 	}
 
@@ -2379,22 +3293,100 @@ public:
 		return this->size() == 0;
 	}
 
-	/**
-	 * Upper bound on size.
-	 */
-	size_type
-	max_size() const
-	{
-		return (~size_type(0)) / sizeof(node);
+	/**
+	 * Upper bound on size.
+	 */
+	size_type
+	max_size() const
+	{
+		return (~size_type(0)) / sizeof(node);
+	}
+
+	/**
+	 * @returns the current number of buckets
+	 */
+	size_type
+	bucket_count() const
+	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
+		return mask() + 1;
+	}
+
+	/**
+	 * Returns memory used by the hash map. Metadata includes the hash
+	 * map object, enabled buckets, node headers and thread specific
+	 * data. Slack are buckets which are allocated, but not enabled yet.
+	 *
+	 * Not thread safe with respect to rehashing.
+	 *
+	 * @return memory_usage_stats struct.
+	 */
+	memory_usage_stats
+	memory_usage() const
+	{
+		using const_segment_facade_t =
+			typename hash_map_base::const_segment_facade_t;
+		using tls_data_t = typename hash_map_base::tls_data_t;
+
+		size_type buckets = bucket_count();
+		size_type allocated = embedded_buckets;
+
+		if (this->my_table[segment_traits_t::embedded_segments] !=
+		    nullptr) {
+			segment_index_t s = segment_traits_t::first_block;
+			allocated = segment_traits_t::segment_size(s);
+
+			for (; s < segment_traits_t::number_of_segments; ++s) {
+				const_segment_facade_t segment(this->my_table,
+							       s);
+				if (!segment.is_valid())
+					break;
+
+				allocated += segment.size();
+			}
+		}
+
+		memory_usage_stats usage;
+		usage.data = size() * sizeof(value_type);
+		usage.metadata = sizeof(*this) +
+			(buckets - embedded_buckets) * sizeof(bucket) +
+			size() * (sizeof(node) - sizeof(value_type));
+		usage.slack = (allocated - buckets) * sizeof(bucket);
+
+		if (this->tls_ptr != nullptr)
+			usage.metadata += sizeof(tls_t) +
+				this->tls_ptr->size() * sizeof(tls_data_t);
+
+		return usage;
 	}
 
 	/**
-	 * @returns the current number of buckets
+	 * Brings the segment table and the enabled buckets into the CPU
+	 * cache, faulting in their pages if needed. Useful right after the
+	 * pool is opened, e.g. from a background thread, so that the first
+	 * lookups do not wait for it. Elements are not touched.
+	 *
+	 * Thread safe, buckets enabled meanwhile may be skipped.
 	 */
-	size_type
-	bucket_count() const
+	void
+	prefetch_metadata() const
 	{
-		return mask() + 1;
+		using const_segment_facade_t =
+			typename hash_map_base::const_segment_facade_t;
+
+		hashcode_type m = mask().load(std::memory_order_acquire);
+
+		detail::touch(this, sizeof(*this));
+
+		segment_index_t last = segment_traits_t::segment_index_of(m);
+		for (segment_index_t s = segment_traits_t::embedded_segments;
+		     s <= last; ++s) {
+			const_segment_facade_t segment(this->my_table, s);
+
+			for (size_type i = 0; i < segment.size(); ++i)
+				detail::touch(&segment[i], sizeof(bucket));
+		}
 	}
 
 	/**
@@ -2534,6 +3526,225 @@ public:
 
 		return internal_find(key, &result, true);
 	}
+
+	/**
+	 * Find n items with keys from the keys array and call
+	 * f(i, item) for each keys[i] which was found. A read lock on
+	 * the item is held while f is being called.
+	 *
+	 * Contrary to a loop of find() calls, the lookups are done in
+	 * batches: hash codes of all keys in a batch are computed first
+	 * and the buckets (and the keys of the next batch) are prefetched
+	 * before the keys are compared, so that many cache misses are in
+	 * flight at the same time. Each key is then looked up under the
+	 * bucket lock, as in find().
+	 *
+	 * The callback must not call any other method of the map.
+	 *
+	 * @return number of keys found.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw rethrows exception thrown by f
+	 */
+	template <typename F>
+	size_type
+	find_many(const Key *keys, size_type n, F f) const
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+
+		return const_cast<concurrent_hash_map *>(this)
+			->internal_find_many(keys, n, f);
+	}
+
+	/**
+	 * Find n items with keys from the keys array and call
+	 * f(i, item) for each keys[i] which was found. A read lock on
+	 * the item is held while f is being called.
+	 *
+	 * This overload only participates in overload resolution if the
+	 * qualified-id Hash::transparent_key_equal is valid and denotes a type.
+	 * This assumes that such Hash is callable with both K and Key type, and
+	 * that its key_equal is transparent, which, together, allows calling
+	 * this function without constructing an instance of Key
+	 *
+	 * @return number of keys found.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw rethrows exception thrown by f
+	 */
+	template <typename K, typename F,
+		  typename = typename std::enable_if<
+			  concurrent_hash_map_internal::
+				  has_transparent_key_equal<hasher>::value,
+			  K>::type>
+	size_type
+	find_many(const K *keys, size_type n, F f) const
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+
+		return const_cast<concurrent_hash_map *>(this)
+			->internal_find_many(keys, n, f);
+	}
+
+	/**
+	 * Enables a size-bounded cache of copies of elements in DRAM, used by
+	 * find_cached(). The number of slots is rounded up to a power of 2,
+	 * each slot can hold one element. Passing 0 disables the cache and
+	 * frees its memory. Hit and miss counters start from 0.
+	 *
+	 * The cache is invalidated when an element is released by an
+	 * accessor (which allows modifying it), erased or when the map is
+	 * cleared. Elements modified in other ways (e.g. through iterators)
+	 * are not invalidated.
+	 *
+	 * The cache is not persistent. It has to be enabled again after the
+	 * pool is reopened and is freed when the pool is closed. In pools
+	 * opened with the C API it must be disabled before the pool is
+	 * closed, otherwise its memory is leaked.
+	 *
+	 * Key and T must be trivially destructible and must not own any
+	 * resources (like p<int>), as the cache copies them bitwise.
+	 *
+	 * Not thread safe. No accessor may be held while calling it.
+	 *
+	 * @throw std::bad_alloc if the cache cannot be allocated.
+	 */
+	void
+	enable_cache(size_type capacity)
+	{
+		static_assert(std::is_trivially_destructible<Key>::value &&
+				      std::is_trivially_destructible<T>::value,
+			      "Key and T must be trivially destructible");
+
+		lazy_initialize();
+
+		this->free_cache();
+
+		if (capacity == 0)
+			return;
+
+		std::unique_ptr<hot_cache_t> cache(new hot_cache_t(capacity));
+
+		hot_cache_t *c = cache.get();
+		detail::release_on_close(get_pool_base().handle(),
+					 &this->my_cache, [c] { delete c; });
+
+		this->my_cache = cache.release();
+	}
+
+	/**
+	 * @return number of slots of the DRAM cache or 0 if it is disabled.
+	 */
+	size_type
+	cache_capacity() const
+	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
+		return this->my_cache ? this->my_cache->capacity() : 0;
+	}
+
+	/**
+	 * @return hit and miss counters of find_cached() since the cache was
+	 * enabled.
+	 */
+	cache_stats
+	get_cache_stats() const
+	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
+		if (!this->my_cache)
+			return cache_stats{0, 0};
+
+		return this->my_cache->stats();
+	}
+
+	/**
+	 * Copies the value of the element with the given key to result.
+	 * If the element is in the DRAM cache (see enable_cache()), the
+	 * persistent memory is not accessed at all. Otherwise, the element
+	 * is searched for like with find() and offered to the cache.
+	 *
+	 * @return true if the element was found.
+	 *
+	 * @throw pmem::transaction_scope_error if the element is not in the
+	 * cache and the method is called inside transaction
+	 */
+	bool
+	find_cached(const Key &key, mapped_type &result) const
+	{
+		const_cast<concurrent_hash_map *>(this)->lazy_initialize();
+
+		hashcode_type h = hasher{}(key);
+		hot_cache_t *cache = this->my_cache;
+
+		if (cache && cache->find(key, h, result, key_equal{}))
+			return true;
+
+		concurrent_hash_map_internal::check_outside_tx();
+
+		const_accessor acc;
+		if (!const_cast<concurrent_hash_map *>(this)->internal_find(
+			    key, h, &acc, false))
+			return false;
+
+		if (cache)
+			cache->admit(h, acc->first, acc->second);
+
+		result = acc->second;
+
+		return true;
+	}
+
+	/**
+	 * Enables a Bloom filter of the keys in DRAM, which lets find(),
+	 * count(), find_many() and erase() return immediately, without
+	 * locking a bucket or accessing persistent memory, for most keys
+	 * which are not in the map. The filter is sized for the given number
+	 * of elements and false positive rate and built from the current
+	 * content of the map. Passing 0 as expected_elements disables the
+	 * filter and frees its memory.
+	 *
+	 * Keys cannot be removed from the filter, so the false positive rate
+	 * grows with the number of erased and inserted keys; enable_filter()
+	 * can be called again to rebuild it. swap() disables the filters of
+	 * both maps.
+	 *
+	 * The filter is not persistent. It has to be enabled again after the
+	 * pool is reopened and is freed when the pool is closed. In pools
+	 * opened with the C API it must be disabled before the pool is
+	 * closed, otherwise its memory is leaked.
+	 *
+	 * Not thread safe.
+	 *
+	 * @throw std::invalid_argument if false_positive_rate is not in
+	 * range (0, 1).
+	 * @throw std::bad_alloc if the filter cannot be allocated.
+	 */
+	void
+	enable_filter(size_type expected_elements,
+		      double false_positive_rate = 0.01)
+	{
+		lazy_initialize();
+
+		this->free_filter();
+
+		if (expected_elements == 0)
+			return;
+
+		std::unique_ptr<detail::bloom_filter> filter(
+			new detail::bloom_filter(expected_elements,
+						 false_positive_rate));
+
+		for (auto it = begin(); it != end(); ++it)
+			filter->add(hasher{}(it->first));
+
+		detail::bloom_filter *f = filter.get();
+		detail::release_on_close(get_pool_base().handle(),
+					 &this->my_filter, [f] { delete f; });
+
+		this->my_filter = filter.release();
+	}
+
 	/**
 	 * Insert item (if not already present) and
 	 * acquire a read lock on the item.
@@ -2830,6 +4041,8 @@ public:
 			throw std::range_error("incorrect range");
 		}
 
+		lazy_initialize();
+
 		size_t max_index = mask().load(std::memory_order_acquire);
 		size_t start_index = (start_percent * max_index) / 100;
 		size_t end_index = (end_percent * max_index) / 100;
@@ -2900,6 +4113,70 @@ protected:
 	bool try_acquire_item(const_accessor *result, node_mutex_t &mutex,
 			      bool write);
 
+	/*
+	 * Acquires the element for the accessor, while the bucket containing
+	 * it is locked by b. With the node lock policy, the mutex of the node
+	 * is acquired.
+	 */
+	bool
+	acquire_item(bucket_accessor &b, const_accessor *result,
+		     const persistent_node_ptr_t &n, bool write,
+		     hash_map_node_lock)
+	{
+		(void)b;
+
+		return try_acquire_item(result, n.get(this->my_pool_uuid)->mutex,
+					write);
+	}
+
+	/*
+	 * With the bucket lock policy, the lock of the bucket is moved to the
+	 * accessor. It has to be a writer lock if write access is requested.
+	 */
+	bool
+	acquire_item(bucket_accessor &b, const_accessor *result,
+		     const persistent_node_ptr_t &n, bool write,
+		     hash_map_bucket_lock)
+	{
+		(void)n;
+
+		if (write && !b.is_writer() &&
+		    !scoped_lock_traits_type::upgrade_to_writer(b))
+			return false;
+
+		result->bucket_lock_type::mutex = b.bucket_lock_type::mutex;
+		result->bucket_lock_type::is_writer =
+			b.bucket_lock_type::is_writer;
+		b.bucket_lock_type::mutex = nullptr;
+		b.bucket_lock_type::is_writer = false;
+
+		return true;
+	}
+
+	/*
+	 * Waits until no accessor holds the node. Bucket containing the node
+	 * must be locked for write.
+	 */
+	bool
+	wait_for_item(node *n, hash_map_node_lock)
+	{
+		const_accessor acc;
+
+		return try_acquire_item(&acc, n->mutex, /*write=*/true);
+	}
+
+	/*
+	 * With the bucket lock policy, accessors hold the lock of the
+	 * bucket, so there is nothing to wait for.
+	 */
+	bool
+	wait_for_item(node *n, hash_map_bucket_lock)
+	{
+		(void)n;
+
+		return true;
+	}
+
 	/**
 	 * Vector of locks to be unlocked at the destruction time.
 	 * MutexType - type of mutex used by buckets.
@@ -2919,10 +4196,8 @@ protected:
 				b->node_list.get(base->my_pool_uuid));
 
 			while (node_ptr) {
-				const_accessor ca;
-				if (!base->try_acquire_item(&ca,
-							    node_ptr->mutex,
-							    /*write=*/true)) {
+				if (!base->wait_for_item(node_ptr,
+							 LockPolicy{})) {
 					vec.pop_back();
 					return nullptr;
 				}
@@ -2939,8 +4214,36 @@ protected:
 		std::vector<bucket_accessor> vec;
 	};
 
+	/*
+	 * Calls runtime_initialize() on the first access after the pool was
+	 * opened, if it was not called explicitly.
+	 */
+	void
+	lazy_initialize()
+	{
+		auto state = this->init_state();
+		if (state)
+			state->ensure([&] { runtime_initialize(); });
+	}
+
+	template <typename K>
+	bool
+	internal_find(const K &key, const_accessor *result, bool write)
+	{
+		lazy_initialize();
+
+		return internal_find(key, hasher{}(key), result, write);
+	}
+
 	template <typename K>
-	bool internal_find(const K &key, const_accessor *result, bool write);
+	bool internal_find(const K &key, hashcode_type h,
+			   const_accessor *result, bool write);
+
+	/* Number of keys looked up at once by find_many() */
+	static constexpr size_type find_many_batch = 16;
+
+	template <typename K, typename F>
+	size_type internal_find_many(const K *keys, size_type n, F &f);
 
 	template <typename K, typename... Args>
 	bool internal_insert(const K &key, const_accessor *result, bool write,
@@ -2949,10 +4252,10 @@ protected:
 	/* Obtain pointer to node and lock bucket */
 	template <bool Bucket_rw_lock, typename K>
 	persistent_node_ptr_t
-	get_node(const K &key, bucket_accessor &b)
+	get_node(const K &key, hashcode_type h, bucket_accessor &b)
 	{
 		/* find a node */
-		auto n = search_bucket(key, b.get());
+		auto n = search_bucket(key, h, b.get());
 
 		if (!n) {
 			if (Bucket_rw_lock && !b.is_writer() &&
@@ -2960,7 +4263,7 @@ protected:
 				/* Rerun search_list, in case another
 				 * thread inserted the item during the
 				 * upgrade. */
-				n = search_bucket(key, b.get());
+				n = search_bucket(key, h, b.get());
 				if (n) {
 					/* unfortunately, it did */
 					scoped_lock_traits_type::
@@ -2978,6 +4281,8 @@ protected:
 
 	void clear_segment(segment_index_t s);
 
+	void merge_segment(pool_base &pop, segment_index_t s);
+
 	/**
 	 * Copy "source" to *this, where *this must start out empty.
 	 */
@@ -3012,12 +4317,12 @@ protected:
 }; // class concurrent_hash_map
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 bool
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::try_acquire_item(const_accessor *result,
-						      node_mutex_t &mutex,
-						      bool write)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::try_acquire_item(const_accessor *result,
+						  node_mutex_t &mutex,
+						  bool write)
 {
 	/* acquire the item */
 	if (!result->try_acquire(mutex, write)) {
@@ -3034,16 +4339,19 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 template <typename K>
 bool
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::internal_find(const K &key,
-						   const_accessor *result,
-						   bool write)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_find(const K &key, hashcode_type h,
+					       const_accessor *result,
+					       bool write)
 {
 	assert(!result || !result->my_node);
 
+	if (this->my_filter && !this->my_filter->may_contain(h))
+		return false;
+
 	hashcode_type m = mask().load(std::memory_order_acquire);
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 	ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
@@ -3051,16 +4359,14 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 
 	assert((m & (m + 1)) == 0);
 
-	hashcode_type const h = hasher{}(key);
-
 	persistent_node_ptr_t node;
 
 	while (true) {
 		/* get bucket and acquire the lock */
-		bucket_accessor b(
-			this, h & m,
-			scoped_lock_traits_type::initial_rw_state(false));
-		node = get_node<false>(key, b);
+		bucket_accessor b(this, h & m,
+				  scoped_lock_traits_type::initial_rw_state(
+					  bucket_lock_policy && write));
+		node = get_node<false>(key, h, b);
 
 		if (!node) {
 			/* Element was possibly relocated, try again */
@@ -3074,8 +4380,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 
 		/* No need to acquire the item or item acquired */
 		if (!result ||
-		    try_acquire_item(
-			    result, node.get(this->my_pool_uuid)->mutex, write))
+		    acquire_item(b, result, node, write, LockPolicy{}))
 			break;
 
 		/* the wait takes really long, restart the
@@ -3093,23 +4398,84 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 	if (result) {
 		result->my_node = node.get_persistent_ptr(this->my_pool_uuid);
 		result->my_hash = h;
+		result->my_cache = write ? this->my_cache : nullptr;
 	}
 
 	return true;
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
+template <typename K, typename F>
+typename concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
+			     ScopedLockType, LockPolicy>::size_type
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_find_many(const K *keys, size_type n,
+						    F &f)
+{
+	lazy_initialize();
+
+	hashcode_type hashes[find_many_batch];
+	bool may_exist[find_many_batch];
+	size_type found = 0;
+
+	for (size_type first = 0; first < n; first += find_many_batch) {
+		const K *batch = keys + first;
+		size_type cnt = (std::min)(n - first,
+					  size_type(find_many_batch));
+
+		hashcode_type m = mask().load(std::memory_order_acquire);
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
+#endif
+
+		/* Compute all hash codes and prefetch the buckets, keys
+		 * rejected by the filter are skipped; the keys of the next
+		 * batch are prefetched as well, as the caller's array may be
+		 * cold too. The nodes are not prefetched: the head of an
+		 * unlocked bucket cannot be read without a data race. */
+		for (size_type i = 0; i < cnt; ++i) {
+			if (first + find_many_batch + i < n)
+				detail::prefetch(batch + find_many_batch + i);
+
+			hashes[i] = hasher{}(batch[i]);
+			may_exist[i] = !this->my_filter ||
+				this->my_filter->may_contain(hashes[i]);
+
+			if (may_exist[i])
+				detail::prefetch(get_bucket(hashes[i] & m));
+		}
+
+		/* Compare the keys, each key is looked up (and its bucket
+		 * locked) exactly once; the mask might have changed
+		 * meanwhile, which is handled by internal_find */
+		for (size_type i = 0; i < cnt; ++i) {
+			const_accessor acc;
+
+			if (may_exist[i] &&
+			    internal_find(batch[i], hashes[i], &acc, false)) {
+				f(first + i, *acc);
+				++found;
+			}
+		}
+	}
+
+	return found;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 template <typename K, typename... Args>
 bool
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::internal_insert(const K &key,
-						     const_accessor *result,
-						     bool write,
-						     Args &&... args)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_insert(const K &key,
+						 const_accessor *result,
+						 bool write, Args &&... args)
 {
 	assert(!result || !result->my_node);
 
+	lazy_initialize();
+
 	hashcode_type m = mask().load(std::memory_order_acquire);
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 	ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
@@ -3128,7 +4494,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 		bucket_accessor b(
 			this, h & m,
 			scoped_lock_traits_type::initial_rw_state(true));
-		node = get_node<true>(key, b);
+		node = get_node<true>(key, h, b);
 
 		if (!node) {
 			/* Element was possibly relocated, try again */
@@ -3138,15 +4504,15 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 			}
 
 			/* insert and set flag to grow the container */
-			new_size = insert_new_node(b.get(), node,
-						   std::forward<Args>(args)...);
+			new_size = create_node(b.get(), node, h,
+					       cached_hash_type{},
+					       std::forward<Args>(args)...);
 			inserted = true;
 		}
 
 		/* No need to acquire the item or item acquired */
 		if (!result ||
-		    try_acquire_item(
-			    result, node.get(this->my_pool_uuid)->mutex, write))
+		    acquire_item(b, result, node, write, LockPolicy{}))
 			break;
 
 		/* the wait takes really long, restart the
@@ -3164,6 +4530,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 	if (result) {
 		result->my_node = node.get_persistent_ptr(this->my_pool_uuid);
 		result->my_hash = h;
+		result->my_cache = write ? this->my_cache : nullptr;
 	}
 
 	check_growth(m, new_size);
@@ -3172,14 +4539,20 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 template <typename K>
 bool
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::internal_erase(const K &key)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_erase(const K &key)
 {
+	lazy_initialize();
+
 	node_ptr_t n;
 	hashcode_type const h = hasher{}(key);
+
+	if (this->my_filter && !this->my_filter->may_contain(h))
+		return false;
+
 	hashcode_type m = mask().load(std::memory_order_acquire);
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 	ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
@@ -3198,10 +4571,9 @@ search:
 	n = *p;
 
 	while (n &&
-	       !key_equal{}(key,
-			    detail::static_persistent_pool_pointer_cast<node>(
-				    n)(this->my_pool_uuid)
-				    ->item.first)) {
+	       !node_has_key(detail::static_persistent_pool_pointer_cast<node>(
+				     n)(this->my_pool_uuid),
+			     key, h, cached_hash_type{})) {
 		p = &n(this->my_pool_uuid)->next;
 		n = *p;
 	}
@@ -3227,8 +4599,7 @@ search:
 		 * other threads might work with this element via
 		 * accessors. The item_locker required to wait while
 		 * other threads use the node. */
-		const_accessor acc;
-		if (!try_acquire_item(&acc, del->mutex, true)) {
+		if (!wait_for_item(del.get(), LockPolicy{})) {
 			/* the wait takes really long, restart the operation */
 			b.release();
 
@@ -3254,28 +4625,44 @@ search:
 	});
 
 	--(this->my_size);
+
+	if (this->my_cache)
+		this->my_cache->invalidate(h);
 }
 
 	return true;
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::swap(
-	concurrent_hash_map<Key, T, Hash, KeyEqual, mutex_t, scoped_t> &table)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::swap(concurrent_hash_map &table)
 {
+	lazy_initialize();
+	table.lazy_initialize();
+
+	if (this->my_cache)
+		this->my_cache->clear();
+	if (table.my_cache)
+		table.my_cache->clear();
+
+	this->free_filter();
+	table.free_filter();
+
 	internal_swap(table);
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::rehash(
-	size_type sz)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::rehash(size_type sz)
 {
 	concurrent_hash_map_internal::check_outside_tx();
 
+	lazy_initialize();
+
 	reserve(sz);
 	hashcode_type m = mask();
 
@@ -3299,12 +4686,125 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::rehash(
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::rehash_down(size_type n)
+{
+	concurrent_hash_map_internal::check_outside_tx();
+
+	lazy_initialize();
+
+	hashcode_type m = mask();
+	hashcode_type min_mask =
+		segment_traits_t::segment_size(this->first_block) - 1;
+
+	if (m <= min_mask)
+		return;
+
+	hashcode_type new_mask =
+		static_cast<hashcode_type>(
+			detail::next_pow_2(static_cast<uint64_t>(n))) -
+		1;
+	new_mask = (std::max)(new_mask, min_mask);
+
+	/* the table grows when size() >= mask(), see check_growth() */
+	while (new_mask <= this->size())
+		new_mask = (new_mask << 1) | 1;
+
+	pool_base pop = get_pool_base();
+
+	for (segment_index_t s = segment_traits_t::segment_index_of(m);
+	     mask() > new_mask; --s)
+		merge_segment(pop, s);
+}
+
+/*
+ * Moves nodes from buckets of the last segment s to their parent buckets
+ * and disables the segment.
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::merge_segment(pool_base &pop,
+					       segment_index_t s)
+{
+	/* number of buckets merged in a single transaction */
+	const size_type batch = 1024;
+
+	segment_facade_t segment(this->my_table, s);
+
+	assert(s >= this->first_block);
+	assert(segment.is_valid());
+	assert(segment_traits_t::segment_index_of(mask()) == s);
+
+	/* parent of the bucket segment_base(s) + i is the bucket i */
+	hashcode_type base = segment_traits_t::segment_base(s);
+	size_type sz = segment.size();
+
+	for (size_type first = 0; first < sz; first += batch) {
+		size_type last = (std::min)(first + batch, sz);
+
+		/* nodes cannot be added to a not rehashed parent, as its
+		 * nodes would be taken for the nodes of the child */
+		for (size_type i = first; i < last; ++i) {
+			bucket *parent = get_bucket(i);
+
+			if (!parent->is_rehashed(std::memory_order_relaxed))
+				rehash_bucket<true>(parent, i);
+		}
+
+		transaction::run(pop, [&] {
+			for (size_type i = first; i < last; ++i) {
+				bucket *b = &segment[i];
+				bucket *parent = get_bucket(i);
+
+				concurrent_hash_map_internal::assert_not_locked<
+					mutex_t, scoped_t>(b->mutex);
+
+				if (b->node_list) {
+					node_ptr_t *tail = &(b->node_list);
+					while (*tail) {
+						auto n = tail->get(
+							this->my_pool_uuid);
+						tail = &(n->next);
+					}
+
+					*tail = parent->node_list;
+					parent->node_list = b->node_list;
+					b->node_list = nullptr;
+				}
+
+				/* nodes can be found through the parent
+				 * until the segment is disabled */
+				b->rehashed.get_rw().store(
+					false, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	transaction::run(pop, [&] {
+		segment.disable();
+
+		transaction::snapshot((size_t *)&this->my_mask);
+		mask().store(base - 1, std::memory_order_relaxed);
+	});
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear()
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::clear()
 {
+	lazy_initialize();
+
 	hashcode_type m = mask();
 
+	if (this->my_cache)
+		this->my_cache->clear();
+
 	assert((m & (m + 1)) == 0);
 
 #ifndef NDEBUG
@@ -3353,10 +4853,10 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear()
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::clear_segment(segment_index_t s)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::clear_segment(segment_index_t s)
 {
 	segment_facade_t segment(this->my_table, s);
 
@@ -3376,10 +4876,11 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::
-	internal_copy(const concurrent_hash_map &source)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_copy(const concurrent_hash_map
+						       &source)
 {
 	auto pop = get_pool_base();
 
@@ -3388,11 +4889,11 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 template <typename I>
 void
-concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::internal_copy(I first, I last)
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+		    LockPolicy>::internal_copy(I first, I last)
 {
 	hashcode_type m = mask();
 
@@ -3403,28 +4904,30 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 		assert(b->is_rehashed(std::memory_order_relaxed));
 
 		detail::persistent_pool_ptr<node> p;
-		insert_new_node(b, p, *first);
+		create_node(b, p, h, cached_hash_type{}, *first);
 	}
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 inline bool
 operator==(const concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType> &a,
+				     ScopedLockType, LockPolicy> &a,
 	   const concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType> &b)
+				     ScopedLockType, LockPolicy> &b)
 {
 	if (a.size() != b.size())
 		return false;
 
 	typename concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType>::const_iterator
+				     ScopedLockType,
+				     LockPolicy>::const_iterator
 		i(a.begin()),
 		i_end(a.end());
 
 	typename concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType>::const_iterator j,
+				     ScopedLockType,
+				     LockPolicy>::const_iterator j,
 		j_end(b.end());
 
 	for (; i != i_end; ++i) {
@@ -3438,21 +4941,23 @@ operator==(const concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 inline bool
 operator!=(const concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType> &a,
+				     ScopedLockType, LockPolicy> &a,
 	   const concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-				     ScopedLockType> &b)
+				     ScopedLockType, LockPolicy> &b)
 {
 	return !(a == b);
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
-	  typename MutexType, typename ScopedLockType>
+	  typename MutexType, typename ScopedLockType, typename LockPolicy>
 inline void
-swap(concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType> &a,
-     concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType> &b)
+swap(concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+			 LockPolicy> &a,
+     concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType,
+			 LockPolicy> &b)
 {
 	a.swap(b);
 }
@@ -8,20 +8,27 @@
 #include <array>
 #include <atomic>
 #include <cstdlib>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <mutex> /* for std::unique_lock */
 #include <random>
 #include <type_traits>
 
+#include <libpmemobj++/defrag.hpp>
+#include <libpmemobj++/detail/bloom_filter.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/enumerable_thread_specific.hpp>
+#include <libpmemobj++/detail/lazy_init_state.hpp>
 #include <libpmemobj++/detail/life.hpp>
 #include <libpmemobj++/detail/pair.hpp>
 #include <libpmemobj++/detail/persistent_pool_ptr.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/template_helpers.hpp>
 #include <libpmemobj++/mutex.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj++/transaction.hpp>
 
 /* Windows has a max and a min macros which collides with min() and max()
@@ -471,7 +478,9 @@ public:
  *
  * Each time, the pool with concurrent_skip_list is being opened, the
  * concurrent_skip_list requires runtime_initialize() to be called in order to
- * restore the state after process restart.
+ * restore the state after process restart. If the pool was opened with
+ * pmem::obj::pool::open(), runtime_initialize() is called automatically
+ * (in a thread-safe way) on the first access which depends on that state.
  *
  * Traits template parameter allows to specify properties of the
  * concurrent_ski_list. The Traits type should has the following member types:
@@ -530,6 +539,10 @@ protected:
 	using node_lock_type = typename list_node_type::lock_type;
 	using lock_array = std::array<node_lock_type, MAX_LEVEL>;
 
+	/* func argument type definition for 'for_each_ptr' method */
+	using for_each_ptr_function =
+		std::function<void(obj::persistent_ptr_base &)>;
+
 public:
 	static constexpr bool allow_multimapping =
 		traits_type::allow_multimapping;
@@ -742,10 +755,16 @@ public:
 	void
 	runtime_initialize()
 	{
+		free_filter();
+
 		tls_restore();
 
-		assert(this->size() ==
+		assert(_size.load() ==
 		       size_type(std::distance(this->begin(), this->end())));
+
+		auto state = container_state<skip_list_state>(this);
+		if (state)
+			state->mark();
 	}
 
 	/**
@@ -763,8 +782,16 @@ public:
 	void
 	free_data()
 	{
-		if (dummy_head == nullptr)
+		/* already freed, possibly in an earlier open of the pool, in
+		 * which case it cannot be initialized anymore */
+		if (dummy_head == nullptr) {
+			free_filter();
 			return;
+		}
+
+		lazy_initialize();
+
+		free_filter();
 
 		auto pop = get_pool_base();
 		obj::transaction::run(pop, [&] {
@@ -1255,6 +1282,7 @@ public:
 	unsafe_erase(iterator pos)
 	{
 		check_outside_tx();
+		lazy_initialize();
 		auto &size_diff = tls_data.local().size_diff;
 		return internal_erase(pos, size_diff);
 	}
@@ -1299,6 +1327,7 @@ public:
 	unsafe_erase(const_iterator first, const_iterator last)
 	{
 		check_outside_tx();
+		lazy_initialize();
 		obj::pool_base pop = get_pool_base();
 		auto &size_diff = tls_data.local().size_diff;
 
@@ -1590,6 +1619,142 @@ public:
 		return internal_find(x);
 	}
 
+	/**
+	 * Finds elements with keys equivalent to keys[0], ..., keys[n - 1]
+	 * and stores iterators to them (or past-the-end iterators, if no such
+	 * element is found) in results[0], ..., results[n - 1].
+	 *
+	 * Contrary to a loop of find() calls, searches for a batch of keys
+	 * are interleaved: a search prefetches the next node and gives way to
+	 * the next search, before comparing the keys, so that many cache
+	 * misses are in flight at the same time.
+	 *
+	 * @param[in] keys array of n keys to search for.
+	 * @param[in] n number of keys.
+	 * @param[out] results array of n iterators.
+	 */
+	void
+	find_many(const key_type *keys, size_type n, iterator *results)
+	{
+		internal_find_many(keys, n, results);
+	}
+
+	/**
+	 * Finds elements with keys equivalent to keys[0], ..., keys[n - 1]
+	 * and stores iterators to them (or past-the-end iterators, if no such
+	 * element is found) in results[0], ..., results[n - 1].
+	 *
+	 * @param[in] keys array of n keys to search for.
+	 * @param[in] n number of keys.
+	 * @param[out] results array of n iterators.
+	 */
+	void
+	find_many(const key_type *keys, size_type n,
+		  const_iterator *results) const
+	{
+		const_cast<concurrent_skip_list *>(this)->internal_find_many(
+			keys, n, results);
+	}
+
+	/**
+	 * Finds elements with keys that compare equivalent to keys[0], ...,
+	 * keys[n - 1]. This overload only participates in overload resolution
+	 * if the qualified-id Compare::is_transparent is valid and denotes a
+	 * type. It allows calling this function without constructing an
+	 * instance of Key.
+	 *
+	 * @param[in] keys array of n values that can be transparently compared
+	 * with a key.
+	 * @param[in] n number of keys.
+	 * @param[out] results array of n iterators.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  has_is_transparent<key_compare>::value, K>::type>
+	void
+	find_many(const K *keys, size_type n, iterator *results)
+	{
+		internal_find_many(keys, n, results);
+	}
+
+	/**
+	 * Finds elements with keys that compare equivalent to keys[0], ...,
+	 * keys[n - 1]. This overload only participates in overload resolution
+	 * if the qualified-id Compare::is_transparent is valid and denotes a
+	 * type. It allows calling this function without constructing an
+	 * instance of Key.
+	 *
+	 * @param[in] keys array of n values that can be transparently compared
+	 * with a key.
+	 * @param[in] n number of keys.
+	 * @param[out] results array of n iterators.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  has_is_transparent<key_compare>::value, K>::type>
+	void
+	find_many(const K *keys, size_type n, const_iterator *results) const
+	{
+		const_cast<concurrent_skip_list *>(this)->internal_find_many(
+			keys, n, results);
+	}
+
+	/**
+	 * Enables a Bloom filter of the keys in DRAM, which lets find(),
+	 * count(), contains() and find_many() return immediately, without
+	 * descending the skip list, for most keys which are not in the
+	 * container. The filter is sized for the given number of elements
+	 * and false positive rate and built from the current content of the
+	 * container. Passing 0 as expected_elements disables the filter and
+	 * frees its memory.
+	 *
+	 * Hash has to be default constructible and callable with key_type.
+	 * Lookups by keys of other types (see find(const K &)) do not use the
+	 * filter.
+	 *
+	 * Keys cannot be removed from the filter, so the false positive rate
+	 * grows with the number of erased and inserted keys; enable_filter()
+	 * can be called again to rebuild it. swap() disables the filters of
+	 * both containers.
+	 *
+	 * The filter is not persistent. It has to be enabled again after the
+	 * pool is reopened and is freed when the pool is closed. Containers
+	 * in pools opened with the C API have no volatile state, the filter
+	 * is never enabled for them.
+	 *
+	 * Not thread safe.
+	 *
+	 * @param[in] expected_elements number of elements the filter is
+	 * sized for.
+	 * @param[in] false_positive_rate probability that a lookup of a
+	 * missing key is not short-circuited.
+	 *
+	 * @throw std::invalid_argument if false_positive_rate is not in
+	 * range (0, 1).
+	 * @throw std::bad_alloc if the filter cannot be allocated.
+	 */
+	template <typename Hash = std::hash<key_type>>
+	void
+	enable_filter(size_type expected_elements,
+		      double false_positive_rate = 0.01)
+	{
+		auto state = lazy_initialize();
+
+		free_filter();
+
+		if (expected_elements == 0 || state == nullptr)
+			return;
+
+		std::unique_ptr<key_filter> filter(
+			new key_filter(expected_elements, false_positive_rate,
+				       &hash_key<Hash>));
+
+		for (auto it = begin(); it != end(); ++it)
+			filter->add(filter->hash(traits_type::get_key(*it)));
+
+		state->filter = filter.release();
+	}
+
 	/**
 	 * Returns the number of elements with key that compares equivalent to
 	 * the specified argument.
@@ -1672,6 +1837,8 @@ public:
 	void
 	clear()
 	{
+		lazy_initialize();
+
 		assert(dummy_head(pool_uuid)->height() > 0);
 		obj::pool_base pop = get_pool_base();
 
@@ -1779,6 +1946,152 @@ public:
 		return const_iterator(pool_uuid, nullptr);
 	}
 
+	/**
+	 * Range of elements of the container, which can be recursively split
+	 * into subranges. Ranges are split at nodes from the upper levels of
+	 * the list, so that splitting does not require walking through the
+	 * elements. Meets requirements of the TBB Range concept.
+	 */
+	template <bool is_const>
+	class range_impl {
+	public:
+		using iterator = typename std::conditional<
+			is_const, typename concurrent_skip_list::const_iterator,
+			typename concurrent_skip_list::iterator>::type;
+
+		/**
+		 * Splitting constructor. Moves the elements of r, starting
+		 * from the first node of an upper level found in r, to the new
+		 * range. Split is a tag type (e.g. tbb::split).
+		 */
+		template <typename Split>
+		range_impl(range_impl &r, Split)
+		    : my_list(r.my_list),
+		      my_begin(r.midpoint()),
+		      my_end(r.my_end)
+		{
+			assert(my_begin);
+
+			r.my_end = my_begin;
+		}
+
+		/** Copy constructor for const range from non-const range */
+		template <typename U = void,
+			  typename = typename std::enable_if<is_const, U>::type>
+		range_impl(const range_impl<false> &other)
+		    : my_list(other.my_list),
+		      my_begin(other.my_begin),
+		      my_end(other.my_end)
+		{
+		}
+
+		/** @return true if the range contains no elements. */
+		bool
+		empty() const
+		{
+			return my_begin == my_end;
+		}
+
+		/** @return true if the range can be split. */
+		bool
+		is_divisible() const
+		{
+			return midpoint() != nullptr;
+		}
+
+		/** @return an iterator to the first element in the range. */
+		iterator
+		begin() const
+		{
+			return iterator(my_list->pool_uuid, my_begin);
+		}
+
+		/** @return an iterator past the last element in the range. */
+		iterator
+		end() const
+		{
+			return iterator(my_list->pool_uuid, my_end);
+		}
+
+	private:
+		friend class concurrent_skip_list;
+		friend class range_impl<true>;
+
+		range_impl(const concurrent_skip_list *list, node_ptr begin,
+			   node_ptr end)
+		    : my_list(list), my_begin(begin), my_end(end)
+		{
+		}
+
+		/*
+		 * Returns the first node after my_begin from the highest level
+		 * (excluding the bottom one), which is also before my_end, or
+		 * nullptr if there is no such node.
+		 */
+		node_ptr
+		midpoint() const
+		{
+			if (empty())
+				return nullptr;
+
+			const uint64_t uuid = my_list->pool_uuid;
+			const key_compare &cmp = my_list->_compare;
+			const key_type &key = get_key(my_begin);
+			node_ptr prev = my_list->dummy_head.get(uuid);
+
+			for (size_type h = prev->height(); h > 1; --h) {
+				node_ptr n = my_list->internal_find_position(
+							    h - 1, prev, key,
+							    not_greater_compare(
+								    cmp))
+						     .get(uuid);
+
+				if (!n)
+					continue;
+
+				if (!my_end || cmp(get_key(n), get_key(my_end)))
+					return n;
+			}
+
+			return nullptr;
+		}
+
+		const concurrent_skip_list *my_list;
+		node_ptr my_begin;
+		node_ptr my_end;
+	};
+
+	using range_type = range_impl<false>;
+	using const_range_type = range_impl<true>;
+
+	/**
+	 * Returns a range of all elements of the container, which can be
+	 * split into subranges and processed in parallel.
+	 *
+	 * @return Range of all elements.
+	 */
+	range_type
+	range()
+	{
+		return range_type(
+			this, dummy_head.get(pool_uuid)->next(0).get(pool_uuid),
+			nullptr);
+	}
+
+	/**
+	 * Returns a range of all elements of the container, which can be
+	 * split into subranges and processed in parallel.
+	 *
+	 * @return Range of all elements.
+	 */
+	const_range_type
+	range() const
+	{
+		return const_range_type(
+			this, dummy_head.get(pool_uuid)->next(0).get(pool_uuid),
+			nullptr);
+	}
+
 	/**
 	 * Returns the number of elements in the container, i.e.
 	 * std::distance(begin(), end()).
@@ -1788,6 +2101,8 @@ public:
 	size_type
 	size() const
 	{
+		const_cast<concurrent_skip_list *>(this)->lazy_initialize();
+
 		return _size.load(std::memory_order_relaxed);
 	}
 
@@ -1804,6 +2119,66 @@ public:
 		return std::numeric_limits<difference_type>::max();
 	}
 
+	/**
+	 * Returns memory used by the container. Metadata includes the
+	 * container object, the head node, headers and next pointers of all
+	 * nodes and thread specific data. Nodes are allocated for each
+	 * element, so there is no slack.
+	 *
+	 * Iterates over all nodes, so it has linear complexity. Can be called
+	 * concurrently with insert operations, but the result may not
+	 * include elements inserted meanwhile.
+	 *
+	 * @return memory_usage_stats struct.
+	 */
+	obj::memory_usage_stats
+	memory_usage() const
+	{
+		obj::memory_usage_stats usage;
+		usage.data = 0;
+		usage.metadata = sizeof(*this) +
+			tls_data.size() * sizeof(tls_entry_type);
+		usage.slack = 0;
+
+		const_node_ptr n = dummy_head.get(pool_uuid);
+		usage.metadata += calc_node_size(n->height());
+
+		for (n = n->next(0).get(pool_uuid); n != nullptr;
+		     n = n->next(0).get(pool_uuid)) {
+			usage.data += sizeof(value_type);
+			usage.metadata += calc_node_size(n->height());
+			usage.metadata -= sizeof(value_type);
+		}
+
+		return usage;
+	}
+
+	/**
+	 * Brings the head node and the nodes of the upper levels (all nodes
+	 * higher than 1, which are visited by every search) into the CPU
+	 * cache, faulting in their pages if needed. Useful right after the
+	 * pool is opened, e.g. from a background thread, so that the first
+	 * searches do not wait for it. The bottom level is not touched.
+	 *
+	 * Can be called concurrently with insert operations, nodes inserted
+	 * meanwhile may be skipped.
+	 */
+	void
+	prefetch_metadata() const
+	{
+		detail::touch(this, sizeof(*this));
+
+		const_node_ptr n = dummy_head.get(pool_uuid);
+		detail::touch(n, calc_node_size(n->height()));
+
+		if (n->height() < 2)
+			return;
+
+		for (n = n->next(1).get(pool_uuid); n != nullptr;
+		     n = n->next(1).get(pool_uuid))
+			detail::touch(n, calc_node_size(n->height()));
+	}
+
 	/**
 	 * Checks if the container has no elements, i.e. whether begin() ==
 	 * end().
@@ -1839,6 +2214,24 @@ public:
 		return _node_allocator;
 	}
 
+	/**
+	 * Iterates over internal pointers of all mapped values and executes
+	 * a callback function on each of them. Nodes themselves are not
+	 * reported, because they are linked from many levels of the list and
+	 * keys are not reported, because they are immutable.
+	 *
+	 * Note: must not be called concurrently with any other operation
+	 * which accesses mapped values or erases elements.
+	 *
+	 * @param func callback function to call on internal pointer.
+	 */
+	void
+	for_each_ptr(for_each_ptr_function func)
+	{
+		for (auto it = begin(); it != end(); ++it)
+			detail::for_each_ptr_of(it->second, func);
+	}
+
 	/**
 	 * Exchanges the contents of the container with those of other
 	 * transactionally. Does not invoke any move, copy, or swap operations
@@ -1849,6 +2242,12 @@ public:
 	void
 	swap(concurrent_skip_list &other)
 	{
+		lazy_initialize();
+		other.lazy_initialize();
+
+		free_filter();
+		other.free_filter();
+
 		obj::pool_base pop = get_pool_base();
 		obj::transaction::run(pop, [&] {
 			using pocs_t = typename node_allocator_traits::
@@ -2006,6 +2405,8 @@ public:
 	}
 
 private:
+	struct skip_list_state;
+
 	/* Status flags stored in insert_stage field */
 	enum insert_stage_type : uint8_t { not_started = 0, in_progress = 1 };
 	/*
@@ -2057,6 +2458,12 @@ private:
 		_size = 0;
 		on_init_size = 0;
 		create_dummy_head();
+
+		forget_container_state(this);
+
+		auto state = container_state<skip_list_state>(this);
+		if (state)
+			state->mark();
 	}
 
 	void
@@ -2098,6 +2505,9 @@ private:
 	iterator
 	internal_find(const K &key)
 	{
+		if (!may_contain(key))
+			return end();
+
 		iterator it = lower_bound(key);
 		return (it == end() || _compare(key, traits_type::get_key(*it)))
 			? end()
@@ -2108,12 +2518,178 @@ private:
 	const_iterator
 	internal_find(const K &key) const
 	{
+		if (!may_contain(key))
+			return end();
+
 		const_iterator it = lower_bound(key);
 		return (it == end() || _compare(key, traits_type::get_key(*it)))
 			? end()
 			: it;
 	}
 
+	/* Number of searches interleaved by find_many() */
+	static constexpr size_type find_many_batch = 16;
+
+	/* State of a single search done by internal_find_many() */
+	struct find_many_state {
+		node_ptr prev;
+		persistent_node_ptr next;
+		size_type level;
+	};
+
+	/*
+	 * Prefetches the node, its value and its array of next pointers.
+	 */
+	void
+	prefetch_node(const persistent_node_ptr &n) const
+	{
+		if (n) {
+			const_node_ptr node = n.get(pool_uuid);
+
+			detail::prefetch(node->get());
+			detail::prefetch(node + 1);
+		}
+	}
+
+	/*
+	 * Returns false if the key is definitely not in the container.
+	 */
+	bool
+	may_contain(const key_type &key) const
+	{
+		auto self = const_cast<concurrent_skip_list *>(this);
+		auto state = self->lazy_initialize();
+		key_filter *f = state ? state->filter : nullptr;
+
+		return !f || f->may_contain(f->hash(key));
+	}
+
+	/*
+	 * Keys of other types might be hashed differently than key_type,
+	 * the filter cannot be used for them.
+	 */
+	template <typename K>
+	bool
+	may_contain(const K &) const
+	{
+		return true;
+	}
+
+	template <typename Hash>
+	static size_t
+	hash_key(const key_type &key)
+	{
+		return Hash{}(key);
+	}
+
+	/*
+	 * Calls runtime_initialize() on the first access after the pool was
+	 * opened, if it was not called explicitly.
+	 *
+	 * Returns the volatile state of the container, nullptr for pools
+	 * opened with the C API.
+	 */
+	skip_list_state *
+	lazy_initialize()
+	{
+		auto state = container_state<skip_list_state>(this);
+		if (state)
+			state->ensure([&] { runtime_initialize(); });
+
+		return state;
+	}
+
+	void
+	free_filter() noexcept
+	{
+		auto state = find_container_state<skip_list_state>(this);
+		if (!state || !state->filter)
+			return;
+
+		delete state->filter;
+		state->filter = nullptr;
+	}
+
+	/*
+	 * Returns iterator to n if its key is equivalent to key, otherwise
+	 * past-the-end iterator.
+	 */
+	template <typename Iterator, typename K>
+	Iterator
+	find_result(node_ptr n, const K &key)
+	{
+		if (n && !_compare(key, get_key(n)))
+			return Iterator(pool_uuid, n);
+
+		return Iterator(end());
+	}
+
+	/*
+	 * Does the same search as internal_get_bound with the default
+	 * comparator for a batch of keys at once. In each round every
+	 * unfinished search does one step on its current level and
+	 * prefetches the node it will look at in the next round.
+	 */
+	template <typename K, typename Iterator>
+	void
+	internal_find_many(const K *keys, size_type n, Iterator *results)
+	{
+		find_many_state states[find_many_batch];
+		node_ptr head = dummy_head.get(pool_uuid);
+		assert(head->height() > 0);
+
+		for (size_type first = 0; first < n; first += find_many_batch) {
+			const K *batch = keys + first;
+			size_type cnt = (std::min)(n - first,
+						  size_type(find_many_batch));
+
+			size_type active = 0;
+			for (size_type i = 0; i < cnt; ++i) {
+				find_many_state &st = states[i];
+
+				if (!may_contain(batch[i])) {
+					results[first + i] = Iterator(end());
+					st.prev = nullptr;
+					continue;
+				}
+
+				st.prev = head;
+				st.level = head->height() - 1;
+				st.next = head->next(st.level);
+				prefetch_node(st.next);
+				++active;
+			}
+
+			while (active > 0) {
+				for (size_type i = 0; i < cnt; ++i) {
+					find_many_state &st = states[i];
+
+					if (st.prev == nullptr)
+						continue;
+
+					node_ptr curr = st.next.get(pool_uuid);
+					if (curr &&
+					    _compare(get_key(curr), batch[i])) {
+						st.prev = curr;
+					} else if (st.level > 0) {
+						--st.level;
+					} else {
+						/* lower bound found */
+						results[first + i] =
+							find_result<Iterator>(
+								curr, batch[i]);
+						st.prev = nullptr;
+						--active;
+						continue;
+					}
+
+					st.next = st.prev->next(st.level);
+					prefetch_node(st.next);
+				}
+			}
+		}
+	}
+
 	template <typename K>
 	size_type
 	internal_count(const K &key) const
@@ -2224,6 +2800,7 @@ private:
 	internal_emplace(Args &&... args)
 	{
 		check_outside_tx();
+		lazy_initialize();
 		tls_entry_type &tls_entry = tls_data.local();
 		obj::pool_base pop = get_pool_base();
 
@@ -2278,6 +2855,7 @@ private:
 	internal_unsafe_emplace(Args &&... args)
 	{
 		check_tx_stage_work();
+		lazy_initialize();
 
 		persistent_node_ptr new_node =
 			create_node(std::forward<Args>(args)...);
@@ -2315,6 +2893,7 @@ private:
 	internal_insert(const K &key, Args &&... args)
 	{
 		check_outside_tx();
+		lazy_initialize();
 		tls_entry_type &tls_entry = tls_data.local();
 		assert(tls_entry.ptr == nullptr);
 
@@ -2402,6 +2981,11 @@ private:
 		assert(new_node != nullptr);
 		node_ptr n = new_node.get(pool_uuid);
 
+		/* The key must be in the filter before the node is visible */
+		auto state = container_state<skip_list_state>(this);
+		if (state && state->filter)
+			state->filter->add(state->filter->hash(get_key(n)));
+
 		/*
 		 * We need to hold lock to the new node until changes
 		 * are committed to persistent domain. Otherwise, the
@@ -2925,6 +3509,33 @@ private:
 		}
 	};
 
+	/* Bloom filter of the keys with the function hashing them */
+	struct key_filter : public bloom_filter {
+		key_filter(size_type expected_elements,
+			   double false_positive_rate,
+			   size_t (*hash_fn)(const key_type &))
+		    : bloom_filter(expected_elements, false_positive_rate),
+		      hash(hash_fn)
+		{
+		}
+
+		size_t (*hash)(const key_type &);
+	};
+
+	/*
+	 * Volatile state of the container in the current open of the pool,
+	 * see lazy_initialize(). Destroyed when the pool is closed.
+	 */
+	struct skip_list_state : public lazy_init_state {
+		~skip_list_state()
+		{
+			delete filter;
+		}
+
+		/* Filter of the keys in DRAM, or null if it is not enabled */
+		key_filter *filter = nullptr;
+	};
+
 	const uint64_t pool_uuid = pmemobj_oid(this).pool_uuid_lo;
 	node_allocator_type _node_allocator;
 	key_compare _compare;
@@ -12,6 +12,7 @@
 #include <libpmemobj++/container/array.hpp>
 #include <libpmemobj++/container/detail/segment_vector_policies.hpp>
 #include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/defrag.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/life.hpp>
 #include <libpmemobj++/detail/temp_value.hpp>
@@ -19,8 +20,14 @@
 #include <libpmemobj++/make_persistent.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj++/transaction.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace pmem
@@ -520,6 +527,9 @@ public:
 		segment_vector_internal::segment_iterator<segment_vector, true>;
 	using reverse_iterator = std::reverse_iterator<iterator>;
 	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+	/* func argument type definition for 'for_each_ptr' method */
+	using for_each_ptr_function =
+		std::function<void(persistent_ptr_base &)>;
 
 	/* Constructors */
 	segment_vector();
@@ -553,6 +563,21 @@ public:
 	void assign(segment_vector &&other);
 	void assign(const std::vector<T> &other);
 
+	/* Parallel assign methods */
+	void parallel_assign(size_type count, const_reference value,
+			     size_type concurrency =
+				     std::thread::hardware_concurrency());
+	template <typename RandomIt,
+		  typename std::enable_if<
+			  detail::is_random_access_iterator<RandomIt>::value,
+			  RandomIt>::type * = nullptr>
+	void parallel_assign(RandomIt first, RandomIt last,
+			     size_type concurrency =
+				     std::thread::hardware_concurrency());
+	void parallel_assign(const segment_vector &other,
+			     size_type concurrency =
+				     std::thread::hardware_concurrency());
+
 	/* Destructor */
 	~segment_vector();
 
@@ -587,6 +612,7 @@ public:
 	slice<iterator> range(size_type start, size_type n);
 	slice<const_iterator> range(size_type start, size_type n) const;
 	slice<const_iterator> crange(size_type start, size_type n) const;
+	void for_each_ptr(for_each_ptr_function func);
 
 	/* Capacity */
 	constexpr bool empty() const noexcept;
@@ -595,6 +621,7 @@ public:
 	void reserve(size_type capacity_new);
 	size_type capacity() const noexcept;
 	void shrink_to_fit();
+	memory_usage_stats memory_usage() const noexcept;
 
 	/* Modifiers */
 	void clear();
@@ -635,6 +662,8 @@ private:
 	void shrink(size_type size_new);
 	pool_base get_pool() const noexcept;
 	void snapshot_data(size_type idx_first, size_type idx_last);
+	template <typename Fill>
+	void parallel_fill(size_type count, size_type concurrency, Fill fill);
 
 	/* Data structure specific helper functions */
 	reference get(size_type n);
@@ -1254,6 +1283,141 @@ segment_vector<T, Policy>::assign(const std::vector<T> &other)
 	assign(other.cbegin(), other.cend());
 }
 
+/**
+ * Replaces the contents with count copies of value value
+ * transactionally, constructing the elements of different segments
+ * concurrently. Segments are independent allocations, so after the
+ * underlying storage is reserved and the old contents are logged, up to
+ * concurrency threads fill disjoint parts of the segments. Each thread
+ * flushes what it has written and the whole operation is committed
+ * once, which keeps the all-or-nothing guarantee of assign().
+ *
+ * Only the iterators and references in [0, count) remain valid.
+ *
+ * @param[in] count number of elements to construct.
+ * @param[in] value value of all constructed elements.
+ * @param[in] concurrency maximum number of threads used to fill the
+ * segments (including the calling one). Zero is treated as one.
+ *
+ * @pre value_type must satisfy LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE.
+ * @pre segment_type must be pmem::obj::vector<T>.
+ *
+ * @post size() == count
+ * @post capacity() == nearest power of 2 greater than max(capacity(),
+ * count)
+ *
+ * @throw std::length_error if count > max_size().
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating new memory
+ * failed.
+ * @throw pmem::transaction_free_error when freeing underlying segment
+ * failed.
+ * @throw std::system_error if a worker thread could not be started.
+ */
+template <typename T, typename Policy>
+void
+segment_vector<T, Policy>::parallel_assign(size_type count,
+					   const_reference value,
+					   size_type concurrency)
+{
+	/* value may refer to an element which is about to be overwritten */
+	const value_type v = value;
+
+	parallel_fill(count, concurrency,
+		      [&](pointer dest, size_type, size_type n) {
+			      std::uninitialized_fill_n(dest, n, v);
+		      });
+}
+
+/**
+ * Replaces the contents with copies of those in the range [first, last)
+ * transactionally, constructing the elements of different segments
+ * concurrently. See parallel_assign(size_type, const_reference,
+ * size_type) for details. This overload participates in overload
+ * resolution only if RandomIt satisfies RandomAccessIterator.
+ *
+ * The range [first, last) must not overlap with this container.
+ *
+ * @param[in] first first iterator.
+ * @param[in] last last iterator.
+ * @param[in] concurrency maximum number of threads used to fill the
+ * segments (including the calling one). Zero is treated as one.
+ *
+ * @pre value_type must satisfy LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE.
+ * @pre segment_type must be pmem::obj::vector<T>.
+ *
+ * @post size() == std::distance(first, last)
+ * @post capacity() == nearest power of 2 greater than max(capacity(),
+ * std::distance(first, last))
+ *
+ * @throw rethrows exception thrown by the iterator.
+ * @throw std::length_error when new capacity larger than max_size().
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating new memory
+ * failed.
+ * @throw pmem::transaction_free_error when freeing underlying segment
+ * failed.
+ * @throw std::system_error if a worker thread could not be started.
+ */
+template <typename T, typename Policy>
+template <typename RandomIt,
+	  typename std::enable_if<
+		  detail::is_random_access_iterator<RandomIt>::value,
+		  RandomIt>::type *>
+void
+segment_vector<T, Policy>::parallel_assign(RandomIt first, RandomIt last,
+					   size_type concurrency)
+{
+	size_type count = static_cast<size_type>(std::distance(first, last));
+
+	parallel_fill(count, concurrency,
+		      [&](pointer dest, size_type idx, size_type n) {
+			      std::uninitialized_copy_n(
+				      first + static_cast<difference_type>(idx),
+				      n, dest);
+		      });
+}
+
+/**
+ * Replaces the contents with a copy of the contents of other
+ * transactionally, copying different segments concurrently. Both
+ * containers share the segment layout, so every thread copies whole
+ * contiguous pieces of the corresponding segments. See
+ * parallel_assign(size_type, const_reference, size_type) for details.
+ *
+ * @param[in] other container to copy from.
+ * @param[in] concurrency maximum number of threads used to fill the
+ * segments (including the calling one). Zero is treated as one.
+ *
+ * @pre value_type must satisfy LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE.
+ * @pre segment_type must be pmem::obj::vector<T>.
+ *
+ * @post size() == other.size()
+ * @post capacity() == max(other.size(), capacity())
+ *
+ * @throw std::length_error when new capacity larger than max_size().
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating new memory
+ * failed.
+ * @throw pmem::transaction_free_error when freeing underlying segment
+ * failed.
+ * @throw std::system_error if a worker thread could not be started.
+ */
+template <typename T, typename Policy>
+void
+segment_vector<T, Policy>::parallel_assign(const segment_vector &other,
+					   size_type concurrency)
+{
+	if (this == &other)
+		return;
+
+	parallel_fill(other.size(), concurrency,
+		      [&](pointer dest, size_type idx, size_type n) {
+			      std::uninitialized_copy_n(&other.cget(idx), n,
+							dest);
+		      });
+}
+
 /**
  * Destructor.
  * Note that free_data may throw a transaction_free_error when freeing
@@ -1693,6 +1857,24 @@ segment_vector<T, Policy>::crange(size_type start, size_type n) const
 	return {const_iterator(this, start), const_iterator(this, start + n)};
 }
 
+/**
+ * Iterates over all internal pointers and executes a callback function
+ * on each of them. These are the pointers to the underlying arrays of all
+ * used segments and, if the segments storage is a vector, the pointer to
+ * its array.
+ *
+ * @param func callback function to call on internal pointer.
+ */
+template <typename T, typename Policy>
+void
+segment_vector<T, Policy>::for_each_ptr(for_each_ptr_function func)
+{
+	for (size_type i = 0; i < _segments_used; ++i)
+		detail::for_each_ptr_of(_data[i], func);
+
+	detail::for_each_ptr_of(_data, func);
+}
+
 /**
  * Checks whether the container is empty.
  *
@@ -1806,6 +1988,28 @@ segment_vector<T, Policy>::shrink_to_fit()
 	});
 }
 
+/**
+ * Returns memory used by the segment_vector. Metadata includes the
+ * segments storage, slack is the unused capacity of all segments.
+ *
+ * @return memory_usage_stats struct.
+ */
+template <typename T, typename Policy>
+memory_usage_stats
+segment_vector<T, Policy>::memory_usage() const noexcept
+{
+	memory_usage_stats usage;
+	usage.data = size() * sizeof(T);
+	usage.metadata = sizeof(*this) + detail::heap_usage(_data);
+
+	size_type segments = 0;
+	for (size_type i = 0; i < _data.size(); ++i)
+		segments += detail::heap_usage(_data[i]);
+	usage.slack = segments - usage.data;
+
+	return usage;
+}
+
 /**
  * Clears the content of a segment_vector transactionally.
  *
@@ -2672,6 +2876,151 @@ segment_vector<T, Policy>::snapshot_data(size_type first, size_type last)
 				      POBJ_XADD_ASSUME_INITIALIZED);
 }
 
+/**
+ * Private helper function. Resizes the container to count elements and
+ * lets up to concurrency threads construct them in place. The range
+ * [0, count) is split into chunks which never cross a segment boundary
+ * and fill(dest, idx, n) is called for each of them, where dest points
+ * to the element with index idx and n is the chunk length.
+ *
+ * Old contents of the segments are logged by the calling thread before
+ * any worker starts. Logged ranges are not flushed on commit, each
+ * worker flushes the chunks it has written instead and the calling
+ * thread drains once after all of them finish. An exception thrown by
+ * fill is rethrown in the calling thread, which aborts the transaction.
+ *
+ * @param[in] count new size of the container.
+ * @param[in] concurrency maximum number of threads (including the
+ * calling one).
+ * @param[in] fill functor constructing elements in uninitialized
+ * memory.
+ *
+ * @throw std::length_error if count > max_size().
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating new memory
+ * failed.
+ * @throw pmem::transaction_free_error when freeing underlying segment
+ * failed.
+ * @throw std::system_error if a worker thread could not be started.
+ * @throw rethrows exception thrown by fill.
+ */
+template <typename T, typename Policy>
+template <typename Fill>
+void
+segment_vector<T, Policy>::parallel_fill(size_type count,
+					 size_type concurrency, Fill fill)
+{
+	static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+		      "parallel_assign requires trivially copyable type");
+	static_assert(std::is_same<segment_type, pmem::obj::vector<T>>::value,
+		      "parallel_assign requires pmem::obj::vector segments");
+
+	if (count > max_size())
+		throw std::length_error("Assignable range exceeds max size.");
+
+	if (concurrency == 0)
+		concurrency = 1;
+
+	/* Number of elements filled at once, roughly 64KB */
+	const size_type chunk = (std::max)(
+		size_type(1), size_type(1 << 16) / sizeof(value_type));
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		if (count > capacity())
+			internal_reserve(count);
+		else if (count < size())
+			shrink(count);
+
+		if (count == 0)
+			return;
+
+		size_type end = policy::get_segment(count - 1);
+		std::vector<pointer> segments(end + 1);
+		for (size_type i = 0; i <= end; ++i) {
+			size_type n = (i < end)
+				? policy::segment_size(i)
+				: count - policy::segment_top(i);
+			segment_type &segment = _data[i];
+			size_type initialized = segment.size();
+			assert(initialized <= n);
+
+			segments[i] = segment._data.get();
+			detail::conditional_add_to_tx(
+				segments[i], initialized,
+				POBJ_XADD_ASSUME_INITIALIZED |
+					POBJ_XADD_NO_FLUSH);
+			detail::conditional_add_to_tx(
+				segments[i] + initialized, n - initialized,
+				POBJ_XADD_NO_SNAPSHOT | POBJ_XADD_NO_FLUSH);
+			segment._size = n;
+		}
+		_segments_used = end + 1;
+
+		std::atomic<size_type> next(0);
+		std::atomic<bool> failed(false);
+		std::exception_ptr error;
+		std::mutex error_mtx;
+
+		/* Fills [first, last), splitting it at segment boundaries */
+		auto fill_chunk = [&](size_type first, size_type last) {
+			while (first != last) {
+				size_type s = policy::get_segment(first);
+				size_type s_end = policy::segment_top(s) +
+					policy::segment_size(s);
+				size_type n = (std::min)(last, s_end) - first;
+				pointer dest = segments[s] +
+					policy::index_in_segment(first);
+
+				fill(dest, first, n);
+				pb.flush(dest, n * sizeof(value_type));
+				first += n;
+			}
+		};
+
+		auto worker = [&] {
+			try {
+				size_type first;
+				while (!failed.load(
+					       std::memory_order_relaxed) &&
+				       (first = next.fetch_add(chunk)) < count)
+					fill_chunk(first,
+						   (std::min)(first + chunk,
+							      count));
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mtx);
+				if (!error)
+					error = std::current_exception();
+				failed.store(true);
+			}
+		};
+
+		size_type nthreads = (std::min)(
+			concurrency, (count + chunk - 1) / chunk);
+		std::vector<std::thread> threads;
+		threads.reserve(nthreads - 1);
+		try {
+			for (size_type i = 1; i < nthreads; ++i)
+				threads.emplace_back(worker);
+		} catch (...) {
+			failed.store(true);
+			for (auto &t : threads)
+				t.join();
+			throw;
+		}
+
+		worker();
+		for (auto &t : threads)
+			t.join();
+
+		if (error)
+			std::rethrow_exception(error);
+
+		pb.drain();
+	});
+	assert(segment_capacity_validation());
+}
+
 /**
  * Private helper function. Not considering if element exist or not.
  *
@@ -18,6 +18,7 @@
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pext.hpp>
 #include <libpmemobj++/slice.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj++/transaction.hpp>
 #include <libpmemobj/base.h>
 
@@ -32,6 +33,9 @@ namespace pmem
 namespace obj
 {
 
+template <typename T, typename Policy>
+class segment_vector;
+
 /**
  * pmem::obj::vector - persistent container with std::vector compatible
  * interface.
@@ -137,6 +141,7 @@ public:
 	void reserve(size_type capacity_new);
 	size_type capacity() const noexcept;
 	void shrink_to_fit();
+	memory_usage_stats memory_usage() const noexcept;
 
 	/* Modifiers */
 	void clear();
@@ -164,6 +169,10 @@ public:
 	void swap(vector &other);
 
 private:
+	/* segment_vector::parallel_assign() fills segments in place */
+	template <typename, typename>
+	friend class segment_vector;
+
 	/* helper iterator */
 	template <typename P>
 	struct single_element_iterator {
@@ -1425,6 +1434,28 @@ vector<T>::shrink_to_fit()
 	transaction::run(pb, [&] { realloc(capacity_new); });
 }
 
+/**
+ * Returns memory used by the vector. Slack is the unused capacity of the
+ * underlying array, including the rounding done by the allocator.
+ *
+ * @return memory_usage_stats struct.
+ */
+template <typename T>
+memory_usage_stats
+vector<T>::memory_usage() const noexcept
+{
+	memory_usage_stats usage;
+	usage.data = size() * sizeof(T);
+	usage.metadata = sizeof(*this);
+	usage.slack = 0;
+
+	if (_data != nullptr)
+		usage.slack =
+			pmemobj_alloc_usable_size(_data.raw()) - usage.data;
+
+	return usage;
+}
+
 /**
  * Clears the content of a vector transactionally.
  *
@@ -10,6 +10,7 @@
 #define LIBPMEMOBJ_CPP_DEFRAG_HPP
 
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <libpmemobj++/detail/template_helpers.hpp>
@@ -33,6 +34,26 @@ using t_has_for_each_ptr = typename std::enable_if<
 
 template <typename T>
 using t_is_defragmentable = supports<T, t_has_for_each_ptr>;
+
+/*
+ * Calls 'for_each_ptr' on the given object, if it implements it.
+ * Used by containers to expose internal pointers of their elements.
+ */
+template <typename T, typename F>
+typename std::enable_if<t_is_defragmentable<T>::value>::type
+for_each_ptr_of(T &t, F &&func)
+{
+	t.for_each_ptr(std::forward<F>(func));
+}
+
+/*
+ * Specialization for non-defragmentable objects - does nothing.
+ */
+template <typename T, typename F>
+typename std::enable_if<!t_is_defragmentable<T>::value>::type
+for_each_ptr_of(T &, F &&)
+{
+}
 }
 
 namespace obj
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Volatile Bloom filter of hash codes, used by containers to skip lookups
+ * of keys which are definitely not present.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_BLOOM_FILTER_HPP
+#define LIBPMEMOBJ_CPP_BLOOM_FILTER_HPP
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Blocked Bloom filter of hash codes, which resides in DRAM.
+ *
+ * All bits of a hash code are set in a single 64-byte block, so that add()
+ * and may_contain() touch only one cache line. Bits are set atomically,
+ * add() and may_contain() can be called concurrently. Hash codes cannot be
+ * removed, the filter has to be rebuilt instead.
+ */
+class bloom_filter {
+public:
+	/**
+	 * Constructs an empty filter, sized for the expected number of
+	 * elements, so that the probability of a false positive does not
+	 * exceed false_positive_rate.
+	 *
+	 * @throw std::invalid_argument if false_positive_rate is not in
+	 * range (0, 1).
+	 * @throw std::bad_alloc if the filter cannot be allocated.
+	 */
+	bloom_filter(std::size_t expected_elements, double false_positive_rate)
+	{
+		if (!(false_positive_rate > 0 && false_positive_rate < 1))
+			throw std::invalid_argument(
+				"False positive rate must be in range (0, 1)");
+
+		const double ln2 = std::log(2.0);
+		double n = static_cast<double>(
+			expected_elements > 0 ? expected_elements : 1);
+		double bits = -n * std::log(false_positive_rate) / (ln2 * ln2);
+
+		std::size_t blocks = 1;
+		while (static_cast<double>(blocks * block_bits) < bits)
+			blocks <<= 1;
+
+		double k = std::round(
+			static_cast<double>(blocks * block_bits) / n * ln2);
+		my_hashes = static_cast<unsigned>(k);
+		if (my_hashes < 1)
+			my_hashes = 1;
+		else if (my_hashes > max_hashes)
+			my_hashes = max_hashes;
+
+		my_blocks_mask = blocks - 1;
+
+		/* one more block to align the words to the cache line */
+		my_storage.reset(
+			new std::atomic<uint64_t>[(blocks + 1) * block_words]);
+		auto addr = reinterpret_cast<std::uintptr_t>(my_storage.get());
+		my_words = my_storage.get() +
+			(block_size - addr % block_size) % block_size /
+				sizeof(uint64_t);
+
+		clear();
+	}
+
+	bloom_filter(const bloom_filter &) = delete;
+	bloom_filter &operator=(const bloom_filter &) = delete;
+
+	/**
+	 * Adds the hash code to the filter.
+	 */
+	void
+	add(std::size_t hash) noexcept
+	{
+		uint64_t x = mix(static_cast<uint64_t>(hash));
+		std::atomic<uint64_t> *block = get_block(x);
+
+		x = mix(x);
+		uint32_t h1 = static_cast<uint32_t>(x);
+		uint32_t h2 = static_cast<uint32_t>(x >> 32) | 1;
+
+		for (unsigned i = 0; i < my_hashes; ++i, h1 += h2) {
+			std::atomic<uint64_t> &word =
+				block[(h1 % block_bits) / 64];
+			uint64_t bit = uint64_t(1) << (h1 % 64);
+
+			/* do not write to the cache line if not needed */
+			if (!(word.load(std::memory_order_relaxed) & bit))
+				word.fetch_or(bit, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @return false if the hash code was definitely not added to the
+	 * filter, true if it might have been added.
+	 */
+	bool
+	may_contain(std::size_t hash) const noexcept
+	{
+		uint64_t x = mix(static_cast<uint64_t>(hash));
+		const std::atomic<uint64_t> *block = get_block(x);
+
+		x = mix(x);
+		uint32_t h1 = static_cast<uint32_t>(x);
+		uint32_t h2 = static_cast<uint32_t>(x >> 32) | 1;
+
+		for (unsigned i = 0; i < my_hashes; ++i, h1 += h2) {
+			uint64_t word = block[(h1 % block_bits) / 64].load(
+				std::memory_order_relaxed);
+
+			if (!(word & (uint64_t(1) << (h1 % 64))))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Removes all hash codes from the filter. Not thread safe.
+	 */
+	void
+	clear() noexcept
+	{
+		for (std::size_t i = 0; i < (my_blocks_mask + 1) * block_words;
+		     ++i)
+			my_words[i].store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @return size of the filter in bits.
+	 */
+	std::size_t
+	bits() const noexcept
+	{
+		return (my_blocks_mask + 1) * block_bits;
+	}
+
+	/**
+	 * @return number of bits set for every hash code.
+	 */
+	unsigned
+	hashes() const noexcept
+	{
+		return my_hashes;
+	}
+
+private:
+	static constexpr std::size_t block_size = 64;
+	static constexpr std::size_t block_words =
+		block_size / sizeof(uint64_t);
+	static constexpr std::size_t block_bits = block_size * 8;
+	static constexpr unsigned max_hashes = 16;
+
+	/*
+	 * Finalizer of MurmurHash3, spreads the bits of hash codes like
+	 * std::hash of integers, which are often the identity.
+	 */
+	static uint64_t
+	mix(uint64_t x) noexcept
+	{
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+
+		return x;
+	}
+
+	std::atomic<uint64_t> *
+	get_block(uint64_t x) const noexcept
+	{
+		return my_words +
+			(static_cast<std::size_t>(x) & my_blocks_mask) *
+			block_words;
+	}
+
+	std::size_t my_blocks_mask;
+	unsigned my_hashes;
+	std::unique_ptr<std::atomic<uint64_t>[]> my_storage;
+	std::atomic<uint64_t> *my_words;
+}; /* class bloom_filter */
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_BLOOM_FILTER_HPP */
@@ -9,6 +9,7 @@
 #ifndef LIBPMEMOBJ_CPP_COMMON_HPP
 #define LIBPMEMOBJ_CPP_COMMON_HPP
 
+#include <libpmemobj++/detail/snapshot_tracker.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj/tx_base.h>
 #include <string>
@@ -154,16 +155,25 @@ conditional_add_to_tx(const T *that, std::size_t count = 1, uint64_t flags = 0)
 	if (!pmemobj_pool_by_ptr(that))
 		return;
 
-	if (pmemobj_tx_xadd_range_direct(that, sizeof(*that) * count, flags)) {
-		if (errno == ENOMEM)
-			throw pmem::transaction_out_of_memory(
-				"Could not add object(s) to the transaction.")
-				.with_pmemobj_errormsg();
-		else
-			throw pmem::transaction_error(
-				"Could not add object(s) to the transaction.")
-				.with_pmemobj_errormsg();
-	}
+	auto add_range = [flags](const void *ptr, std::size_t size) {
+		if (pmemobj_tx_xadd_range_direct(ptr, size, flags)) {
+			if (errno == ENOMEM)
+				throw pmem::transaction_out_of_memory(
+					"Could not add object(s) to the transaction.")
+					.with_pmemobj_errormsg();
+			else
+				throw pmem::transaction_error(
+					"Could not add object(s) to the transaction.")
+					.with_pmemobj_errormsg();
+		}
+	};
+
+	/* ranges added with flags are not flushed or snapshotted normally */
+	if (flags != 0)
+		add_range(that, sizeof(*that) * count);
+	else
+		snapshot_tracker::instance().add(that, sizeof(*that) * count,
+						 add_range);
 }
 
 /*
@@ -209,6 +219,51 @@ next_pow_2(uint32_t v)
 	return v + (v == 0);
 }
 
+/*
+ * Maps a hash to [0, n). The hash is mixed first, so that the result does
+ * not depend only on the low bits, which containers use to choose a bucket.
+ */
+inline std::size_t
+hash_to_index(std::size_t hash, std::size_t n) noexcept
+{
+	uint64_t h = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+
+	return static_cast<std::size_t>(((h >> 32) * n) >> 32);
+}
+
+/*
+ * Hints the processor to fetch the cache line containing addr. It never
+ * faults, so addr does not have to point to a valid object.
+ */
+inline void
+prefetch(const void *addr) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(addr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch(static_cast<const char *>(addr), _MM_HINT_T0);
+#else
+	(void)addr;
+#endif
+}
+
+/*
+ * Reads one byte in every stride bytes of [addr, addr + len). Unlike
+ * prefetch(), which is dropped for pages which are not mapped yet, this
+ * faults the pages in and brings the lines into the cache.
+ */
+inline void
+touch(const void *addr, std::size_t len, std::size_t stride = 64) noexcept
+{
+	auto bytes = static_cast<const volatile char *>(addr);
+
+	for (std::size_t off = 0; off < len; off += stride)
+		(void)bytes[off];
+
+	if (len > 0)
+		(void)bytes[len - 1];
+}
+
 #if _MSC_VER
 static inline int
 Log2(uint64_t x)
@@ -11,16 +11,27 @@
 
 #include <libpmemobj++/container/segment_vector.hpp>
 #include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/mutex.hpp>
 #include <libpmemobj++/shared_mutex.hpp>
 
 #include <cassert>
+#include <cstdint>
 #include <deque>
 #include <mutex>
 #include <numeric>
 #include <thread>
 #include <unordered_map>
 
+/*
+ * Cache the address of the calling thread's element in a thread_local slot,
+ * so that enumerable_thread_specific::local() does not have to resolve it
+ * through the underlying storage on every call.
+ */
+#ifndef LIBPMEMOBJ_CPP_ETS_LOCAL_CACHE
+#define LIBPMEMOBJ_CPP_ETS_LOCAL_CACHE 1
+#endif
+
 namespace pmem
 {
 namespace detail
@@ -109,7 +120,7 @@ public:
 
 	/* ctors & dtor */
 	enumerable_thread_specific();
-	~enumerable_thread_specific() = default;
+	~enumerable_thread_specific();
 
 	/* access */
 	reference local();
@@ -126,10 +137,20 @@ public:
 	const_iterator end() const;
 
 private:
+	/* Entry of the per-thread cache of local() results */
+	struct local_cache_entry {
+		const enumerable_thread_specific *owner;
+		std::uint64_t epoch;
+		pointer value;
+	};
+
+	static constexpr size_t local_cache_size = 16;
+
 	/* private helper methods */
 	obj::pool_base get_pool() const noexcept;
 	void set_cached_size(size_t s);
 	size_t get_cached_size();
+	reference local_storage();
 
 	mutex_type _mutex;
 	storage_type _storage;
@@ -292,10 +313,25 @@ enumerable_thread_specific<T, Mutex, Storage>::initialize(Handler handler)
 	clear();
 }
 
+/**
+ * Destructor. Drops cached references to the elements.
+ */
+template <typename T, typename Mutex, typename Storage>
+enumerable_thread_specific<T, Mutex, Storage>::~enumerable_thread_specific()
+{
+	invalidate_caches();
+}
+
 /**
  * Returns data reference for the current thread.
  * For the new thread, element by reference will be default constructed.
  *
+ * The address of the element is cached in a small thread_local table,
+ * keyed by the container address and tagged with cache_epoch(). As long
+ * as no pool was closed and no container was cleared or destroyed in the
+ * meantime, subsequent calls are served from that table without touching
+ * the thread id or the underlying storage.
+ *
  * @pre must be called outside of a transaction.
  *
  * @return reference to value for the current thread.
@@ -306,6 +342,40 @@ enumerable_thread_specific<T, Mutex, Storage>::local()
 {
 	assert(pmemobj_tx_stage() != TX_STAGE_WORK);
 
+#if LIBPMEMOBJ_CPP_ETS_LOCAL_CACHE
+	static thread_local local_cache_entry cache[local_cache_size];
+
+	auto &entry = cache[(reinterpret_cast<uintptr_t>(this) >> 4) %
+			    local_cache_size];
+	auto epoch = cache_epoch().load(std::memory_order_acquire);
+
+	if (entry.owner == this && entry.epoch == epoch)
+		return *entry.value;
+
+	pointer value = &local_storage();
+
+	entry.owner = this;
+	entry.epoch = epoch;
+	entry.value = value;
+
+	return *value;
+#else
+	return local_storage();
+#endif
+}
+
+/**
+ * Private helper function. Returns data reference for the current thread
+ * from the underlying storage, growing it if needed.
+ *
+ * @pre must be called outside of a transaction.
+ *
+ * @return reference to value for the current thread.
+ */
+template <typename T, typename Mutex, typename Storage>
+typename enumerable_thread_specific<T, Mutex, Storage>::reference
+enumerable_thread_specific<T, Mutex, Storage>::local_storage()
+{
 	static thread_local thread_id_type tid;
 	auto index = tid.get();
 
@@ -350,6 +420,8 @@ enumerable_thread_specific<T, Mutex, Storage>::clear()
 		_storage_size.get_rw() = 0;
 		_storage.clear();
 	});
+
+	invalidate_caches();
 }
 
 /**
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Lazy initialization of persistent containers after the pool is reopened.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_LAZY_INIT_STATE_HPP
+#define LIBPMEMOBJ_CPP_LAZY_INIT_STATE_HPP
+
+#include <atomic>
+#include <mutex>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Volatile state of a container which tells whether its runtime_initialize()
+ * was called in the current open of the pool, so that it can be called on
+ * the first access after the pool was reopened.
+ *
+ * The state is a part of the volatile state of the container kept in DRAM
+ * (see container_state()) and is destroyed when the pool is closed, so
+ * nothing left from a previous open or process can be mistaken for it.
+ */
+struct lazy_init_state {
+	/**
+	 * Calls init() if the container was not initialized in the current
+	 * open of the pool. Thread-safe, init() is called by one thread and
+	 * the others wait for it.
+	 *
+	 * @throw rethrows exception thrown by init(), the next call retries.
+	 */
+	template <typename Init>
+	void
+	ensure(Init &&init)
+	{
+		if (initialized.load(std::memory_order_acquire))
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (!initialized.load(std::memory_order_relaxed))
+			init();
+	}
+
+	/**
+	 * @return true if the container was initialized in the current open
+	 *	of the pool, i.e. its volatile data is valid.
+	 */
+	bool
+	is_initialized() const noexcept
+	{
+		return initialized.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Records that the container was initialized in the current open of
+	 * the pool. Called at the end of runtime_initialize().
+	 */
+	void
+	mark() noexcept
+	{
+		initialized.store(true, std::memory_order_release);
+	}
+
+private:
+	std::atomic<bool> initialized{false};
+
+	/* serializes calls to init() */
+	std::mutex mutex;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_LAZY_INIT_STATE_HPP */
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Discovery of NUMA nodes and of the node of the calling thread.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_NUMA_TOPOLOGY_HPP
+#define LIBPMEMOBJ_CPP_NUMA_TOPOLOGY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fstream>
+#include <sched.h>
+#endif
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * NUMA nodes of the machine and the CPUs attached to them.
+ *
+ * On Linux the topology is read from /sys/devices/system/node, nodes
+ * without CPUs (e.g. memory-only nodes) are skipped. On other systems, or
+ * if the topology cannot be read, the machine is treated as a single node.
+ *
+ * Nodes are numbered densely from 0 in the order of the system node ids.
+ */
+class numa_topology {
+public:
+	/**
+	 * @return the topology of the machine, detected on the first call.
+	 */
+	static const numa_topology &
+	instance()
+	{
+		static numa_topology topology;
+		return topology;
+	}
+
+	/**
+	 * @return the number of nodes, at least 1.
+	 */
+	size_t
+	nodes() const noexcept
+	{
+		return node_cpus.empty() ? 1 : node_cpus.size();
+	}
+
+	/**
+	 * @return the node of the CPU on which the calling thread runs, 0 if
+	 *	it cannot be determined.
+	 */
+	size_t
+	current_node() const noexcept
+	{
+#ifdef __linux__
+		int cpu = sched_getcpu();
+		if (cpu >= 0 && static_cast<size_t>(cpu) < cpu_node.size())
+			return cpu_node[static_cast<size_t>(cpu)];
+#endif
+		return 0;
+	}
+
+	/**
+	 * Restricts the calling thread to the CPUs of the given node.
+	 *
+	 * @return true on success, false if the node is not known or binding
+	 *	is not supported.
+	 */
+	bool
+	bind_current_thread(size_t node) const noexcept
+	{
+#ifdef __linux__
+		if (node >= node_cpus.size())
+			return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto cpu : node_cpus[node]) {
+			if (cpu < CPU_SETSIZE)
+				CPU_SET(static_cast<size_t>(cpu), &set);
+		}
+
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+		(void)node;
+		return false;
+#endif
+	}
+
+private:
+	numa_topology()
+	{
+#ifdef __linux__
+		detect();
+#endif
+	}
+
+#ifdef __linux__
+	void
+	detect()
+	{
+		static const char sysfs[] = "/sys/devices/system/node";
+
+		std::vector<int> ids;
+
+		DIR *dir = opendir(sysfs);
+		if (dir == nullptr)
+			return;
+
+		while (struct dirent *e = readdir(dir)) {
+			std::string name = e->d_name;
+			if (name.size() > 4 &&
+			    name.compare(0, 4, "node") == 0 &&
+			    name.find_first_not_of("0123456789", 4) ==
+				    std::string::npos)
+				ids.push_back(std::stoi(name.substr(4)));
+		}
+		closedir(dir);
+
+		std::sort(ids.begin(), ids.end());
+
+		for (auto id : ids) {
+			std::ifstream f(std::string(sysfs) + "/node" +
+					std::to_string(id) + "/cpulist");
+			std::string list;
+			if (!std::getline(f, list))
+				continue;
+
+			auto cpus = parse_cpu_list(list);
+			if (cpus.empty())
+				continue;
+
+			for (auto cpu : cpus) {
+				auto c = static_cast<size_t>(cpu);
+				if (c >= cpu_node.size())
+					cpu_node.resize(c + 1, 0);
+				cpu_node[c] = node_cpus.size();
+			}
+
+			node_cpus.push_back(std::move(cpus));
+		}
+	}
+
+	/*
+	 * Parses a list in the format of cpulist, e.g. "0-3,8,10-11".
+	 */
+	static std::vector<int>
+	parse_cpu_list(const std::string &list)
+	{
+		std::vector<int> cpus;
+		size_t pos = 0;
+
+		while (pos < list.size()) {
+			auto end = list.find(',', pos);
+			if (end == std::string::npos)
+				end = list.size();
+
+			auto item = list.substr(pos, end - pos);
+			pos = end + 1;
+
+			if (item.find_first_of("0123456789") ==
+			    std::string::npos)
+				continue;
+
+			auto dash = item.find('-');
+			int first = std::stoi(item.substr(0, dash));
+			int last = dash == std::string::npos
+				? first
+				: std::stoi(item.substr(dash + 1));
+
+			for (int cpu = first; cpu <= last; ++cpu)
+				cpus.push_back(cpu);
+		}
+
+		return cpus;
+	}
+#endif
+
+	/* CPUs of every node */
+	std::vector<std::vector<int>> node_cpus;
+	/* node of every CPU */
+	std::vector<size_t> cpu_node;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_NUMA_TOPOLOGY_HPP */
@@ -1,5 +1,5 @@
 // SPDX-License-Identifier: BSD-3-Clause
-/* Copyright 2019, Intel Corporation */
+/* Copyright 2019-2020, Intel Corporation */
 
 /**
  * @file
@@ -11,7 +11,16 @@
 #define LIBPMEMOBJ_CPP_POOL_DATA_HPP
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <libpmemobj/base.h>
+#include <libpmemobj/pool_base.h>
 
 namespace pmem
 {
@@ -23,6 +32,7 @@ struct pool_data {
 	pool_data()
 	{
 		initialized = false;
+		closing = false;
 	}
 
 	/* Set cleanup function if not already set */
@@ -40,10 +50,296 @@ struct pool_data {
 		}
 	}
 
+	/* Register a function which waits for a background task of the pool */
+	void
+	add_background(std::function<void()> wait)
+	{
+		std::unique_lock<std::mutex> lock(background_mutex);
+
+		background.push_back(std::move(wait));
+	}
+
+	/* Ask background tasks to stop and wait for them, called on close */
+	void
+	stop_background()
+	{
+		closing.store(true, std::memory_order_relaxed);
+
+		std::vector<std::function<void()>> tasks;
+		{
+			std::unique_lock<std::mutex> lock(background_mutex);
+			tasks.swap(background);
+		}
+
+		for (auto &wait : tasks)
+			wait();
+	}
+
+	/*
+	 * Register a function which frees volatile memory referenced by the
+	 * object at key, called on close unless cancelled before. Replaces
+	 * the function registered for key, if any.
+	 */
+	void
+	set_release(const void *key, std::function<void()> release)
+	{
+		std::unique_lock<std::mutex> lock(release_mutex);
+
+		releases[key] = std::move(release);
+	}
+
+	/* Forget the function registered for key, the memory was freed */
+	void
+	cancel_release(const void *key)
+	{
+		std::unique_lock<std::mutex> lock(release_mutex);
+
+		releases.erase(key);
+	}
+
+	/*
+	 * Call and forget the function registered for key, if any.
+	 * Return true if it was registered.
+	 */
+	bool
+	release(const void *key)
+	{
+		std::function<void()> r;
+		{
+			std::unique_lock<std::mutex> lock(release_mutex);
+
+			auto it = releases.find(key);
+			if (it == releases.end())
+				return false;
+
+			r = std::move(it->second);
+			releases.erase(it);
+		}
+
+		r();
+
+		return true;
+	}
+
+	/* Call all registered release functions, called on close */
+	void
+	release_all()
+	{
+		std::unordered_map<const void *, std::function<void()>> r;
+		{
+			std::unique_lock<std::mutex> lock(release_mutex);
+			r.swap(releases);
+		}
+
+		for (auto &entry : r)
+			entry.second();
+	}
+
+	/*
+	 * Return the volatile state of the object at key, default constructed
+	 * on the first call. It lives until the pool is closed or
+	 * erase_state() is called for the key.
+	 */
+	template <typename State>
+	State *
+	get_state(const void *key)
+	{
+		std::unique_lock<std::mutex> lock(states_mutex);
+
+		auto &state = states[key];
+		if (!state)
+			state = std::make_shared<State>();
+
+		return static_cast<State *>(state.get());
+	}
+
+	/* Return the volatile state of the object at key or nullptr */
+	template <typename State>
+	State *
+	find_state(const void *key)
+	{
+		std::unique_lock<std::mutex> lock(states_mutex);
+
+		auto it = states.find(key);
+
+		if (it == states.end())
+			return nullptr;
+
+		return static_cast<State *>(it->second.get());
+	}
+
+	/* Destroy the volatile state of the object at key, if any */
+	void
+	erase_state(const void *key)
+	{
+		std::unique_lock<std::mutex> lock(states_mutex);
+
+		states.erase(key);
+	}
+
 	std::atomic<bool> initialized;
 	std::function<void()> cleanup;
+
+	/* Set when the pool is being closed, background tasks stop on it */
+	std::atomic<bool> closing;
+
+	std::mutex background_mutex;
+	std::vector<std::function<void()>> background;
+
+	std::mutex release_mutex;
+	std::unordered_map<const void *, std::function<void()>> releases;
+
+	/* Volatile state of persistent objects, keyed by their address */
+	std::mutex states_mutex;
+	std::unordered_map<const void *, std::shared_ptr<void>> states;
 };
 
+/*
+ * Process-wide epoch of volatile caches which hold direct pointers to
+ * persistent objects. It is advanced whenever a pool is closed or such a
+ * cached object goes away, so a cache entry is valid only as long as the
+ * epoch it was filled in is still the current one.
+ */
+inline std::atomic<std::uint64_t> &
+cache_epoch() noexcept
+{
+	static std::atomic<std::uint64_t> epoch(1);
+	return epoch;
+}
+
+/* Invalidate all volatile caches tagged with cache_epoch() */
+inline void
+invalidate_caches() noexcept
+{
+	cache_epoch().fetch_add(1, std::memory_order_acq_rel);
+}
+
+/**
+ * Returns the volatile state of the container at obj in the current open of
+ * its pool, default constructed on the first call. The address of the state
+ * is remembered in a small thread_local table tagged with cache_epoch(), so
+ * a repeated lookup for the same container takes no lock.
+ *
+ * Pools opened with the C API have no pool_data, containers in such pools
+ * have no volatile state.
+ *
+ * @return pointer to the state or nullptr for pools opened with the C API.
+ *
+ * @throw std::bad_alloc if the state cannot be allocated.
+ */
+template <typename State>
+State *
+container_state(const void *obj)
+{
+	struct cache_entry {
+		const void *owner;
+		std::uint64_t epoch;
+		void *state;
+	};
+
+	static constexpr std::size_t cache_size = 16;
+	static thread_local cache_entry cache[cache_size];
+
+	auto index = (reinterpret_cast<std::uintptr_t>(obj) >> 4) % cache_size;
+	auto &entry = cache[index];
+	auto epoch = cache_epoch().load(std::memory_order_acquire);
+
+	if (entry.owner == obj && entry.epoch == epoch)
+		return static_cast<State *>(entry.state);
+
+	auto data = static_cast<pool_data *>(
+		pmemobj_get_user_data(pmemobj_pool_by_ptr(obj)));
+	if (data == nullptr)
+		return nullptr;
+
+	State *state = data->get_state<State>(obj);
+
+	entry.owner = obj;
+	entry.epoch = epoch;
+	entry.state = state;
+
+	return state;
+}
+
+/**
+ * Returns the volatile state of the container at obj in the current open of
+ * its pool, without creating it.
+ *
+ * @return pointer to the state or nullptr if it was not created.
+ */
+template <typename State>
+State *
+find_container_state(const void *obj) noexcept
+{
+	auto data = static_cast<pool_data *>(
+		pmemobj_get_user_data(pmemobj_pool_by_ptr(obj)));
+
+	return data == nullptr ? nullptr : data->find_state<State>(obj);
+}
+
+/**
+ * Destroys the volatile state of the container at obj, called by the
+ * constructor of the container, which may reuse the address of a destroyed
+ * one.
+ */
+inline void
+forget_container_state(const void *obj) noexcept
+{
+	auto data = static_cast<pool_data *>(
+		pmemobj_get_user_data(pmemobj_pool_by_ptr(obj)));
+
+	if (data != nullptr)
+		data->erase_state(obj);
+
+	invalidate_caches();
+}
+
+/**
+ * Makes close of the pool call release, which frees volatile memory
+ * referenced by a container in the pool (e.g. a DRAM cache), unless
+ * cancel_release_on_close() is called with the same key before. Nothing is
+ * registered for pools opened with the C API.
+ *
+ * @throw std::bad_alloc if the function cannot be registered.
+ */
+inline void
+release_on_close(PMEMobjpool *pop, const void *key,
+		 std::function<void()> release)
+{
+	auto data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+
+	if (data != nullptr)
+		data->set_release(key, std::move(release));
+}
+
+/**
+ * Cancels release_on_close() for the key, when the memory is freed by the
+ * container itself.
+ */
+inline void
+cancel_release_on_close(PMEMobjpool *pop, const void *key) noexcept
+{
+	auto data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+
+	if (data != nullptr)
+		data->cancel_release(key);
+}
+
+/**
+ * Calls the function registered by release_on_close() for the key now,
+ * if there is one.
+ *
+ * @return true if the function was registered, i.e. the memory was
+ *	allocated in the current open of the pool.
+ */
+inline bool
+release_now(PMEMobjpool *pop, const void *key) noexcept
+{
+	auto data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+
+	return data != nullptr && data->release(key);
+}
+
 } /* namespace detail */
 
 } /* namespace pmem */
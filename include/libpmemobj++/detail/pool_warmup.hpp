@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Prefaulting of the memory mapping of a pool.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_POOL_WARMUP_HPP
+#define LIBPMEMOBJ_CPP_POOL_WARMUP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/detail/common.hpp>
+
+#ifdef __linux__
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#endif
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/* Granularity in which the mapping is split between threads and in which
+ * cancellation is checked; a multiple of all page sizes up to 2MiB */
+const std::size_t warmup_chunk = std::size_t(2) << 20;
+
+/**
+ * Range of virtual addresses.
+ */
+struct mapped_range {
+	char *begin;
+	char *end;
+};
+
+/**
+ * Finds the file mapping which contains addr, merged with the following
+ * adjacent mappings of the same file.
+ *
+ * The mappings are read from /proc/self/maps on Linux. On other systems,
+ * or if the mapping cannot be found, an empty range is returned.
+ */
+inline mapped_range
+find_mapping(const void *addr)
+{
+	mapped_range range = {nullptr, nullptr};
+
+#ifdef __linux__
+	auto target = reinterpret_cast<std::uintptr_t>(addr);
+	std::uintptr_t last = 0;
+	std::ifstream maps("/proc/self/maps");
+	std::string line, file;
+
+	while (std::getline(maps, line)) {
+		std::istringstream in(line);
+		std::uintptr_t begin = 0, end = 0;
+		std::string skip, name;
+		char dash;
+
+		in >> std::hex >> begin >> dash >> end >> skip >> skip >>
+			skip >> skip >> std::ws;
+		std::getline(in, name);
+
+		if (range.begin == nullptr) {
+			if (target < begin || target >= end)
+				continue;
+
+			range.begin = reinterpret_cast<char *>(begin);
+			file = name;
+		} else if (file.empty() || name != file || begin != last) {
+			break;
+		}
+
+		last = end;
+		range.end = reinterpret_cast<char *>(end);
+	}
+#else
+	(void)addr;
+#endif
+
+	return range;
+}
+
+/*
+ * Faults in [begin, end) chunk by chunk, until done or cancelled.
+ * Returns the number of bytes processed.
+ */
+inline std::size_t
+warmup_range(char *begin, char *end, std::size_t stride, bool populate,
+	     const std::atomic<bool> &cancel) noexcept
+{
+	std::size_t done = 0;
+
+	while (begin < end && !cancel.load(std::memory_order_relaxed)) {
+		auto len = std::min(static_cast<std::size_t>(end - begin),
+				    warmup_chunk);
+
+#if defined(__linux__) && defined(MADV_POPULATE_READ)
+		if (!populate || madvise(begin, len, MADV_POPULATE_READ) != 0)
+#else
+		(void)populate;
+#endif
+			touch(begin, len, stride);
+
+		begin += len;
+		done += len;
+	}
+
+	return done;
+}
+
+/**
+ * Faults in the range using up to the given number of threads, the calling
+ * thread included. The range is only read.
+ *
+ * @return number of bytes processed, less than the size of the range if
+ *	cancelled.
+ *
+ * @throw std::system_error if a thread cannot be started.
+ */
+inline std::size_t
+warmup_mapping(mapped_range range, std::size_t threads, std::size_t stride,
+	       bool populate, const std::atomic<bool> &cancel)
+{
+	auto size = static_cast<std::size_t>(range.end - range.begin);
+	auto chunks = (size + warmup_chunk - 1) / warmup_chunk;
+
+	threads = std::max<std::size_t>(1, std::min(threads, chunks));
+
+	auto per_thread = (chunks + threads - 1) / threads * warmup_chunk;
+
+	std::vector<std::size_t> done(threads, 0);
+	std::vector<std::thread> workers;
+
+	auto work = [&](std::size_t i) {
+		auto begin = range.begin + std::min(size, i * per_thread);
+		auto end = range.begin + std::min(size, (i + 1) * per_thread);
+
+		done[i] = warmup_range(begin, end, stride, populate, cancel);
+	};
+
+	try {
+		for (std::size_t i = 1; i < threads; ++i)
+			workers.emplace_back(work, i);
+	} catch (...) {
+		for (auto &w : workers)
+			w.join();
+		throw;
+	}
+
+	work(0);
+
+	for (auto &w : workers)
+		w.join();
+
+	std::size_t total = 0;
+	for (auto d : done)
+		total += d;
+
+	return total;
+}
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_POOL_WARMUP_HPP */
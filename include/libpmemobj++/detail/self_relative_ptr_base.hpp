@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Base class for self_relative_ptr.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_BASE_HPP
+#define LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_BASE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <libpmemobj++/detail/common.hpp>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * self_relative_ptr base (non-template) class
+ *
+ * Stores the distance (in bytes) between its own address and the address
+ * of the object it points to, so that it stays valid regardless of the
+ * address at which the pool is mapped, and it can be dereferenced without
+ * looking up the pool.
+ *
+ * A null pointer is represented by offset 0, so zeroed memory contains null
+ * pointers. To make it possible, the stored offset is shifted by one: a
+ * pointer cannot point to the second byte of itself, which is never needed.
+ *
+ * The offset of a copy has to be recalculated, because the copy resides at
+ * a different address. For the same reason self_relative_ptr is not
+ * trivially copyable and must not be copied with memcpy.
+ */
+class self_relative_ptr_base {
+public:
+	/** Type of the offset. */
+	using difference_type = std::ptrdiff_t;
+
+	/** Offset which represents a null pointer. */
+	static constexpr difference_type nullptr_offset = 0;
+
+	/**
+	 * Default constructor, equal to nullptr.
+	 */
+	self_relative_ptr_base() noexcept : offset(nullptr_offset)
+	{
+	}
+
+	/**
+	 * Nullptr constructor.
+	 */
+	self_relative_ptr_base(std::nullptr_t) noexcept
+	    : offset(nullptr_offset)
+	{
+	}
+
+	/**
+	 * Volatile pointer constructor.
+	 *
+	 * @param ptr volatile pointer to the object, usually residing in the
+	 * same pool.
+	 */
+	self_relative_ptr_base(const void *ptr) noexcept
+	    : offset(pointer_to_offset(this, ptr))
+	{
+	}
+
+	/**
+	 * Copy constructor, calculates the offset relative to the new
+	 * object.
+	 */
+	self_relative_ptr_base(const self_relative_ptr_base &r) noexcept
+	    : offset(pointer_to_offset(this, r.to_void_pointer()))
+	{
+	}
+
+	/**
+	 * Assignment operator.
+	 *
+	 * Self-relative pointer assignment within a transaction
+	 * automatically registers this operation so that a rollback
+	 * is possible.
+	 *
+	 * @throw pmem::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr_base &
+	operator=(const self_relative_ptr_base &r)
+	{
+		if (this == &r)
+			return *this;
+
+		detail::conditional_add_to_tx(this);
+		offset = pointer_to_offset(this, r.to_void_pointer());
+
+		return *this;
+	}
+
+	/**
+	 * Nullptr assignment operator.
+	 *
+	 * @throw pmem::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr_base &
+	operator=(std::nullptr_t)
+	{
+		detail::conditional_add_to_tx(this);
+		offset = nullptr_offset;
+
+		return *this;
+	}
+
+	/**
+	 * Swaps two self_relative_ptr_base objects.
+	 *
+	 * @param[in,out] other the other pointer to swap.
+	 *
+	 * @throw pmem::transaction_error when adding the objects to the
+	 *	transaction failed.
+	 */
+	void
+	swap(self_relative_ptr_base &other)
+	{
+		if (this == &other)
+			return;
+
+		detail::conditional_add_to_tx(this);
+		detail::conditional_add_to_tx(&other);
+
+		void *first = to_void_pointer();
+		void *second = other.to_void_pointer();
+
+		offset = pointer_to_offset(this, second);
+		other.offset = pointer_to_offset(&other, first);
+	}
+
+	/**
+	 * @return the direct pointer to the object.
+	 */
+	void *
+	to_void_pointer() const noexcept
+	{
+		return offset_to_pointer(this, offset);
+	}
+
+	/**
+	 * @return true if the pointer is null.
+	 */
+	bool
+	is_null() const noexcept
+	{
+		return offset == nullptr_offset;
+	}
+
+	/**
+	 * Converts the offset stored at the address base to the pointer.
+	 */
+	static void *
+	offset_to_pointer(const void *base, difference_type off) noexcept
+	{
+		if (off == nullptr_offset)
+			return nullptr;
+
+		return reinterpret_cast<void *>(
+			reinterpret_cast<std::uintptr_t>(base) +
+			static_cast<std::uintptr_t>(off) + 1);
+	}
+
+	/**
+	 * Converts the pointer to the offset which can be stored at the
+	 * address base.
+	 */
+	static difference_type
+	pointer_to_offset(const void *base, const void *ptr) noexcept
+	{
+		if (ptr == nullptr)
+			return nullptr_offset;
+
+		return static_cast<difference_type>(
+			reinterpret_cast<std::uintptr_t>(ptr) -
+			reinterpret_cast<std::uintptr_t>(base) - 1);
+	}
+
+protected:
+	/* Offset of the object relative to this, minus one. */
+	difference_type offset;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_BASE_HPP */
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Per-transaction set of snapshotted ranges.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_SNAPSHOT_TRACKER_HPP
+#define LIBPMEMOBJ_CPP_SNAPSHOT_TRACKER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Counters of the snapshot requests of the calling thread.
+ */
+struct snapshot_stats {
+	/* number of ranges requested to be snapshotted */
+	uint64_t requested = 0;
+	/* number of ranges passed to pmemobj_tx_add_range */
+	uint64_t forwarded = 0;
+	/* number of requests already covered by the earlier snapshots */
+	uint64_t avoided = 0;
+};
+
+/**
+ * Set of ranges snapshotted in the current transaction of the calling
+ * thread.
+ *
+ * Containers often snapshot overlapping or repeated ranges within a single
+ * transaction, and every call to pmemobj_tx_add_range_direct has to search
+ * the range tree of libpmemobj. The tracker keeps the snapshotted ranges
+ * (with the adjacent ones coalesced) in a sorted vector and forwards only
+ * the parts of a request which are not covered yet.
+ *
+ * The tracker is active only in transactions started by the C++ API, as
+ * only then the end of the transaction is reliably observed (in
+ * transaction::c_callback). In other transactions all requests are
+ * forwarded.
+ */
+class snapshot_tracker {
+public:
+	/*
+	 * Above this number of ranges new ranges are not recorded, so that
+	 * the cost of insertion stays bounded.
+	 */
+	static constexpr size_t max_ranges = 1024;
+
+	/**
+	 * @return the tracker of the calling thread.
+	 */
+	static snapshot_tracker &
+	instance() noexcept
+	{
+		static thread_local snapshot_tracker tracker;
+		return tracker;
+	}
+
+	/**
+	 * Starts tracking a new transaction.
+	 */
+	void
+	start() noexcept
+	{
+		ranges.clear();
+		active = true;
+	}
+
+	/**
+	 * Stops tracking, called when the transaction leaves the work stage.
+	 */
+	void
+	stop() noexcept
+	{
+		active = false;
+		ranges.clear();
+	}
+
+	/**
+	 * Calls add_range for the parts of [ptr, ptr + size) which were not
+	 * snapshotted in the current transaction and records the range.
+	 *
+	 * @param[in] add_range callable taking (const void *, size_t),
+	 *	which snapshots the range and throws on failure.
+	 */
+	template <typename F>
+	void
+	add(const void *ptr, size_t size, F &&add_range)
+	{
+		++stats.requested;
+
+		if (!active) {
+			++stats.forwarded;
+			add_range(ptr, size);
+			return;
+		}
+
+		auto begin = reinterpret_cast<uintptr_t>(ptr);
+		auto end = begin + size;
+
+		/* first range which ends after the beginning of the request */
+		auto it = std::upper_bound(
+			ranges.begin(), ranges.end(), begin,
+			[](uintptr_t v, const range &r) { return v < r.end; });
+
+		auto cursor = begin;
+		bool covered = true;
+
+		for (auto r = it; r != ranges.end() && r->begin < end; ++r) {
+			if (r->begin > cursor) {
+				forward(cursor, r->begin, add_range);
+				covered = false;
+			}
+			cursor = std::max(cursor, r->end);
+		}
+
+		if (cursor < end) {
+			forward(cursor, end, add_range);
+			covered = false;
+		}
+
+		if (covered) {
+			++stats.avoided;
+			return;
+		}
+
+		insert(begin, end);
+	}
+
+	/**
+	 * @return counters of the calling thread.
+	 */
+	const snapshot_stats &
+	statistics() const noexcept
+	{
+		return stats;
+	}
+
+	/**
+	 * Resets counters of the calling thread.
+	 */
+	void
+	reset_statistics() noexcept
+	{
+		stats = snapshot_stats();
+	}
+
+private:
+	struct range {
+		uintptr_t begin;
+		uintptr_t end;
+	};
+
+	snapshot_tracker() = default;
+
+	template <typename F>
+	void
+	forward(uintptr_t begin, uintptr_t end, F &add_range)
+	{
+		++stats.forwarded;
+		add_range(reinterpret_cast<const void *>(begin),
+			  static_cast<size_t>(end - begin));
+	}
+
+	/*
+	 * Inserts [begin, end), merging it with the overlapping and adjacent
+	 * ranges.
+	 */
+	void
+	insert(uintptr_t begin, uintptr_t end)
+	{
+		/* first range which ends at or after the beginning */
+		auto first = std::lower_bound(
+			ranges.begin(), ranges.end(), begin,
+			[](const range &r, uintptr_t v) { return r.end < v; });
+
+		auto last = first;
+		while (last != ranges.end() && last->begin <= end) {
+			begin = std::min(begin, last->begin);
+			end = std::max(end, last->end);
+			++last;
+		}
+
+		if (first != last) {
+			first->begin = begin;
+			first->end = end;
+			ranges.erase(first + 1, last);
+		} else if (ranges.size() < max_ranges) {
+			ranges.insert(first, range{begin, end});
+		}
+	}
+
+	std::vector<range> ranges;
+	snapshot_stats stats;
+	bool active = false;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_SNAPSHOT_TRACKER_HPP */
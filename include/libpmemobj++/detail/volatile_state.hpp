@@ -11,7 +11,9 @@
 #ifndef LIBPMEMOBJ_CPP_VOLATILE_STATE_HPP
 #define LIBPMEMOBJ_CPP_VOLATILE_STATE_HPP
 
+#include <array>
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -21,6 +23,7 @@
 
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj++/transaction.hpp>
 
@@ -34,6 +37,13 @@ namespace detail
  * Global key value store which allows persistent objects to
  * use volatile memory. Entries in this kv store are indexed
  * by PMEMoids.
+ *
+ * The store is split into shards selected by a hash of the PMEMoid, each
+ * protected by its own rwlock, so lookups of unrelated objects do not
+ * contend on a single lock. Successful lookups are additionally remembered
+ * in a small thread_local table tagged with cache_epoch(); a repeated
+ * lookup of the same object takes no lock at all. destroy() and pool close
+ * advance the epoch, which drops all remembered entries.
  */
 class volatile_state {
 public:
@@ -41,24 +51,36 @@ public:
 	static T *
 	get_if_exists(const PMEMoid &oid)
 	{
-		auto &map = get_map();
+		auto h = hash(oid);
+		auto &entry = get_cache()[h % cache_size];
+		auto epoch = cache_epoch().load(std::memory_order_acquire);
+
+		if (entry.epoch == epoch && pmemoid_equal_to()(entry.oid, oid))
+			return static_cast<T *>(entry.value);
+
+		auto &shard = get_shard(h);
+		void *value = nullptr;
 
 		{
-			std::shared_lock<rwlock_type> lock(get_rwlock());
-			auto it = map.find(oid);
-			if (it != map.end())
-				return static_cast<T *>(it->second.get());
-			else
-				return nullptr;
+			std::shared_lock<rwlock_type> lock(shard.rwlock);
+			auto it = shard.map.find(oid);
+			if (it != shard.map.end())
+				value = it->second.get();
+		}
+
+		if (value) {
+			entry.oid = oid;
+			entry.epoch = epoch;
+			entry.value = value;
 		}
+
+		return static_cast<T *>(value);
 	}
 
 	template <typename T>
 	static T *
 	get(const PMEMoid &oid)
 	{
-		auto &map = get_map();
-
 		auto element = get_if_exists<T>(oid);
 		if (element)
 			return element;
@@ -67,17 +89,19 @@ public:
 			throw pmem::transaction_scope_error(
 				"volatile_state::get() cannot be called in a transaction");
 
+		auto &shard = get_shard(hash(oid));
+
 		{
-			std::unique_lock<rwlock_type> lock(get_rwlock());
+			std::unique_lock<rwlock_type> lock(shard.rwlock);
 
 			auto deleter = [](void const *data) {
 				T const *p = static_cast<T const *>(data);
 				delete p;
 			};
 
-			auto it = map.find(oid);
-			if (it == map.end()) {
-				auto ret = map.emplace(
+			auto it = shard.map.find(oid);
+			if (it == shard.map.end()) {
+				auto ret = shard.map.emplace(
 					std::piecewise_construct,
 					std::forward_as_tuple(oid),
 					std::forward_as_tuple(new T, deleter));
@@ -108,14 +132,10 @@ public:
 	{
 		if (pmemobj_tx_stage() == TX_STAGE_WORK) {
 			obj::transaction::register_callback(
-				obj::transaction::stage::oncommit, [oid] {
-					std::unique_lock<rwlock_type> lock(
-						get_rwlock());
-					get_map().erase(oid);
-				});
+				obj::transaction::stage::oncommit,
+				[oid] { erase(oid); });
 		} else {
-			std::unique_lock<rwlock_type> lock(get_rwlock());
-			get_map().erase(oid);
+			erase(oid);
 		}
 	}
 
@@ -147,32 +167,85 @@ private:
 
 	using rwlock_type = std::shared_timed_mutex;
 
+	/* Shards are aligned to separate their locks' cache lines */
+	struct alignas(64) shard_type {
+		rwlock_type rwlock;
+		map_type map;
+	};
+
+	/* Entry of the per-thread lookup cache */
+	struct cache_entry {
+		PMEMoid oid;
+		std::uint64_t epoch;
+		void *value;
+	};
+
+	static constexpr std::size_t shards_number = 64;
+	static constexpr std::size_t cache_size = 16;
+
+	/*
+	 * Offsets of objects are usually aligned, so mix all bits of the
+	 * PMEMoid before selecting a shard or a cache entry.
+	 */
+	static std::size_t
+	hash(const PMEMoid &oid)
+	{
+		std::uint64_t h = pmemoid_hash()(oid);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return static_cast<std::size_t>(h);
+	}
+
+	static void
+	erase(const PMEMoid &oid)
+	{
+		auto &shard = get_shard(hash(oid));
+
+		{
+			std::unique_lock<rwlock_type> lock(shard.rwlock);
+			shard.map.erase(oid);
+		}
+
+		invalidate_caches();
+	}
+
 	static void
 	clear_from_pool(uint64_t pool_id)
 	{
-		std::unique_lock<rwlock_type> lock(get_rwlock());
-		auto &map = get_map();
-
-		for (auto it = map.begin(); it != map.end();) {
-			if (it->first.pool_uuid_lo == pool_id)
-				it = map.erase(it);
-			else
-				++it;
+		for (auto &shard : get_shards()) {
+			std::unique_lock<rwlock_type> lock(shard.rwlock);
+			auto &map = shard.map;
+
+			for (auto it = map.begin(); it != map.end();) {
+				if (it->first.pool_uuid_lo == pool_id)
+					it = map.erase(it);
+				else
+					++it;
+			}
 		}
+
+		invalidate_caches();
+	}
+
+	static std::array<shard_type, shards_number> &
+	get_shards()
+	{
+		static std::array<shard_type, shards_number> shards;
+		return shards;
 	}
 
-	static map_type &
-	get_map()
+	static shard_type &
+	get_shard(std::size_t h)
 	{
-		static map_type map;
-		return map;
+		return get_shards()[(h >> 8) % shards_number];
 	}
 
-	static rwlock_type &
-	get_rwlock()
+	static cache_entry *
+	get_cache()
 	{
-		static rwlock_type rwlock;
-		return rwlock;
+		static thread_local cache_entry cache[cache_size];
+		return cache;
 	}
 };
 
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Volatile buffer of writes to persistent memory.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_WRITE_SET_HPP
+#define LIBPMEMOBJ_CPP_WRITE_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Set of buffered writes, kept at the granularity of 8-byte words.
+ *
+ * Every word remembers which of its bytes were written, so writes of any
+ * size and alignment can be buffered. The bytes which were not written
+ * are never read from the memory: merging them at commit would revert
+ * the updates made to them in the meantime, so it is left to the user of
+ * the set, which must do it atomically with applying the word.
+ */
+class write_set {
+public:
+	static constexpr uintptr_t word_size = sizeof(uint64_t);
+
+	/**
+	 * Buffers a write of size bytes from src to dst.
+	 */
+	void
+	write(void *dst, const void *src, size_t size)
+	{
+		auto begin = reinterpret_cast<uintptr_t>(dst);
+		auto end = begin + size;
+		auto bytes = static_cast<const unsigned char *>(src);
+
+		for (auto w = begin & ~word_mask; w < end; w += word_size) {
+			auto &entry = words[reinterpret_cast<uint64_t *>(w)];
+
+			for (size_t i = 0; i < word_size; ++i) {
+				auto addr = w + i;
+				if (addr < begin || addr >= end)
+					continue;
+
+				entry.bytes[i] = bytes[addr - begin];
+				entry.mask[i] = 0xff;
+			}
+		}
+	}
+
+	/**
+	 * Copies size bytes from src to dst, including the buffered writes.
+	 */
+	void
+	read(void *dst, const void *src, size_t size) const
+	{
+		std::memcpy(dst, src, size);
+
+		if (size == 0 || words.empty())
+			return;
+
+		auto begin = reinterpret_cast<uintptr_t>(src);
+		auto end = begin + size;
+		auto bytes = static_cast<unsigned char *>(dst);
+
+		for (auto w = begin & ~word_mask; w < end; w += word_size) {
+			auto it = words.find(reinterpret_cast<uint64_t *>(w));
+			if (it == words.end())
+				continue;
+
+			for (size_t i = 0; i < word_size; ++i) {
+				auto addr = w + i;
+				if (addr < begin || addr >= end ||
+				    !it->second.mask[i])
+					continue;
+
+				bytes[addr - begin] = it->second.bytes[i];
+			}
+		}
+	}
+
+	/**
+	 * Calls f(uint64_t *addr, uint64_t value, uint64_t mask) for every
+	 * modified word. All bits of the written bytes are set in mask, the
+	 * other bytes of value are zero.
+	 */
+	template <typename F>
+	void
+	for_each(F &&f) const
+	{
+		for (auto &w : words) {
+			uint64_t value, mask;
+			std::memcpy(&value, w.second.bytes, word_size);
+			std::memcpy(&mask, w.second.mask, word_size);
+
+			f(w.first, value, mask);
+		}
+	}
+
+	/**
+	 * @return true if all bytes of every modified word were written.
+	 */
+	bool
+	whole_words() const noexcept
+	{
+		for (auto &w : words) {
+			for (size_t i = 0; i < word_size; ++i) {
+				if (!w.second.mask[i])
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @return the number of modified words.
+	 */
+	size_t
+	size() const noexcept
+	{
+		return words.size();
+	}
+
+	bool
+	empty() const noexcept
+	{
+		return words.empty();
+	}
+
+	void
+	clear() noexcept
+	{
+		words.clear();
+	}
+
+private:
+	static constexpr uintptr_t word_mask = word_size - 1;
+
+	/* buffered bytes of a word, mask marks the written ones */
+	struct word {
+		unsigned char bytes[word_size] = {};
+		unsigned char mask[word_size] = {};
+	};
+
+	std::unordered_map<uint64_t *, word> words;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_WRITE_SET_HPP */
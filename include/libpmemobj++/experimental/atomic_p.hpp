@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Atomic persistent property, which guarantees that readers never observe
+ * a value which is not durable.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_ATOMIC_P_HPP
+#define LIBPMEMOBJ_CPP_ATOMIC_P_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj/base.h>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Atomic persistent property with built-in flush semantics.
+ *
+ * All modifications flush the value before returning. Unlike in
+ * atomic_persistent_ptr, there is no spare bit in the value which could be
+ * used as a "dirty" flag, so the number of modifications in progress is
+ * counted instead. A reader which observes a non-zero counter flushes the
+ * value before returning it (flush-on-read), so the readers never act on a
+ * value which could be lost after a crash, while in the common case of no
+ * concurrent writers reading the value costs two loads from the same cache
+ * line.
+ *
+ * The counter may be left non-zero after a crash, which causes redundant
+ * flushes on every read until runtime_initialize() is called.
+ *
+ * T has to be trivially copyable and not bigger than 8 bytes, so that
+ * std::atomic<T> is lock-free on the supported platforms.
+ *
+ * If the object does not reside in a pool, no flushes are done.
+ * The operations are not added to transactions.
+ */
+template <typename T>
+class alignas(16) atomic_p {
+	static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+		      "T must be trivially copyable");
+	static_assert(sizeof(T) <= sizeof(uint64_t),
+		      "T must not be bigger than 8 bytes");
+
+public:
+	using value_type = T;
+
+	/**
+	 * Value-initializes the value.
+	 */
+	atomic_p() noexcept : value(T()), writers(0)
+	{
+	}
+
+	/**
+	 * Initializes the value. The initialization is not atomic and the
+	 * value is not flushed.
+	 */
+	atomic_p(T desired) noexcept : value(desired), writers(0)
+	{
+	}
+
+	atomic_p(const atomic_p &) = delete;
+	atomic_p &operator=(const atomic_p &) = delete;
+
+	/**
+	 * Resets the counter of modifications in progress. Should be called
+	 * after the pool is opened, before the property is accessed
+	 * concurrently. Not thread safe.
+	 */
+	void
+	runtime_initialize() noexcept
+	{
+		writers.store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Atomically loads the value. If a modification of the value is in
+	 * progress, flushes it before returning.
+	 *
+	 * @return the durable value.
+	 */
+	T
+	load() const noexcept
+	{
+		T v = value.load();
+
+		if (writers.load() != 0)
+			persist();
+
+		return v;
+	}
+
+	/**
+	 * Atomically stores the value and flushes it.
+	 */
+	void
+	store_persist(T desired) noexcept
+	{
+		writer_guard guard(*this);
+
+		value.store(desired);
+		persist();
+	}
+
+	/**
+	 * Atomically replaces the value and flushes it.
+	 *
+	 * @return the previous value.
+	 */
+	T
+	exchange_persist(T desired) noexcept
+	{
+		writer_guard guard(*this);
+
+		T old = value.exchange(desired);
+		persist();
+
+		return old;
+	}
+
+	/**
+	 * Atomically compares the value with expected and if they are
+	 * equal, replaces it with desired and flushes it. Otherwise, loads
+	 * the current (durable) value into expected.
+	 *
+	 * @return true if the value was replaced, false otherwise.
+	 */
+	bool
+	compare_exchange_persist(T &expected, T desired) noexcept
+	{
+		writer_guard guard(*this);
+
+		bool result = value.compare_exchange_strong(expected, desired);
+
+		/* flush also the value observed on failure */
+		if (result || writers.load() > 1)
+			persist();
+
+		return result;
+	}
+
+	/**
+	 * Atomically adds arg to the value and flushes it. Available only
+	 * for integral types.
+	 *
+	 * @return the previous value.
+	 */
+	template <typename U = T,
+		  typename = typename std::enable_if<
+			  std::is_integral<U>::value>::type>
+	T
+	fetch_add_persist(T arg) noexcept
+	{
+		writer_guard guard(*this);
+
+		T old = value.fetch_add(arg);
+		persist();
+
+		return old;
+	}
+
+	/**
+	 * Atomically subtracts arg from the value and flushes it. Available
+	 * only for integral types.
+	 *
+	 * @return the previous value.
+	 */
+	template <typename U = T,
+		  typename = typename std::enable_if<
+			  std::is_integral<U>::value>::type>
+	T
+	fetch_sub_persist(T arg) noexcept
+	{
+		writer_guard guard(*this);
+
+		T old = value.fetch_sub(arg);
+		persist();
+
+		return old;
+	}
+
+	/**
+	 * @return true if the operations are lock-free.
+	 */
+	bool
+	is_lock_free() const noexcept
+	{
+		return value.is_lock_free() && writers.is_lock_free();
+	}
+
+	/**
+	 * Equivalent to load().
+	 */
+	operator T() const noexcept
+	{
+		return load();
+	}
+
+	/**
+	 * Equivalent to store_persist().
+	 */
+	T
+	operator=(T desired) noexcept
+	{
+		store_persist(desired);
+		return desired;
+	}
+
+private:
+	/*
+	 * Marks a modification in progress. The counter is incremented
+	 * before the value is modified and decremented after it is flushed,
+	 * so a reader which observed the new value and a zero counter knows
+	 * that the value is durable.
+	 */
+	class writer_guard {
+	public:
+		writer_guard(const atomic_p &owner) : owner(owner)
+		{
+			owner.writers.fetch_add(1);
+		}
+
+		~writer_guard()
+		{
+			owner.writers.fetch_sub(1);
+		}
+
+		writer_guard(const writer_guard &) = delete;
+		writer_guard &operator=(const writer_guard &) = delete;
+
+	private:
+		const atomic_p &owner;
+	};
+
+	void
+	persist() const noexcept
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		if (pop != nullptr)
+			pmemobj_persist(pop, &value, sizeof(value));
+	}
+
+	std::atomic<T> value;
+	mutable std::atomic<uint32_t> writers;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_ATOMIC_P_HPP */
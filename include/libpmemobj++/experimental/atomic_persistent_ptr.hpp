@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Atomic persistent pointer, which guarantees that readers never observe
+ * a pointer which is not durable.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_ATOMIC_PERSISTENT_PTR_HPP
+#define LIBPMEMOBJ_CPP_ATOMIC_PERSISTENT_PTR_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/self_relative_ptr_base.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj/base.h>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Atomic persistent pointer with built-in flush semantics.
+ *
+ * The pointer is stored in the self_relative_ptr format, so it takes 8
+ * bytes and all operations are lock-free. Every modification stores the
+ * new value with a "dirty" flag, which is cleared after the value is
+ * flushed (link-and-persist). A reader which observes a dirty value
+ * flushes it and clears the flag before returning the value (flush-on-read),
+ * so the readers never act on a pointer which could be lost after a crash,
+ * and the pointer is flushed only once no matter how many threads read it.
+ *
+ * store() only marks the value as dirty and leaves flushing to the first
+ * reader, while store_persist() and compare_exchange_persist() flush the
+ * value before returning. The dirty flag may survive a crash, which only
+ * causes one redundant flush after restart.
+ *
+ * If the object does not reside in a pool, no flushes are done.
+ * The operations are not added to transactions.
+ */
+template <typename T>
+class atomic_persistent_ptr {
+private:
+	using base_type = pmem::detail::self_relative_ptr_base;
+
+public:
+	using value_type = self_relative_ptr<T>;
+	using difference_type = base_type::difference_type;
+
+	/**
+	 * Default constructor, equal to nullptr.
+	 */
+	atomic_persistent_ptr() noexcept : ptr(base_type::nullptr_offset)
+	{
+	}
+
+	/**
+	 * Initializes the pointer with value. The initialization is not
+	 * atomic and the value is not flushed.
+	 */
+	atomic_persistent_ptr(value_type value) noexcept
+	    : ptr(encode(value.get()))
+	{
+	}
+
+	atomic_persistent_ptr(const atomic_persistent_ptr &) = delete;
+	atomic_persistent_ptr &
+	operator=(const atomic_persistent_ptr &) = delete;
+
+	/**
+	 * Atomically loads the pointer. If the value was not flushed yet,
+	 * flushes it before returning.
+	 *
+	 * @return the durable value of the pointer.
+	 */
+	value_type
+	load(std::memory_order order = std::memory_order_seq_cst) const noexcept
+	{
+		difference_type off = ptr.load(order);
+
+		if (is_dirty(off))
+			off = make_clean(off);
+
+		return value_type{decode(off)};
+	}
+
+	/**
+	 * Atomically stores the pointer without flushing it. The value is
+	 * flushed by the first reader, or by a subsequent persist
+	 * operation.
+	 */
+	void
+	store(value_type desired,
+	      std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		ptr.store(set_dirty(encode(desired.get())), order);
+	}
+
+	/**
+	 * Atomically stores the pointer and flushes it.
+	 */
+	void
+	store_persist(value_type desired) noexcept
+	{
+		difference_type off = set_dirty(encode(desired.get()));
+
+		ptr.store(off, std::memory_order_seq_cst);
+		make_clean(off);
+	}
+
+	/**
+	 * Atomically compares the pointer with expected and if they are
+	 * equal, replaces it with desired and flushes it. Otherwise, loads
+	 * the current (durable) value of the pointer into expected.
+	 *
+	 * The operation does not fail because the pointer was not flushed
+	 * yet.
+	 *
+	 * @return true if the pointer was replaced, false otherwise.
+	 */
+	bool
+	compare_exchange_persist(value_type &expected,
+				 value_type desired) noexcept
+	{
+		difference_type expected_off = encode(expected.get());
+		difference_type desired_off = set_dirty(encode(desired.get()));
+
+		while (true) {
+			difference_type off = expected_off;
+			if (ptr.compare_exchange_strong(off, desired_off)) {
+				make_clean(desired_off);
+				return true;
+			}
+
+			if (is_dirty(off)) {
+				off = make_clean(off);
+
+				/* the expected value was not flushed yet */
+				if (off == expected_off)
+					continue;
+			}
+
+			expected = decode(off);
+			return false;
+		}
+	}
+
+	/**
+	 * @return true if the operations are lock-free.
+	 */
+	bool
+	is_lock_free() const noexcept
+	{
+		return ptr.is_lock_free();
+	}
+
+	/**
+	 * Equivalent to load().
+	 */
+	operator value_type() const noexcept
+	{
+		return load();
+	}
+
+	/**
+	 * Equivalent to store_persist().
+	 */
+	value_type
+	operator=(value_type desired) noexcept
+	{
+		store_persist(desired);
+		return desired;
+	}
+
+private:
+	/*
+	 * The dirty flag is stored by negating the bit 62 of the offset.
+	 * Offsets never exceed the size of the address space, so the bits 62
+	 * and 63 of a clean offset are always equal (also for negative
+	 * offsets and nullptr).
+	 */
+	static constexpr difference_type dirty_flag = difference_type(1)
+		<< 62;
+
+	static bool
+	is_dirty(difference_type off) noexcept
+	{
+		uint64_t u = static_cast<uint64_t>(off);
+
+		return ((u >> 62) ^ (u >> 63)) & 1;
+	}
+
+	static difference_type
+	set_dirty(difference_type off) noexcept
+	{
+		return off ^ dirty_flag;
+	}
+
+	static difference_type
+	clear_dirty(difference_type off) noexcept
+	{
+		return off ^ dirty_flag;
+	}
+
+	difference_type
+	encode(const void *pointer) const noexcept
+	{
+		return base_type::pointer_to_offset(this, pointer);
+	}
+
+	typename value_type::element_type *
+	decode(difference_type off) const noexcept
+	{
+		return static_cast<typename value_type::element_type *>(
+			base_type::offset_to_pointer(this, off));
+	}
+
+	/*
+	 * Flushes the dirty offset and clears the flag, unless the pointer
+	 * was modified in the meantime. Returns the clean offset.
+	 */
+	difference_type
+	make_clean(difference_type off) const noexcept
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		if (pop != nullptr)
+			pmemobj_persist(pop, &ptr, sizeof(ptr));
+
+		difference_type expected = off;
+		ptr.compare_exchange_strong(expected, clear_dirty(off),
+					    std::memory_order_release,
+					    std::memory_order_relaxed);
+
+		return clear_dirty(off);
+	}
+
+	mutable std::atomic<difference_type> ptr;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_ATOMIC_PERSISTENT_PTR_HPP */
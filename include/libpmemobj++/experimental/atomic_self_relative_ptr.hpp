@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Specialization of std::atomic for self_relative_ptr, which allows to use
+ * self-relative pointers in lock-free data structures.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_ATOMIC_SELF_RELATIVE_PTR_HPP
+#define LIBPMEMOBJ_CPP_ATOMIC_SELF_RELATIVE_PTR_HPP
+
+#include <atomic>
+#include <cstddef>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/self_relative_ptr_base.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+
+namespace std
+{
+
+/**
+ * Atomic specialization for self_relative_ptr.
+ *
+ * Stores the offset in the same format as self_relative_ptr, relative to
+ * its own address, so it has the same size and it can be placed in
+ * persistent memory. All operations are lock-free if the offset type is
+ * lock-free. The values are converted to and from self_relative_ptr when
+ * they are passed to or returned from the operations, which requires only
+ * an addition or a subtraction.
+ *
+ * The operations are not added to transactions, which is consistent with
+ * std::atomic of other types. Flushing the stored value is the
+ * responsibility of the user.
+ */
+template <typename T>
+struct atomic<pmem::obj::experimental::self_relative_ptr<T>> {
+private:
+	using base_type = pmem::detail::self_relative_ptr_base;
+	using difference_type = base_type::difference_type;
+
+public:
+	using value_type = pmem::obj::experimental::self_relative_ptr<T>;
+
+	/*
+	 * Constructors
+	 */
+
+	atomic() noexcept : ptr(base_type::nullptr_offset)
+	{
+	}
+
+	atomic(value_type value) : ptr(to_offset(value.get()))
+	{
+	}
+
+	atomic(const atomic &) = delete;
+
+	void
+	store(value_type desired,
+	      std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		ptr.store(to_offset(desired.get()), order);
+	}
+
+	value_type
+	load(std::memory_order order = std::memory_order_seq_cst) const noexcept
+	{
+		return value_type{to_pointer(ptr.load(order))};
+	}
+
+	value_type
+	exchange(value_type desired,
+		 std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		auto old = ptr.exchange(to_offset(desired.get()), order);
+
+		return value_type{to_pointer(old)};
+	}
+
+	bool
+	compare_exchange_weak(value_type &expected, value_type desired,
+			      std::memory_order success,
+			      std::memory_order failure) noexcept
+	{
+		auto expected_off = to_offset(expected.get());
+		auto desired_off = to_offset(desired.get());
+		bool result = ptr.compare_exchange_weak(
+			expected_off, desired_off, success, failure);
+		if (!result)
+			expected = to_pointer(expected_off);
+
+		return result;
+	}
+
+	bool
+	compare_exchange_weak(
+		value_type &expected, value_type desired,
+		std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		auto expected_off = to_offset(expected.get());
+		auto desired_off = to_offset(desired.get());
+		bool result = ptr.compare_exchange_weak(expected_off,
+							desired_off, order);
+		if (!result)
+			expected = to_pointer(expected_off);
+
+		return result;
+	}
+
+	bool
+	compare_exchange_strong(value_type &expected, value_type desired,
+				std::memory_order success,
+				std::memory_order failure) noexcept
+	{
+		auto expected_off = to_offset(expected.get());
+		auto desired_off = to_offset(desired.get());
+		bool result = ptr.compare_exchange_strong(
+			expected_off, desired_off, success, failure);
+		if (!result)
+			expected = to_pointer(expected_off);
+
+		return result;
+	}
+
+	bool
+	compare_exchange_strong(
+		value_type &expected, value_type desired,
+		std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		auto expected_off = to_offset(expected.get());
+		auto desired_off = to_offset(desired.get());
+		bool result = ptr.compare_exchange_strong(expected_off,
+							  desired_off, order);
+		if (!result)
+			expected = to_pointer(expected_off);
+
+		return result;
+	}
+
+	/**
+	 * Atomically adds val elements to the stored pointer. The stored
+	 * pointer must not be null.
+	 *
+	 * @return the previous value.
+	 */
+	value_type
+	fetch_add(difference_type val,
+		  std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		auto offset = ptr.fetch_add(val * elem_size(), order);
+
+		return value_type{to_pointer(offset)};
+	}
+
+	/**
+	 * Atomically subtracts val elements from the stored pointer. The
+	 * stored pointer must not be null.
+	 *
+	 * @return the previous value.
+	 */
+	value_type
+	fetch_sub(difference_type val,
+		  std::memory_order order = std::memory_order_seq_cst) noexcept
+	{
+		auto offset = ptr.fetch_sub(val * elem_size(), order);
+
+		return value_type{to_pointer(offset)};
+	}
+
+	bool
+	is_lock_free() const noexcept
+	{
+		return ptr.is_lock_free();
+	}
+
+	/*
+	 * Operators
+	 */
+
+	operator value_type() const noexcept
+	{
+		return load();
+	}
+
+	atomic &operator=(const atomic &) = delete;
+	atomic &operator=(const atomic &) volatile = delete;
+
+	value_type
+	operator=(value_type desired) noexcept
+	{
+		store(desired);
+		return desired;
+	}
+
+	value_type
+	operator++() noexcept
+	{
+		return this->fetch_add(1) + 1;
+	}
+
+	value_type
+	operator++(int) noexcept
+	{
+		return this->fetch_add(1);
+	}
+
+	value_type
+	operator--() noexcept
+	{
+		return this->fetch_sub(1) - 1;
+	}
+
+	value_type
+	operator--(int) noexcept
+	{
+		return this->fetch_sub(1);
+	}
+
+	value_type
+	operator+=(difference_type diff) noexcept
+	{
+		return this->fetch_add(diff) + diff;
+	}
+
+	value_type
+	operator-=(difference_type diff) noexcept
+	{
+		return this->fetch_sub(diff) - diff;
+	}
+
+private:
+	static constexpr difference_type
+	elem_size() noexcept
+	{
+		return static_cast<difference_type>(sizeof(T));
+	}
+
+	difference_type
+	to_offset(const void *pointer) const noexcept
+	{
+		return base_type::pointer_to_offset(this, pointer);
+	}
+
+	typename value_type::element_type *
+	to_pointer(difference_type offset) const noexcept
+	{
+		return static_cast<typename value_type::element_type *>(
+			base_type::offset_to_pointer(this, offset));
+	}
+
+	std::atomic<difference_type> ptr;
+};
+
+} /* namespace std */
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+static_assert(sizeof(std::atomic<self_relative_ptr<char>>) ==
+		      sizeof(self_relative_ptr<char>),
+	      "std::atomic<self_relative_ptr> must have the same size as "
+	      "self_relative_ptr");
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_ATOMIC_SELF_RELATIVE_PTR_HPP */
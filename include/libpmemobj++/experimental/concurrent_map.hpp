@@ -69,6 +69,8 @@ public:
 	using reverse_iterator = typename base_type::reverse_iterator;
 	using const_reverse_iterator =
 		typename base_type::const_reverse_iterator;
+	using range_type = typename base_type::range_type;
+	using const_range_type = typename base_type::const_range_type;
 
 	/**
 	 * Default constructor.
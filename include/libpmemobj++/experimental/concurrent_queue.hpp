@@ -0,0 +1,806 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Persistent memory aware implementation of a concurrent, multi-producer,
+ * multi-consumer FIFO queue.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_CONCURRENT_QUEUE_HPP
+#define LIBPMEMOBJ_CPP_CONCURRENT_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/experimental/atomic_self_relative_ptr.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/mutex.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Persistent memory aware, unbounded, multi-producer, multi-consumer FIFO
+ * queue.
+ *
+ * The elements are stored in slots of fixed-size segments, which are linked
+ * into a list. Every push and pop takes a ticket (position in the queue)
+ * with a single atomic operation on a shared counter, so producers and
+ * consumers do not take locks and do not run transactions, except when a
+ * new segment has to be allocated or a fully consumed one freed, which
+ * happens once per segment.
+ *
+ * Each slot has a state (empty, ready, consumed). A producer copies the
+ * element to the slot, flushes it and only then marks the slot as ready,
+ * so a consumer never observes a partially written element. push_range()
+ * and try_pop_many() flush all the slots of a batch and wait for the
+ * flushes once (two drains for a push, one for a pop), instead of once per
+ * element.
+ *
+ * try_pop() and try_pop_many() never wait: if the element at the front of
+ * the queue is still being written, they return as if the queue was empty.
+ *
+ * Each time the pool with concurrent_queue is opened, runtime_initialize()
+ * must be called. Recovery does not depend on the size of the queue: only
+ * the slot states of the last segment are read to find the end of the
+ * queue. Slots which were consumed before a crash are skipped, and slots
+ * which were never written because of a crash (holes) are skipped when a
+ * consumer reaches them. An element whose pop was in progress during the
+ * crash is returned again, so the elements are delivered at least once.
+ *
+ * T must be trivially copyable. The queue can be used only outside of
+ * transactions.
+ */
+template <typename T>
+class concurrent_queue {
+	static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+		      "T must be trivially copyable");
+
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = value_type &;
+	using const_reference = const value_type &;
+
+	/**
+	 * Constructs an empty queue.
+	 *
+	 * @pre must be called in transaction scope.
+	 *
+	 * @throw pmem::transaction_scope_error if constructor wasn't called in
+	 * transaction.
+	 * @throw pmem::transaction_alloc_error when allocating memory for
+	 * the first segment failed.
+	 */
+	concurrent_queue()
+	{
+		check_tx_stage_work();
+
+		auto seg = make_persistent<segment>(uint64_t(0));
+		first_seg.store(seg.get());
+		head_seg.store(seg.get());
+		tail_seg.store(seg.get());
+		run = 0;
+
+		init_volatile_data(0, 0);
+	}
+
+	concurrent_queue(const concurrent_queue &) = delete;
+	concurrent_queue &operator=(const concurrent_queue &) = delete;
+
+	/**
+	 * Destructor.
+	 * free_data should be called before concurrent_queue destructor is
+	 * called. Otherwise, program can terminate if an exception occurs
+	 * while freeing memory inside dtor.
+	 */
+	~concurrent_queue()
+	{
+		try {
+			free_data();
+		} catch (...) {
+			std::terminate();
+		}
+	}
+
+	/**
+	 * Intialize concurrent_queue after process restart.
+	 * MUST be called everytime after process restart.
+	 * Not thread safe.
+	 *
+	 * Frees the segments which were consumed before the crash and finds
+	 * the end of the queue, reading only the last segment.
+	 *
+	 * @throw pmem::transaction_error when freeing the segments failed.
+	 */
+	void
+	runtime_initialize()
+	{
+		check_outside_tx();
+
+		if (first_seg.load() == nullptr)
+			return;
+
+		pool_base pop = get_pool_base();
+
+		/* invalidates the counters of finished slots of all segments */
+		run = run + 1;
+		pop.persist(run);
+
+		transaction::run(pop, [&] {
+			free_segments(first_seg.load().get(),
+				      head_seg.load().get());
+		});
+
+		segment *tail = tail_seg.load().get();
+		uint64_t end = tail->first;
+		for (size_type i = segment_capacity; i > 0; --i) {
+			if (tail->slots[i - 1].state.load() != slot_empty) {
+				end = tail->first + i;
+				break;
+			}
+		}
+
+		init_volatile_data(head_seg.load().get()->first, end);
+	}
+
+	/**
+	 * Pushes the element to the end of the queue and flushes it.
+	 * Thread safe.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 * @throw pmem::transaction_alloc_error when allocating a new segment
+	 * failed.
+	 */
+	void
+	push(const value_type &value)
+	{
+		push_range(&value, &value + 1);
+	}
+
+	/**
+	 * Pushes the elements from range [first, last) to the end of the
+	 * queue. The elements are placed in consecutive positions and are
+	 * flushed together. Thread safe.
+	 *
+	 * ForwardIt must meet the requirements of LegacyForwardIterator.
+	 *
+	 * If an exception is thrown while the elements are copied, the
+	 * elements copied so far are pushed and the remaining positions are
+	 * skipped.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 * @throw pmem::transaction_alloc_error when allocating a new segment
+	 * failed.
+	 * @throw rethrows iterator exception.
+	 */
+	template <typename ForwardIt>
+	void
+	push_range(ForwardIt first, ForwardIt last)
+	{
+		check_outside_tx();
+
+		auto n = static_cast<size_type>(std::distance(first, last));
+		if (n == 0)
+			return;
+
+		pool_base pop = get_pool_base();
+		bool allocated = false;
+
+		{
+			epoch_guard guard(*this);
+
+			/*
+			 * The tickets are taken only when their segments
+			 * exist, so that a failed allocation does not leave a
+			 * gap in the queue.
+			 */
+			uint64_t ticket = tail.load();
+			do {
+				allocated |=
+					ensure_segments(pop, ticket + n - 1);
+			} while (!tail.compare_exchange_weak(ticket,
+							     ticket + n));
+
+			segment *seg = find_segment(ticket);
+
+			size_type copied = 0;
+			try {
+				segment *s = seg;
+				for (; first != last; ++first, ++copied) {
+					slot &sl = get_slot(s, ticket + copied);
+					new (&sl.value) value_type(*first);
+					pop.flush(&sl.value, sizeof(sl.value));
+				}
+			} catch (...) {
+				publish(pop, seg, ticket, n, copied);
+				throw;
+			}
+
+			publish(pop, seg, ticket, n, copied);
+		}
+
+		if (allocated)
+			try_collect(pop);
+	}
+
+	/**
+	 * Pops the element from the front of the queue. Thread safe.
+	 *
+	 * @param[out] result the popped element.
+	 *
+	 * @return true if an element was popped, false if the queue is empty
+	 * or the element at the front is still being pushed.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 */
+	bool
+	try_pop(value_type &result)
+	{
+		return try_pop_many(&result, 1) == 1;
+	}
+
+	/**
+	 * Pops up to n elements from the front of the queue and writes them
+	 * to out. The consumed slots are flushed together. Thread safe.
+	 *
+	 * OutputIt must meet the requirements of LegacyOutputIterator and
+	 * its operations must not throw.
+	 *
+	 * @return number of popped elements. Zero if the queue is empty or
+	 * the element at the front is still being pushed.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 */
+	template <typename OutputIt>
+	size_type
+	try_pop_many(OutputIt out, size_type n)
+	{
+		check_outside_tx();
+
+		pool_base pop = get_pool_base();
+		size_type popped = 0;
+		bool segment_finished = false;
+
+		{
+			epoch_guard guard(*this);
+
+			/* retry if only skipped slots were claimed */
+			while (popped == 0) {
+				uint64_t h = head.load();
+				segment *seg = find_segment(h);
+				if (seg == nullptr)
+					break;
+
+				size_type k = claimable(seg, h, n);
+				if (k == 0)
+					break;
+
+				if (!head.compare_exchange_strong(h, h + k))
+					continue;
+
+				popped += consume(pop, seg, h, k, out,
+						  segment_finished);
+			}
+		}
+
+		/*
+		 * Removed segments are freed in a later epoch, so try again
+		 * when the queue is found empty, not to keep them until the
+		 * next segment is consumed.
+		 */
+		if (segment_finished ||
+		    (popped == 0 && first_seg.load() != head_seg.load()))
+			try_collect(pop);
+
+		return popped;
+	}
+
+	/**
+	 * Checks if the queue is empty. The result can be outdated if the
+	 * queue is modified concurrently.
+	 */
+	bool
+	empty() const noexcept
+	{
+		return size() == 0;
+	}
+
+	/**
+	 * Returns the number of positions taken by pushes and not popped
+	 * yet. Elements which are still being pushed, and after a restart
+	 * also skipped positions, are included. The result can be outdated
+	 * if the queue is modified concurrently.
+	 */
+	size_type
+	size() const noexcept
+	{
+		uint64_t h = head.load();
+		uint64_t t = tail.load();
+
+		return t > h ? static_cast<size_type>(t - h) : 0;
+	}
+
+	/**
+	 * Frees all the segments. Not thread safe.
+	 *
+	 * The queue can NOT be used after free_data() was called
+	 * (unless it was called in a transaction and that transaction
+	 * aborted).
+	 *
+	 * @throw pmem::transaction_error when freeing the segments failed.
+	 */
+	void
+	free_data()
+	{
+		if (first_seg.load() == nullptr)
+			return;
+
+		pool_base pop = get_pool_base();
+		transaction::run(pop, [&] {
+			free_segments(first_seg.load().get(), nullptr);
+
+			detail::conditional_add_to_tx(&head_seg);
+			head_seg.store(nullptr);
+			detail::conditional_add_to_tx(&tail_seg);
+			tail_seg.store(nullptr);
+		});
+	}
+
+private:
+	enum : uint64_t {
+		slot_empty = 0,
+		slot_ready = 1,
+		slot_consumed = 2,
+	};
+
+	struct slot {
+		std::atomic<uint64_t> state;
+		typename std::aligned_storage<sizeof(value_type),
+					      alignof(value_type)>::type value;
+	};
+
+	/* number of slots in a segment, which takes about 16 KB */
+	static constexpr size_type segment_capacity =
+		16384 / sizeof(slot) > 64 ? 16384 / sizeof(slot) : 64;
+
+	struct segment {
+		segment(uint64_t first) : first(first), finished(0), retired(0)
+		{
+			for (auto &sl : slots)
+				sl.state.store(slot_empty,
+					       std::memory_order_relaxed);
+		}
+
+		std::atomic<self_relative_ptr<segment>> next;
+
+		/* ticket of the first slot */
+		p<uint64_t> first;
+
+		/*
+		 * Number of slots popped or skipped in the current run (lower
+		 * 32 bits) and the run (higher 32 bits). The counter of the
+		 * previous run is not valid, so it does not have to be reset
+		 * on restart.
+		 */
+		std::atomic<uint64_t> finished;
+
+		/* epoch in which the segment was removed from the queue */
+		std::atomic<uint64_t> retired;
+
+		slot slots[segment_capacity];
+	};
+
+	/*
+	 * Guards the segments against being freed while they are accessed,
+	 * for the duration of a single operation (epoch-based reclamation).
+	 */
+	class epoch_guard {
+	public:
+		epoch_guard(concurrent_queue &owner) : owner(owner)
+		{
+			while (true) {
+				e = owner.epoch.load();
+				owner.active[e & 1].fetch_add(1);
+
+				if (owner.epoch.load() == e)
+					break;
+
+				owner.active[e & 1].fetch_sub(1);
+			}
+		}
+
+		~epoch_guard()
+		{
+			owner.active[e & 1].fetch_sub(1);
+		}
+
+		epoch_guard(const epoch_guard &) = delete;
+		epoch_guard &operator=(const epoch_guard &) = delete;
+
+	private:
+		concurrent_queue &owner;
+		uint64_t e;
+	};
+
+	void
+	init_volatile_data(uint64_t head_ticket, uint64_t tail_ticket) noexcept
+	{
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&head, sizeof(head));
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&tail, sizeof(tail));
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&recovered_tail,
+						 sizeof(recovered_tail));
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&epoch, sizeof(epoch));
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&active, sizeof(active));
+#endif
+		head.store(head_ticket);
+		tail.store(tail_ticket);
+		recovered_tail.store(tail_ticket);
+		epoch.store(0);
+		active[0].store(0);
+		active[1].store(0);
+	}
+
+	obj::pool_base
+	get_pool_base() const
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		return obj::pool_base(pop);
+	}
+
+	void
+	check_tx_stage_work() const
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw pmem::transaction_scope_error(
+				"Function called out of transaction scope.");
+	}
+
+	static void
+	check_outside_tx()
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw pmem::transaction_scope_error(
+				"Function called inside transaction scope.");
+	}
+
+	/*
+	 * Returns the segment with the given ticket or nullptr if it was not
+	 * allocated yet or it was already removed from the queue. Must be
+	 * called under epoch_guard.
+	 */
+	segment *
+	find_segment(uint64_t ticket) const noexcept
+	{
+		segment *seg = tail_seg.load().get();
+		if (ticket < seg->first)
+			seg = head_seg.load().get();
+		if (ticket < seg->first)
+			return nullptr;
+
+		while (seg != nullptr &&
+		       ticket >= seg->first + segment_capacity)
+			seg = seg->next.load().get();
+
+		return seg;
+	}
+
+	/*
+	 * Returns the slot with the given ticket, moving seg to the next
+	 * segment if needed. The tickets must be accessed in order.
+	 */
+	static slot &
+	get_slot(segment *&seg, uint64_t ticket) noexcept
+	{
+		if (ticket >= seg->first + segment_capacity)
+			seg = seg->next.load().get();
+
+		return seg->slots[ticket - seg->first];
+	}
+
+	/*
+	 * Allocates the segments needed for tickets up to last. Returns true
+	 * if a segment was allocated. Must be called under epoch_guard.
+	 */
+	bool
+	ensure_segments(pool_base &pop, uint64_t last)
+	{
+		segment *seg = tail_seg.load().get();
+
+		if (last >= seg->first + segment_capacity) {
+			std::unique_lock<obj::mutex> lock(seg_mutex);
+
+			seg = tail_seg.load().get();
+			if (last >= seg->first + segment_capacity) {
+				transaction::run(pop, [&] {
+					append_segments(seg, last);
+				});
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/* Must be called in a transaction, under seg_mutex. */
+	void
+	append_segments(segment *seg, uint64_t last)
+	{
+		while (last >= seg->first + segment_capacity) {
+			auto next = make_persistent<segment>(seg->first +
+							     segment_capacity);
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+			VALGRIND_PMC_REMOVE_PMEM_MAPPING(
+				&next->finished, sizeof(next->finished));
+			VALGRIND_PMC_REMOVE_PMEM_MAPPING(&next->retired,
+							 sizeof(next->retired));
+#endif
+			detail::conditional_add_to_tx(&seg->next);
+			seg->next.store(next.get());
+			seg = next.get();
+		}
+
+		detail::conditional_add_to_tx(&tail_seg);
+		tail_seg.store(seg);
+	}
+
+	/*
+	 * Marks the first copied slots starting from ticket as ready and the
+	 * remaining ones (if the copy failed) as consumed.
+	 */
+	void
+	publish(pool_base &pop, segment *seg, uint64_t ticket, size_type n,
+		size_type copied) noexcept
+	{
+		/* the elements must be durable before they are published */
+		pop.drain();
+
+		for (size_type i = 0; i < n; ++i) {
+			slot &sl = get_slot(seg, ticket + i);
+			sl.state.store(i < copied ? slot_ready : slot_consumed,
+				       std::memory_order_release);
+			pop.flush(&sl.state, sizeof(sl.state));
+		}
+
+		pop.drain();
+	}
+
+	/*
+	 * Returns the number of slots (up to n) starting from ticket which
+	 * can be claimed by a consumer: ready ones, and the ones which are
+	 * skipped (consumed before a crash, or never written because of a
+	 * crash).
+	 */
+	size_type
+	claimable(segment *seg, uint64_t ticket, size_type n) const noexcept
+	{
+		uint64_t hole_end = recovered_tail.load();
+		size_type k = 0;
+
+		for (; k < n; ++k, ++ticket) {
+			if (ticket >= seg->first + segment_capacity) {
+				seg = seg->next.load().get();
+				if (seg == nullptr)
+					break;
+			}
+
+			slot &sl = seg->slots[ticket - seg->first];
+			uint64_t state =
+				sl.state.load(std::memory_order_acquire);
+			if (state == slot_empty && ticket >= hole_end)
+				break;
+		}
+
+		return k;
+	}
+
+	/*
+	 * Moves the elements out of k claimed slots starting from ticket and
+	 * marks the slots as consumed. Returns the number of elements.
+	 */
+	template <typename OutputIt>
+	size_type
+	consume(pool_base &pop, segment *seg, uint64_t ticket, size_type k,
+		OutputIt &out, bool &segment_finished) noexcept
+	{
+		size_type popped = 0;
+		uint64_t finished = 0;
+
+		for (size_type i = 0; i < k; ++i, ++ticket) {
+			if (ticket >= seg->first + segment_capacity) {
+				segment_finished |= add_finished(seg, finished);
+				finished = 0;
+				seg = seg->next.load().get();
+			}
+
+			slot &sl = seg->slots[ticket - seg->first];
+			if (sl.state.load(std::memory_order_acquire) ==
+			    slot_ready) {
+				*out = *reinterpret_cast<value_type *>(
+					&sl.value);
+				++out;
+				++popped;
+			}
+
+			sl.state.store(slot_consumed,
+				       std::memory_order_relaxed);
+			pop.flush(&sl.state, sizeof(sl.state));
+			++finished;
+		}
+
+		pop.drain();
+		segment_finished |= add_finished(seg, finished);
+
+		return popped;
+	}
+
+	/*
+	 * Adds n to the counter of finished slots of the segment. Returns
+	 * true if all the slots of the segment are finished.
+	 */
+	bool
+	add_finished(segment *seg, uint64_t n) noexcept
+	{
+		uint64_t r = static_cast<uint64_t>(run.get_ro()) << 32;
+		uint64_t v = seg->finished.load();
+
+		while (true) {
+			uint64_t count = (v & ~finished_mask) == r
+				? (v & finished_mask)
+				: 0;
+			uint64_t desired = r | (count + n);
+			if (seg->finished.compare_exchange_weak(v, desired))
+				return count + n == segment_capacity;
+		}
+	}
+
+	bool
+	is_finished(const segment *seg) const noexcept
+	{
+		uint64_t r = static_cast<uint64_t>(run.get_ro()) << 32;
+
+		return seg->finished.load() == (r | segment_capacity);
+	}
+
+	/*
+	 * Called after the elements were popped, so a failure is not
+	 * reported. Freeing is retried by the next collect().
+	 */
+	void
+	try_collect(pool_base &pop) noexcept
+	{
+		try {
+			std::unique_lock<obj::mutex> lock(seg_mutex,
+							  std::try_to_lock);
+
+			if (lock.owns_lock())
+				collect(pop);
+		} catch (...) {
+		}
+	}
+
+	/*
+	 * Removes finished segments from the front of the queue and frees
+	 * the ones which cannot be accessed anymore. Must be called under
+	 * seg_mutex.
+	 */
+	void
+	collect(pool_base &pop)
+	{
+		/*
+		 * The epoch can be advanced once all operations which started
+		 * in the previous one are done. A segment removed in epoch e
+		 * can be freed in epoch e + 2.
+		 */
+		uint64_t e = epoch.load();
+		if (active[(e + 1) & 1].load() == 0)
+			epoch.store(++e);
+
+		segment *first = first_seg.load().get();
+		segment *h = head_seg.load().get();
+
+		segment *new_head = h;
+		while (is_finished(new_head) &&
+		       new_head->next.load() != nullptr) {
+			new_head->retired.store(e);
+			new_head = new_head->next.load().get();
+		}
+
+		segment *new_first = first;
+		while (new_first != new_head &&
+		       new_first->retired.load() + 2 <= e)
+			new_first = new_first->next.load().get();
+
+		if (new_head == h && new_first == first)
+			return;
+
+		transaction::run(pop, [&] {
+			if (new_head != h) {
+				detail::conditional_add_to_tx(&head_seg);
+				head_seg.store(new_head);
+			}
+
+			free_segments(first, new_first);
+		});
+	}
+
+	/*
+	 * Frees the segments from first up to (excluding) last and makes last
+	 * the first segment. Must be called in a transaction.
+	 */
+	void
+	free_segments(segment *first, segment *last)
+	{
+		if (first == last)
+			return;
+
+		while (first != last) {
+			segment *next = first->next.load().get();
+			delete_persistent<segment>(
+				persistent_ptr<segment>(first));
+			first = next;
+		}
+
+		detail::conditional_add_to_tx(&first_seg);
+		first_seg.store(last);
+	}
+
+	static constexpr uint64_t finished_mask = 0xffffffffULL;
+
+	/* the oldest segment which was not freed yet */
+	std::atomic<self_relative_ptr<segment>> first_seg;
+
+	/* the segment with the front of the queue */
+	std::atomic<self_relative_ptr<segment>> head_seg;
+
+	/* the last segment */
+	std::atomic<self_relative_ptr<segment>> tail_seg;
+
+	/* protects allocating and freeing segments */
+	obj::mutex seg_mutex;
+
+	/* incremented on every restart */
+	p<uint32_t> run;
+
+	/*
+	 * Volatile data, reset in runtime_initialize().
+	 */
+
+	/* ticket of the front of the queue */
+	std::atomic<uint64_t> head;
+
+	/* ticket of the next push */
+	std::atomic<uint64_t> tail;
+
+	/* empty slots below this ticket were not written because of a crash */
+	std::atomic<uint64_t> recovered_tail;
+
+	std::atomic<uint64_t> epoch;
+	std::atomic<uint64_t> active[2];
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_CONCURRENT_QUEUE_HPP */
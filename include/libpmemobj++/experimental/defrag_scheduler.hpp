@@ -0,0 +1,519 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Incremental defragmentation scheduler.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_DEFRAG_SCHEDULER_HPP
+#define LIBPMEMOBJ_CPP_DEFRAG_SCHEDULER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <libpmemobj++/defrag.hpp>
+#include <libpmemobj++/detail/template_helpers.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr_base.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj/base.h>
+
+namespace pmem
+{
+
+namespace detail
+{
+template <typename T>
+using t_has_defragment = decltype(std::declval<T>().defragment(
+	std::declval<double>(), std::declval<double>()));
+
+template <typename T>
+using t_is_range_defragmentable = supports<T, t_has_defragment>;
+}
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent progress of the defrag_scheduler.
+ *
+ * It has to be placed in the same pool as the containers which are
+ * defragmented. It allows a scheduler created after the pool is reopened
+ * to continue from the place where the previous one stopped, as long as
+ * the containers are added to it in the same order.
+ */
+struct defrag_progress {
+	/* index of the currently processed container */
+	p<uint64_t> source = 0;
+	/* position within the currently processed container */
+	p<uint64_t> position = 0;
+	/* number of completed passes over all containers */
+	p<uint64_t> passes = 0;
+	/* total number of relocated objects */
+	p<uint64_t> relocated = 0;
+};
+
+/**
+ * Incremental defragmentation scheduler.
+ *
+ * Contrary to pmem::obj::defrag, which relocates all collected objects in
+ * a single call, this class splits the defragmentation of the added
+ * containers into small steps and runs them in time-bounded slices. The
+ * number of objects processed in a step is adjusted after each step, so
+ * that a slice takes approximately the configured time. Between slices
+ * other threads can access the containers, and the position reached is
+ * stored in the persistent defrag_progress.
+ *
+ * Containers implementing 'defragment(start_percent, amount_percent)'
+ * (like concurrent_hash_map) are processed in small ranges of buckets,
+ * which are locked only for the duration of a step. Such containers can
+ * be defragmented while being used. All other containers implementing
+ * 'for_each_ptr' (vector, string, segment_vector, concurrent_map) are
+ * processed in ranges of their internal pointers. The pointers are
+ * collected once, when a pass over the container begins, and the
+ * following steps continue from the saved position. Such containers may
+ * be accessed only while holding the lock returned by lock(), which also
+ * makes the scheduler collect the pointers again.
+ *
+ * Slices can be run manually with run_slice() or by a background thread
+ * started with start(). The background thread begins a new pass only if
+ * the pool fragmentation is not lower than the configured threshold.
+ *
+ * Important note: an instance of this class can work only on containers
+ * from one pmem::obj::pool instance.
+ */
+class defrag_scheduler {
+public:
+	/**
+	 * Number of steps, in which a container implementing 'defragment'
+	 * method is processed. It's a power of 2 multiple of 100, so that
+	 * the range of each step is exactly representable in percents.
+	 */
+	static constexpr uint64_t range_steps = 100 * 64;
+
+	/**
+	 * Binds the scheduler with the selected pool and progress object.
+	 *
+	 * @param[in] p a pool, which scheduler will be working with/on.
+	 * @param[in] progress persistent progress, stored in the pool.
+	 *
+	 * @throw std::runtime_error when progress is not from the pool.
+	 */
+	defrag_scheduler(pool_base p, defrag_progress &progress)
+	    : pop(p), progress(progress)
+	{
+		if (pmemobj_pool_by_ptr(&progress) != pop.handle())
+			throw std::runtime_error(
+				"progress is not from the chosen pool");
+	}
+
+	defrag_scheduler(const defrag_scheduler &) = delete;
+	defrag_scheduler &operator=(const defrag_scheduler &) = delete;
+
+	/**
+	 * Stops the background thread, if it is running. Exception thrown
+	 * by the background thread, if any, is ignored.
+	 */
+	~defrag_scheduler()
+	{
+		try {
+			stop();
+		} catch (...) {
+		}
+	}
+
+	/**
+	 * Adds a container, which implements 'defragment(start_percent,
+	 * amount_percent)' method, to the scheduler.
+	 *
+	 * Must not be called while the background thread is running.
+	 *
+	 * @throw std::runtime_error when object t is not from the pool
+	 *	passed in ctor.
+	 */
+	template <typename T>
+	typename std::enable_if<
+		detail::t_is_range_defragmentable<T>::value>::type
+	add(T &t)
+	{
+		check_pool(&t);
+
+		sources.emplace_back([&t](uint64_t pos, uint64_t n,
+					  pobj_defrag_result &result,
+					  clock::time_point &) {
+			if (pos >= range_steps)
+				return true;
+
+			n = (std::min)(n, range_steps - pos);
+
+			double start = static_cast<double>(pos) * 100 /
+				static_cast<double>(range_steps);
+			double amount = static_cast<double>(n) * 100 /
+				static_cast<double>(range_steps);
+
+			auto r = t.defragment(start, amount);
+			result.total += r.total;
+			result.relocated += r.relocated;
+
+			return pos + n >= range_steps;
+		});
+		batches.push_back(1);
+	}
+
+	/**
+	 * Adds a container, which implements 'for_each_ptr' method,
+	 * to the scheduler. The container may be accessed only while
+	 * holding the lock returned by lock().
+	 *
+	 * Must not be called while the background thread is running.
+	 *
+	 * @throw std::runtime_error when object t is not from the pool
+	 *	passed in ctor.
+	 */
+	template <typename T>
+	typename std::enable_if<
+		is_defragmentable<T>() &&
+		!detail::t_is_range_defragmentable<T>::value>::type
+	add(T &t)
+	{
+		check_pool(&t);
+
+		auto snapshot = std::make_shared<ptr_snapshot>();
+		auto step = [this, &t, snapshot](uint64_t pos, uint64_t n,
+						 pobj_defrag_result &result,
+						 clock::time_point &start) {
+			std::unique_lock<std::mutex> lock(access_mutex);
+
+			auto &ptrs = snapshot->ptrs;
+
+			/* The pointers are collected when a pass over the
+			 * container begins, or if the container might have
+			 * been modified since they were collected. The walk
+			 * visits contained pointers before the pointers to
+			 * their holders, so relocations done by the previous
+			 * steps do not move the remaining pointers. */
+			if (pos == 0 || !snapshot->valid ||
+			    snapshot->epoch != access_epoch) {
+				ptrs.clear();
+				t.for_each_ptr([&](persistent_ptr_base &ptr) {
+					ptrs.push_back(&ptr);
+				});
+				snapshot->epoch = access_epoch;
+				snapshot->valid = true;
+			}
+
+			/* waiting for the lock and the walk do not depend on
+			 * n, so they must not shrink the batch */
+			start = clock::now();
+
+			auto size = static_cast<uint64_t>(ptrs.size());
+
+			if (pos < size) {
+				n = (std::min)(n, size - pos);
+
+				auto r = pop.defrag(ptrs.data() + pos,
+						    static_cast<size_t>(n));
+				result.total += r.total;
+				result.relocated += r.relocated;
+			}
+
+			if (pos + n < size)
+				return false;
+
+			snapshot->valid = false;
+			std::vector<persistent_ptr_base *>().swap(ptrs);
+
+			return true;
+		};
+
+		sources.emplace_back(step);
+		batches.push_back(1);
+	}
+
+	/**
+	 * Returns a lock, which has to be held while any container added
+	 * with the 'for_each_ptr' overload of add() is accessed, both when
+	 * slices are run by the background thread and by run_slice(). Steps
+	 * processing such containers wait for the lock to be released, and
+	 * the pointers of the containers are collected again afterwards.
+	 *
+	 * Containers implementing 'defragment' method do not need the lock.
+	 *
+	 * Other methods of the scheduler must not be called while the lock
+	 * is held.
+	 */
+	std::unique_lock<std::mutex>
+	lock()
+	{
+		std::unique_lock<std::mutex> lock(access_mutex);
+		++access_epoch;
+
+		return lock;
+	}
+
+	/**
+	 * Sets the time after which a slice stops starting new steps.
+	 * A single step is never interrupted.
+	 */
+	void
+	set_slice(std::chrono::microseconds slice)
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+		slice_time = slice;
+	}
+
+	/**
+	 * Sets the minimal fragmentation (see fragmentation()) at which the
+	 * background thread begins a new pass. Value 0 means that passes are
+	 * run unconditionally.
+	 */
+	void
+	set_threshold(double threshold)
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+		fragmentation_threshold = threshold;
+	}
+
+	/**
+	 * Returns fragmentation of the pool heap, see
+	 * heap_stats::fragmentation().
+	 *
+	 * @throw pmem::ctl_error when the statistics cannot be read.
+	 */
+	double
+	fragmentation()
+	{
+		return pop.stats().fragmentation();
+	}
+
+	/**
+	 * Runs steps of the defragmentation until the slice time elapses or
+	 * the current pass is completed. The progress is persisted after each
+	 * step.
+	 *
+	 * @return result struct containing a number of relocated and total
+	 *	processed objects in this slice.
+	 *
+	 * @throw rethrows pmem::defrag_error when a failure during
+	 *	defragmentation occurs.
+	 * @throw std::range_error if the position of a container implementing
+	 *	'defragment' method is incorrect.
+	 */
+	pobj_defrag_result
+	run_slice()
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+
+		return slice();
+	}
+
+	/**
+	 * Starts a background thread, which runs slices separated by the
+	 * given interval. A new pass is begun only if fragmentation() is not
+	 * lower than the threshold, otherwise the thread waits for the next
+	 * interval.
+	 *
+	 * @throw std::runtime_error when the thread is already running.
+	 */
+	void
+	start(std::chrono::milliseconds interval)
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+
+		if (worker.joinable())
+			throw std::runtime_error(
+				"defrag_scheduler is already running");
+
+		stopped = false;
+		error = nullptr;
+		worker = std::thread(
+			[this, interval] { background(interval); });
+	}
+
+	/**
+	 * Stops the background thread and waits for the current slice to
+	 * finish.
+	 *
+	 * @throw rethrows exception which stopped the background thread.
+	 */
+	void
+	stop()
+	{
+		{
+			std::unique_lock<std::mutex> lock(run_mutex);
+			stopped = true;
+		}
+		stop_cv.notify_all();
+
+		if (worker.joinable())
+			worker.join();
+
+		if (error) {
+			auto e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	/**
+	 * @return true if the background thread is running.
+	 */
+	bool
+	running() const
+	{
+		return worker.joinable();
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	/* Processes n units starting from pos; returns true if the container
+	 * is completed. A step may move start forward to exclude its setup
+	 * from the time used to adjust the number of units. */
+	using step_function = std::function<bool(
+		uint64_t pos, uint64_t n, pobj_defrag_result &result,
+		clock::time_point &start)>;
+
+	/* Pointers of a container implementing 'for_each_ptr', valid for
+	 * the access_epoch in which they were collected */
+	struct ptr_snapshot {
+		std::vector<persistent_ptr_base *> ptrs;
+		uint64_t epoch = 0;
+		bool valid = false;
+	};
+
+	void
+	check_pool(const void *ptr)
+	{
+		if (pmemobj_pool_by_ptr(ptr) != pop.handle())
+			throw std::runtime_error(
+				"object is not from the chosen pool");
+	}
+
+	/* Must be called with run_mutex held */
+	pobj_defrag_result
+	slice()
+	{
+		pobj_defrag_result result;
+		result.total = 0;
+		result.relocated = 0;
+
+		if (sources.empty())
+			return result;
+
+		/* Containers might have been added in a different order */
+		if (progress.source >= sources.size())
+			store_progress(0, 0);
+
+		auto deadline = clock::now() + slice_time;
+		do {
+			uint64_t src = progress.source;
+			uint64_t pos = progress.position;
+			uint64_t n = batches[src];
+
+			auto step_start = clock::now();
+			bool done = sources[src](pos, n, result, step_start);
+			auto step_time = clock::now() - step_start;
+
+			/* Keep a single step within 1/8 - 1/4 of the slice */
+			if (step_time * 8 < slice_time)
+				batches[src] = n * 2;
+			else if (step_time * 4 > slice_time && n > 1)
+				batches[src] = n / 2;
+
+			if (!done) {
+				store_progress(src, pos + n);
+			} else if (src + 1 < sources.size()) {
+				store_progress(src + 1, 0);
+			} else {
+				/* this is to trigger global recycling */
+				pop.defrag(nullptr, 0);
+
+				progress.passes = progress.passes + 1;
+				pop.persist(progress.passes);
+				store_progress(0, 0);
+				break;
+			}
+		} while (clock::now() < deadline);
+
+		progress.relocated = progress.relocated + result.relocated;
+		pop.persist(progress.relocated);
+
+		return result;
+	}
+
+	void
+	store_progress(uint64_t src, uint64_t pos)
+	{
+		progress.source = src;
+		progress.position = pos;
+		pop.persist(&progress.source, 2 * sizeof(progress.source));
+	}
+
+	void
+	background(std::chrono::milliseconds interval)
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+
+		try {
+			while (!stopped) {
+				bool pass_started = progress.source != 0 ||
+					progress.position != 0;
+
+				if (pass_started ||
+				    fragmentation() >= fragmentation_threshold)
+					slice();
+
+				stop_cv.wait_for(lock, interval,
+						 [this] { return stopped; });
+			}
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+
+	pool_base pop;
+	defrag_progress &progress;
+
+	std::vector<step_function> sources;
+	/* number of units processed in a single step, per container */
+	std::vector<uint64_t> batches;
+
+	std::chrono::microseconds slice_time = std::chrono::microseconds(1000);
+	double fragmentation_threshold = 0;
+
+	std::mutex run_mutex;
+	std::condition_variable stop_cv;
+	bool stopped = true;
+	std::exception_ptr error;
+	std::thread worker;
+
+	/* held by steps processing containers implementing only
+	 * 'for_each_ptr' and by users of lock() */
+	std::mutex access_mutex;
+	/* incremented by each lock() */
+	uint64_t access_epoch = 0;
+};
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_DEFRAG_SCHEDULER_HPP */
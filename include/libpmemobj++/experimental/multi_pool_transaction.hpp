@@ -0,0 +1,543 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Atomic updates of data residing in several pools.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_MULTI_POOL_TRANSACTION_HPP
+#define LIBPMEMOBJ_CPP_MULTI_POOL_TRANSACTION_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/write_set.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj/base.h>
+#include <libpmemobj/tx_base.h>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Intent log of a multi_pool_coordinator.
+ *
+ * One instance has to be placed in every pool coordinated by a
+ * multi_pool_coordinator (e.g. in the root object). It is empty, except
+ * during a commit of a transaction modifying several pools or when such a
+ * commit was interrupted.
+ */
+struct multi_pool_log {
+	/* idle, prepared or committed */
+	p<uint64_t> state = 0;
+	/* identifier of the logged transaction */
+	p<uint64_t> txid = 0;
+	/* last identifier used, meaningful only in the coordinator's log */
+	p<uint64_t> last_txid = 0;
+	/* number of logged words */
+	p<uint64_t> count = 0;
+	/* triples of (offset from the pool base, written bytes of the word,
+	 * mask of the written bytes) */
+	persistent_ptr<uint64_t[]> entries;
+};
+
+class multi_pool_coordinator;
+
+/**
+ * Write set of a transaction spanning several pools.
+ *
+ * Writes are buffered per pool and applied when the closure passed to
+ * multi_pool_coordinator::run() returns. Reads through the transaction
+ * observe the buffered values. Only trivially copyable objects and raw
+ * ranges can be modified, the data must not be modified in place.
+ */
+class multi_pool_transaction {
+public:
+	multi_pool_transaction(const multi_pool_transaction &) = delete;
+	multi_pool_transaction &
+	operator=(const multi_pool_transaction &) = delete;
+
+	/**
+	 * Buffers a write of value to dst.
+	 *
+	 * @throw std::runtime_error if dst is not from any of the
+	 *	coordinated pools.
+	 */
+	template <typename T>
+	void
+	write(T &dst, const T &value)
+	{
+		static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "T must be trivially copyable");
+
+		write_range(&dst, &value, sizeof(T));
+	}
+
+	/**
+	 * Buffers a write of value to the persistent property dst.
+	 *
+	 * @throw std::runtime_error if dst is not from any of the
+	 *	coordinated pools.
+	 */
+	template <typename T>
+	void
+	write(p<T> &dst, const T &value)
+	{
+		/* get_rw() would snapshot the property */
+		write_range(const_cast<T *>(&dst.get_ro()), &value, sizeof(T));
+	}
+
+	/**
+	 * Buffers a write of size bytes from src to dst.
+	 *
+	 * @throw std::runtime_error if the range is not from one of the
+	 *	coordinated pools.
+	 */
+	void
+	write_range(void *dst, const void *src, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		auto last = static_cast<const char *>(dst) + size - 1;
+		auto pop = pmemobj_pool_by_ptr(dst);
+
+		if (pop == nullptr || pmemobj_pool_by_ptr(last) != pop)
+			throw std::runtime_error(
+				"range is not from the coordinated pools");
+
+		writes[pool_index(pop)].write(dst, src, size);
+	}
+
+	/**
+	 * Reads the value of src, including the buffered writes.
+	 */
+	template <typename T>
+	T
+	read(const T &src) const
+	{
+		static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "T must be trivially copyable");
+
+		T value;
+		read_range(&value, &src, sizeof(T));
+
+		return value;
+	}
+
+	/**
+	 * Reads the value of the persistent property src, including the
+	 * buffered writes.
+	 */
+	template <typename T>
+	T
+	read(const p<T> &src) const
+	{
+		return read(src.get_ro());
+	}
+
+	/**
+	 * Copies size bytes from src to dst, including the buffered writes.
+	 */
+	void
+	read_range(void *dst, const void *src, size_t size) const
+	{
+		auto pop = pmemobj_pool_by_ptr(src);
+
+		for (size_t i = 0; i < pools.size(); ++i) {
+			if (pools[i] == pop) {
+				writes[i].read(dst, src, size);
+				return;
+			}
+		}
+
+		std::memcpy(dst, src, size);
+	}
+
+	/**
+	 * @return the number of modified 8-byte words in all pools.
+	 */
+	size_t
+	size() const noexcept
+	{
+		size_t n = 0;
+		for (auto &w : writes)
+			n += w.size();
+
+		return n;
+	}
+
+private:
+	friend class multi_pool_coordinator;
+
+	explicit multi_pool_transaction(const std::vector<PMEMobjpool *> &pools)
+	    : pools(pools), writes(pools.size())
+	{
+	}
+
+	size_t
+	pool_index(PMEMobjpool *pop) const
+	{
+		for (size_t i = 0; i < pools.size(); ++i) {
+			if (pools[i] == pop)
+				return i;
+		}
+
+		throw std::runtime_error(
+			"range is not from the coordinated pools");
+	}
+
+	const std::vector<PMEMobjpool *> &pools;
+	std::vector<detail::write_set> writes;
+};
+
+/**
+ * Coordinator of transactions modifying data in several pools atomically.
+ *
+ * A transaction which modifies a single pool is applied with a regular
+ * pmem::obj::transaction, without touching the intent logs. A transaction
+ * which modifies several pools is committed with a two-phase protocol:
+ * 1. prepare: the new values of the modified words are stored in the
+ *    intent log of every participating pool (except the coordinator's one)
+ *    and the logs are marked as prepared,
+ * 2. commit point: the coordinator's log (the log in the first pool) is
+ *    marked as committed, together with its own part of the new values,
+ * 3. the logged values are applied in every pool and the logs are
+ *    cleared, the coordinator's log is cleared last.
+ *
+ * The log holds only the written bytes of every modified word, they are
+ * merged with the rest of the word when it is applied, so the updates made
+ * to the rest of the word in the meantime are kept.
+ *
+ * Every step is a pmem::obj::transaction on a single pool. After a crash,
+ * the constructor (or recover()) applies the logged values if the
+ * coordinator's log is committed, and discards the prepared logs
+ * otherwise. It must be called after all the pools are opened and before
+ * the data is accessed. If applying the logged values fails in run(),
+ * they are applied by the next run() before its closure is called.
+ *
+ * The commits of concurrent transactions are serialized, the closures
+ * (and the single-pool transactions) run concurrently. The coordinator
+ * does not take any locks on the data, synchronization with other threads
+ * accessing the same data has to be provided by the caller.
+ */
+class multi_pool_coordinator {
+public:
+	/**
+	 * Binds the coordinator with the intent logs and recovers the
+	 * interrupted transactions.
+	 *
+	 * @param[in] logs intent logs, each in a different pool. The first
+	 *	one is the coordinator's log. The logs have to be passed in the
+	 *	same order every time the pools are opened.
+	 *
+	 * @throw std::runtime_error if any log is not in a pool or two logs
+	 *	are in the same pool.
+	 * @throw transaction_error if the recovery failed.
+	 */
+	explicit multi_pool_coordinator(
+		const std::vector<multi_pool_log *> &logs)
+	    : logs(logs)
+	{
+		if (logs.empty())
+			throw std::runtime_error("no logs given");
+
+		for (auto log : logs) {
+			auto pop = pmemobj_pool_by_ptr(log);
+			if (pop == nullptr)
+				throw std::runtime_error(
+					"log is not in a pool");
+
+			for (auto other : handles) {
+				if (other == pop)
+					throw std::runtime_error(
+						"logs are in the same pool");
+			}
+
+			handles.push_back(pop);
+			pools.emplace_back(pop);
+		}
+
+		recover();
+	}
+
+	multi_pool_coordinator(const multi_pool_coordinator &) = delete;
+	multi_pool_coordinator &
+	operator=(const multi_pool_coordinator &) = delete;
+
+	/**
+	 * Finishes the transaction interrupted by a crash: applies it if it
+	 * reached the commit point, discards it otherwise. Called by the
+	 * constructor.
+	 *
+	 * @throw transaction_error if the recovery failed.
+	 */
+	void
+	recover()
+	{
+		std::lock_guard<std::mutex> lock(commit_mutex);
+
+		finish_pending();
+	}
+
+	/**
+	 * Executes a closure-like transaction spanning the coordinated
+	 * pools. The closure is called with a reference to
+	 * multi_pool_transaction, and its writes are committed atomically
+	 * if it returns normally. If the closure throws, the writes are
+	 * discarded and the exception is rethrown.
+	 *
+	 * @pre must be called outside of a transaction.
+	 *
+	 * @throw transaction_scope_error if called inside a transaction.
+	 * @throw transaction_error if the commit failed, or if a transaction
+	 *	whose commit failed after the commit point still cannot be
+	 *	finished. Such a transaction is finished by the next run() or
+	 *	by recover().
+	 * @throw rethrows exception thrown by the closure.
+	 */
+	template <typename F>
+	void
+	run(F &&f)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw pmem::transaction_scope_error(
+				"multi_pool_coordinator::run called inside a "
+				"transaction");
+
+		finish_if_pending();
+
+		multi_pool_transaction tx(handles);
+
+		f(tx);
+
+		commit(tx);
+	}
+
+private:
+	/* states of multi_pool_log */
+	enum log_state : uint64_t { idle = 0, prepared = 1, committed = 2 };
+
+	/* number of words in a log entry */
+	static constexpr uint64_t entry_size = 3;
+
+	void
+	commit(multi_pool_transaction &tx)
+	{
+		std::vector<size_t> participants;
+		for (size_t i = 0; i < tx.writes.size(); ++i) {
+			if (!tx.writes[i].empty())
+				participants.push_back(i);
+		}
+
+		if (participants.empty())
+			return;
+
+		/* a single pool is modified, no coordination is needed; a
+		 * pending transaction might overwrite the data later, so it is
+		 * finished first */
+		if (participants.size() == 1) {
+			finish_if_pending();
+
+			auto i = participants[0];
+			transaction::run(pools[i], [&] {
+				tx.writes[i].for_each([](uint64_t *addr,
+							 uint64_t value,
+							 uint64_t mask) {
+					transaction::snapshot(addr);
+					*addr = (*addr & ~mask) | value;
+				});
+			});
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(commit_mutex);
+
+		/* the logs are overwritten below */
+		finish_pending();
+
+		auto &coordinator = *logs[0];
+		uint64_t txid = coordinator.last_txid + 1;
+
+		try {
+			for (auto i : participants) {
+				if (i == 0)
+					continue;
+
+				transaction::run(pools[i], [&] {
+					log_writes(i, tx.writes[i]);
+					logs[i]->txid = txid;
+					logs[i]->state = prepared;
+				});
+			}
+
+			/* commit point */
+			transaction::run(pools[0], [&] {
+				log_writes(0, tx.writes[0]);
+				coordinator.txid = txid;
+				coordinator.last_txid = txid;
+				coordinator.state = committed;
+			});
+		} catch (...) {
+			for (auto i : participants) {
+				if (i != 0 && logs[i]->state != idle)
+					discard(i);
+			}
+			throw;
+		}
+
+		try {
+			for (auto i : participants) {
+				if (i != 0)
+					apply(i);
+			}
+			apply(0);
+		} catch (...) {
+			pending.store(true, std::memory_order_release);
+			throw;
+		}
+	}
+
+	/*
+	 * Finishes the transaction which reached the commit point but was
+	 * not applied, discards the other logs. Must be called with
+	 * commit_mutex held. Afterwards all the logs are idle and empty.
+	 */
+	void
+	finish_pending()
+	{
+		auto &coordinator = *logs[0];
+
+		if (coordinator.state == committed) {
+			for (size_t i = 1; i < logs.size(); ++i) {
+				if (logs[i]->state == prepared &&
+				    logs[i]->txid == coordinator.txid)
+					apply(i);
+			}
+			apply(0);
+		}
+
+		for (size_t i = 1; i < logs.size(); ++i) {
+			if (logs[i]->state != idle ||
+			    logs[i]->entries != nullptr)
+				discard(i);
+		}
+
+		pending.store(false, std::memory_order_release);
+	}
+
+	void
+	finish_if_pending()
+	{
+		if (!pending.load(std::memory_order_acquire))
+			return;
+
+		std::lock_guard<std::mutex> lock(commit_mutex);
+
+		finish_pending();
+	}
+
+	/*
+	 * Stores the written bytes of the modified words in the log. Must be
+	 * called in a transaction on the pool of the log.
+	 */
+	void
+	log_writes(size_t i, const detail::write_set &writes)
+	{
+		auto &log = *logs[i];
+		auto n = writes.size();
+
+		if (n == 0)
+			return;
+
+		log.entries = make_persistent<uint64_t[]>(entry_size * n);
+		log.count = n;
+
+		/* the array is allocated in this transaction */
+		uint64_t *entries = log.entries.get();
+		auto base = reinterpret_cast<uintptr_t>(handles[i]);
+
+		writes.for_each([&](uint64_t *addr, uint64_t value,
+				    uint64_t mask) {
+			*entries++ = reinterpret_cast<uintptr_t>(addr) - base;
+			*entries++ = value;
+			*entries++ = mask;
+		});
+	}
+
+	/*
+	 * Merges the bytes stored in the log with the current content of the
+	 * words and clears the log.
+	 */
+	void
+	apply(size_t i)
+	{
+		auto &log = *logs[i];
+		auto base = reinterpret_cast<uintptr_t>(handles[i]);
+
+		transaction::run(pools[i], [&] {
+			uint64_t *entries = log.entries.get();
+
+			for (uint64_t e = 0; e < log.count; ++e) {
+				auto entry = entries + entry_size * e;
+				auto addr = reinterpret_cast<uint64_t *>(
+					base + entry[0]);
+
+				transaction::snapshot(addr);
+				*addr = (*addr & ~entry[2]) | entry[1];
+			}
+
+			clear(log);
+		});
+	}
+
+	/*
+	 * Clears the log without applying it.
+	 */
+	void
+	discard(size_t i)
+	{
+		transaction::run(pools[i], [&] { clear(*logs[i]); });
+	}
+
+	static void
+	clear(multi_pool_log &log)
+	{
+		if (log.entries != nullptr)
+			delete_persistent<uint64_t[]>(log.entries,
+						      entry_size * log.count);
+
+		log.entries = nullptr;
+		log.count = 0;
+		log.state = idle;
+	}
+
+	std::vector<multi_pool_log *> logs;
+	std::vector<PMEMobjpool *> handles;
+	std::vector<pool_base> pools;
+	std::mutex commit_mutex;
+	/* set if applying a committed transaction failed in commit() */
+	std::atomic<bool> pending{false};
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_MULTI_POOL_TRANSACTION_HPP */
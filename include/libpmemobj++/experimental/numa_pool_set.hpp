@@ -0,0 +1,350 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Set of pools placed on NUMA nodes, with routing of keys to pools.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_NUMA_POOL_SET_HPP
+#define LIBPMEMOBJ_CPP_NUMA_POOL_SET_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/numa_topology.hpp>
+#include <libpmemobj++/pool.hpp>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Set of pools with the same root type, one (or more) per NUMA node.
+ *
+ * A single pool lives on a single PMem device, so on a multi-socket
+ * machine every thread running on the other socket accesses it through
+ * the interconnect. numa_pool_set spreads the data over pools created on
+ * the devices of all sockets: the pool at index i is assumed to be placed
+ * on a device attached to NUMA node (i % nodes()), so the paths have to be
+ * given in the order of the nodes (e.g. /mnt/pmem0/file, /mnt/pmem1/file).
+ *
+ * Data which has to be found by key is placed in the pool selected by
+ * index_for(hash), the same for every thread. Locality comes from the
+ * placement of the threads: a worker bound to the node of a pool with
+ * bind_thread() and serving the keys routed to that pool only ever accesses
+ * local memory. Data which can be placed anywhere (e.g. a per-thread log)
+ * should go to local(). The statistics show how many accesses routed
+ * through the set were local, which tells whether the threads are placed
+ * well.
+ *
+ * Statistics are counted per node of the calling thread, so the counters
+ * are not shared between threads running on different nodes.
+ *
+ * The set itself is not thread-safe for open/create/close, the routing
+ * methods can be called concurrently.
+ */
+template <typename T>
+class numa_pool_set {
+public:
+	/**
+	 * Accesses routed to a single pool.
+	 */
+	struct pool_statistics {
+		/* accesses from threads running on the node of the pool */
+		uint64_t local_accesses;
+		/* accesses from threads running on other nodes */
+		uint64_t remote_accesses;
+	};
+
+	/**
+	 * Creates an empty set.
+	 */
+	numa_pool_set() = default;
+
+	numa_pool_set(const numa_pool_set &) = delete;
+	numa_pool_set &operator=(const numa_pool_set &) = delete;
+
+	numa_pool_set(numa_pool_set &&) = default;
+	numa_pool_set &operator=(numa_pool_set &&) = default;
+
+	/**
+	 * The pools are not closed automatically, close() has to be called.
+	 */
+	~numa_pool_set() = default;
+
+	/**
+	 * Creates a pool for every path.
+	 *
+	 * @param paths paths of the pools, the pool at index i should be
+	 *	placed on a device attached to node (i % nodes()).
+	 * @param layout layout of all pools.
+	 * @param size size of every pool.
+	 * @param mode file mode of the new files.
+	 *
+	 * @throw pmem::pool_error when creation of any pool fails, the
+	 *	already created pools are closed.
+	 * @throw std::invalid_argument if paths is empty.
+	 */
+	static numa_pool_set
+	create(const std::vector<std::string> &paths,
+	       const std::string &layout, std::size_t size = PMEMOBJ_MIN_POOL,
+	       mode_t mode = S_IWUSR | S_IRUSR)
+	{
+		return numa_pool_set(paths, [&](const std::string &path) {
+			return pool<T>::create(path, layout, size, mode);
+		});
+	}
+
+	/**
+	 * Opens the pools in the order in which they were created.
+	 *
+	 * @throw pmem::pool_error when opening of any pool fails, the
+	 *	already opened pools are closed.
+	 * @throw std::invalid_argument if paths is empty.
+	 */
+	static numa_pool_set
+	open(const std::vector<std::string> &paths, const std::string &layout)
+	{
+		return numa_pool_set(paths, [&](const std::string &path) {
+			return pool<T>::open(path, layout);
+		});
+	}
+
+	/**
+	 * Closes all pools.
+	 *
+	 * @throw std::logic_error if any pool has already been closed.
+	 */
+	void
+	close()
+	{
+		for (auto &p : pools)
+			p.close();
+
+		pools.clear();
+		counters_storage.reset();
+	}
+
+	/**
+	 * @return the number of pools.
+	 */
+	size_t
+	size() const noexcept
+	{
+		return pools.size();
+	}
+
+	/**
+	 * @return the number of NUMA nodes of the machine.
+	 */
+	static size_t
+	nodes()
+	{
+		return detail::numa_topology::instance().nodes();
+	}
+
+	/**
+	 * @return the pool at the given index.
+	 */
+	pool<T> &
+	get(size_t index)
+	{
+		return pools.at(index);
+	}
+
+	/**
+	 * @return the node on which the pool at the given index is placed.
+	 */
+	static size_t
+	node_of(size_t index)
+	{
+		return index % nodes();
+	}
+
+	/**
+	 * @return the index of the pool for the given hash, the same for
+	 *	every thread.
+	 */
+	size_t
+	index_for(size_t hash) const noexcept
+	{
+		return detail::hash_to_index(hash, pools.size());
+	}
+
+	/**
+	 * @return the pool for the given hash, the access is counted in the
+	 *	statistics.
+	 */
+	pool<T> &
+	route(size_t hash)
+	{
+		auto index = index_for(hash);
+		count(index);
+
+		return pools[index];
+	}
+
+	/**
+	 * @return the index of a pool placed on the node of the calling
+	 *	thread. If there are many such pools, one is chosen by the id
+	 *	of the thread. If no pool is placed on that node, a pool is
+	 *	chosen by the id of the thread among all pools.
+	 */
+	size_t
+	local_index() const
+	{
+		auto n = nodes();
+		auto node = detail::numa_topology::instance().current_node();
+		auto t = std::hash<std::thread::id>()(
+			std::this_thread::get_id());
+
+		if (node >= pools.size())
+			return t % pools.size();
+
+		/* pools node, node + n, node + 2n, ... */
+		auto local = (pools.size() - node + n - 1) / n;
+
+		return node + (t % local) * n;
+	}
+
+	/**
+	 * @return a pool placed on the node of the calling thread (see
+	 *	local_index()), the access is counted in the statistics.
+	 */
+	pool<T> &
+	local()
+	{
+		auto index = local_index();
+		count(index);
+
+		return pools[index];
+	}
+
+	/**
+	 * Restricts the calling thread to the CPUs of the node on which the
+	 * pool at the given index is placed.
+	 *
+	 * @return true on success, false if binding is not supported.
+	 */
+	bool
+	bind_thread(size_t index) const
+	{
+		return detail::numa_topology::instance().bind_current_thread(
+			node_of(index));
+	}
+
+	/**
+	 * @return statistics of the accesses routed to the pool at the given
+	 *	index.
+	 */
+	pool_statistics
+	statistics(size_t index) const
+	{
+		if (index >= pools.size())
+			throw std::out_of_range("pool index out of range");
+
+		pool_statistics stats{0, 0};
+		auto n = nodes();
+
+		for (size_t node = 0; node < n; ++node) {
+			auto v = counter_at(node * pools.size() + index)
+					 .value.load(std::memory_order_relaxed);
+
+			if (node == node_of(index))
+				stats.local_accesses += v;
+			else
+				stats.remote_accesses += v;
+		}
+
+		return stats;
+	}
+
+	/**
+	 * Resets the statistics of all pools. Accesses routed concurrently
+	 * might be lost.
+	 */
+	void
+	reset_statistics() noexcept
+	{
+		auto n = nodes() * pools.size();
+
+		for (size_t i = 0; i < n; ++i)
+			counter_at(i).value.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	/* counter occupying a whole cache line */
+	struct alignas(64) counter {
+		std::atomic<uint64_t> value{0};
+	};
+
+	template <typename Open>
+	numa_pool_set(const std::vector<std::string> &paths, Open open)
+	{
+		if (paths.empty())
+			throw std::invalid_argument("no pool paths given");
+
+		pools.reserve(paths.size());
+
+		try {
+			for (auto &path : paths)
+				pools.push_back(open(path));
+		} catch (...) {
+			for (auto &p : pools)
+				p.close();
+			throw;
+		}
+
+		/* operator new does not respect the alignment of counter
+		 * before C++17, so the array is aligned manually */
+		auto n = nodes() * pools.size();
+		counters_storage.reset(
+			new char[n * sizeof(counter) + alignof(counter) - 1]);
+
+		for (size_t i = 0; i < n; ++i)
+			new (&counter_at(i)) counter();
+	}
+
+	counter &
+	counter_at(size_t i) const noexcept
+	{
+		auto base = reinterpret_cast<uintptr_t>(counters_storage.get());
+		base = (base + alignof(counter) - 1) &
+			~static_cast<uintptr_t>(alignof(counter) - 1);
+
+		return reinterpret_cast<counter *>(base)[i];
+	}
+
+	void
+	count(size_t index) noexcept
+	{
+		auto node = detail::numa_topology::instance().current_node();
+
+		counter_at(node * pools.size() + index)
+			.value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::vector<pool<T>> pools;
+
+	/* number of accesses, per node of the caller and per pool */
+	std::unique_ptr<char[]> counters_storage;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_NUMA_POOL_SET_HPP */
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Parallel traversal of containers providing splittable ranges.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_PARALLEL_FOR_EACH_HPP
+#define LIBPMEMOBJ_CPP_PARALLEL_FOR_EACH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pmem
+{
+
+namespace detail
+{
+/*
+ * Tag type passed to splitting constructors of ranges.
+ */
+struct split {
+};
+} /* namespace detail */
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Calls f(element) for each element of the container, using the given
+ * number of threads (including the calling one).
+ *
+ * The container has to provide a 'range()' method returning a range which
+ * meets requirements of the TBB Range concept (like concurrent_hash_map
+ * and concurrent_map). The range is split into subranges, which are then
+ * processed by the threads in a dynamic manner, so that a thread which
+ * finishes its subrange early takes the next one.
+ *
+ * The container must not be modified while this function is running,
+ * unless the container itself allows such modifications during iteration.
+ *
+ * @param[in] c container to traverse.
+ * @param[in] f callable object, called concurrently from many threads.
+ * @param[in] threads number of threads, 0 means
+ *	std::thread::hardware_concurrency().
+ *
+ * @throw rethrows the first exception thrown by f. The remaining
+ *	subranges are not processed in that case.
+ * @throw std::system_error if a thread cannot be started.
+ */
+template <typename Container, typename F>
+void
+parallel_for_each(Container &c, F f, std::size_t threads = 0)
+{
+	using range_type = decltype(c.range());
+
+	if (threads == 0)
+		threads = (std::max)(std::thread::hardware_concurrency(), 1U);
+
+	/* Split into a few subranges per thread, to balance the load */
+	std::vector<range_type> ranges(1, c.range());
+	std::size_t target = threads * 4;
+	bool divisible = threads > 1;
+
+	while (ranges.size() < target && divisible) {
+		divisible = false;
+
+		for (std::size_t i = 0, n = ranges.size(); i < n; ++i) {
+			if (!ranges[i].is_divisible())
+				continue;
+
+			range_type r(ranges[i], detail::split());
+			ranges.push_back(r);
+			divisible = true;
+
+			if (ranges.size() == target)
+				break;
+		}
+	}
+
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto worker = [&] {
+		try {
+			std::size_t i;
+			while ((i = next.fetch_add(1)) < ranges.size()) {
+				for (auto &e : ranges[i])
+					f(e);
+			}
+		} catch (...) {
+			std::unique_lock<std::mutex> lock(error_mutex);
+			if (!error)
+				error = std::current_exception();
+
+			/* stop other threads */
+			next.store(ranges.size());
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+
+	try {
+		for (std::size_t i = 1; i < threads; ++i)
+			workers.emplace_back(worker);
+	} catch (...) {
+		next.store(ranges.size());
+		for (auto &t : workers)
+			t.join();
+		throw;
+	}
+
+	worker();
+
+	for (auto &t : workers)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_PARALLEL_FOR_EACH_HPP */
@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Transaction which buffers writes in DRAM and applies them at commit
+ * through a redo log.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_REDO_TRANSACTION_HPP
+#define LIBPMEMOBJ_CPP_REDO_TRANSACTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/write_set.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj/action_base.h>
+#include <libpmemobj/tx_base.h>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Transaction with deferred (write-buffered) modifications.
+ *
+ * Contrary to pmem::obj::transaction, which snapshots a range in the undo
+ * log before it is modified in place, redo_transaction does not modify
+ * persistent memory until commit. Writes are buffered in a volatile write
+ * set at the granularity of 8-byte words, and reads through the
+ * transaction observe the buffered values. At commit, every modified word
+ * becomes a single pmemobj_set_value() action and all actions are
+ * published atomically through the redo log. Therefore:
+ * - writing the same location many times costs one log entry,
+ * - a transaction which is aborted (or not committed) never touches
+ *   persistent memory.
+ *
+ * Only the data written with write() or write_range() is covered, the
+ * data must not be modified in place, and it must be read with read() or
+ * read_range() to observe the buffered values. Allocations are not
+ * supported within a redo_transaction.
+ *
+ * An action replaces a whole word, so every modified word has to be
+ * written completely before commit, e.g. a 4-byte property can only be
+ * written together with the other half of its 8-byte word. The remaining
+ * bytes are not filled from persistent memory, because the action would
+ * revert the updates made to them before it is applied.
+ *
+ * If commit() is called within a pmem::obj::transaction, the actions are
+ * published as a part of that transaction and applied when it commits.
+ *
+ * The transaction does not take any locks, synchronization with other
+ * threads accessing the same data has to be provided by the caller.
+ */
+class redo_transaction {
+public:
+	/**
+	 * Starts an empty transaction on the given pool.
+	 */
+	explicit redo_transaction(pool_base pop) : pop(pop)
+	{
+	}
+
+	redo_transaction(const redo_transaction &) = delete;
+	redo_transaction &operator=(const redo_transaction &) = delete;
+
+	/**
+	 * Discards the uncommitted writes.
+	 */
+	~redo_transaction() = default;
+
+	/**
+	 * Executes a closure-like redo transaction. The closure is called
+	 * with a reference to the transaction and its writes are committed
+	 * if it returns normally. If the closure throws, the writes are
+	 * discarded and the exception is rethrown.
+	 *
+	 * @param[in,out] pop the pool in which the transaction will take
+	 *	place.
+	 * @param[in] tx a closure taking redo_transaction&, which will
+	 *	perform operations within this transaction.
+	 *
+	 * @throw std::invalid_argument if a modified word was not written
+	 *	completely.
+	 * @throw transaction_error if publishing the actions failed.
+	 * @throw rethrows exception thrown by the closure.
+	 */
+	template <typename F>
+	static void
+	run(pool_base &pop, F &&tx)
+	{
+		redo_transaction rtx(pop);
+
+		tx(rtx);
+
+		rtx.commit();
+	}
+
+	/**
+	 * Buffers a write of value to dst.
+	 *
+	 * @throw std::runtime_error if dst is not from the pool of the
+	 *	transaction.
+	 */
+	template <typename T>
+	void
+	write(T &dst, const T &value)
+	{
+		static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "T must be trivially copyable");
+
+		write_range(&dst, &value, sizeof(T));
+	}
+
+	/**
+	 * Buffers a write of value to the persistent property dst.
+	 *
+	 * @throw std::runtime_error if dst is not from the pool of the
+	 *	transaction.
+	 */
+	template <typename T>
+	void
+	write(p<T> &dst, const T &value)
+	{
+		/* get_rw() would snapshot the property */
+		write_range(const_cast<T *>(&dst.get_ro()), &value, sizeof(T));
+	}
+
+	/**
+	 * Buffers a write of size bytes from src to dst.
+	 *
+	 * @throw std::runtime_error if the range is not from the pool of the
+	 *	transaction.
+	 */
+	void
+	write_range(void *dst, const void *src, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		auto last = static_cast<const char *>(dst) + size - 1;
+
+		if (pmemobj_pool_by_ptr(dst) != pop.handle() ||
+		    pmemobj_pool_by_ptr(last) != pop.handle())
+			throw std::runtime_error(
+				"range is not from the chosen pool");
+
+		writes.write(dst, src, size);
+	}
+
+	/**
+	 * Reads the value of src, including the buffered writes.
+	 */
+	template <typename T>
+	T
+	read(const T &src) const
+	{
+		static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "T must be trivially copyable");
+
+		T value;
+		read_range(&value, &src, sizeof(T));
+
+		return value;
+	}
+
+	/**
+	 * Reads the value of the persistent property src, including the
+	 * buffered writes.
+	 */
+	template <typename T>
+	T
+	read(const p<T> &src) const
+	{
+		return read(src.get_ro());
+	}
+
+	/**
+	 * Copies size bytes from src to dst, including the buffered writes.
+	 */
+	void
+	read_range(void *dst, const void *src, size_t size) const
+	{
+		writes.read(dst, src, size);
+	}
+
+	/**
+	 * @return the number of modified 8-byte words, which is the number
+	 *	of redo log entries needed to commit the transaction.
+	 */
+	size_t
+	size() const noexcept
+	{
+		return writes.size();
+	}
+
+	/**
+	 * Atomically applies the buffered writes. If called within a
+	 * pmem::obj::transaction, they are applied when it commits. The
+	 * transaction can be reused afterwards.
+	 *
+	 * @throw std::invalid_argument if a modified word was not written
+	 *	completely, the buffered writes are discarded.
+	 * @throw transaction_error if publishing the actions failed, the
+	 *	buffered writes are discarded.
+	 */
+	void
+	commit()
+	{
+		if (writes.empty())
+			return;
+
+		if (!writes.whole_words()) {
+			writes.clear();
+			throw std::invalid_argument(
+				"modified word was not written completely");
+		}
+
+		std::vector<pobj_action> actions(writes.size());
+		size_t n = 0;
+
+		try {
+			writes.for_each([&](uint64_t *addr, uint64_t value,
+					    uint64_t) {
+				if (pmemobj_set_value(pop.handle(), &actions[n],
+						      addr, value) != 0)
+					throw pmem::transaction_error(
+						"failed to create an action")
+						.with_pmemobj_errormsg();
+				++n;
+			});
+		} catch (...) {
+			pmemobj_cancel(pop.handle(), actions.data(), n);
+			writes.clear();
+			throw;
+		}
+
+		writes.clear();
+
+		int ret;
+		if (pmemobj_tx_stage() == TX_STAGE_WORK)
+			ret = pmemobj_tx_publish(actions.data(), n);
+		else
+			ret = pmemobj_publish(pop.handle(), actions.data(), n);
+
+		if (ret != 0) {
+			pmemobj_cancel(pop.handle(), actions.data(), n);
+			throw pmem::transaction_error(
+				"failed to publish the actions")
+				.with_pmemobj_errormsg();
+		}
+	}
+
+	/**
+	 * Discards the buffered writes. Persistent memory is not accessed.
+	 */
+	void
+	abort() noexcept
+	{
+		writes.clear();
+	}
+
+private:
+	pool_base pop;
+	detail::write_set writes;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_REDO_TRANSACTION_HPP */
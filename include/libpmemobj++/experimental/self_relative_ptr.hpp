@@ -0,0 +1,541 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Persistent smart pointer, which stores the offset of the object relative
+ * to its own address.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_HPP
+#define LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/self_relative_ptr_base.hpp>
+#include <libpmemobj++/detail/specialization.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Persistent self-relative pointer class.
+ *
+ * self_relative_ptr stores the distance between its own address and the
+ * address of the pointed-to object. It takes 8 bytes (instead of 16 bytes of
+ * persistent_ptr) and it is dereferenced with a single addition, without
+ * looking up the pool. It is valid as long as the pointer and the object
+ * reside in the same pool (or the same memory mapping, in general).
+ *
+ * The pointer can be converted to and from persistent_ptr. Like
+ * persistent_ptr, modifications made inside of a transaction are
+ * automatically added to the transaction. Lock-free operations on the
+ * pointer are available through std::atomic<self_relative_ptr<T>>, defined
+ * in atomic_self_relative_ptr.hpp.
+ *
+ * Copying the pointer recalculates the offset, so it must not be copied
+ * with memcpy. Polymorphic types are not supported.
+ */
+template <typename T>
+class self_relative_ptr : public pmem::detail::self_relative_ptr_base {
+public:
+	using base_type = pmem::detail::self_relative_ptr_base;
+
+	template <typename U>
+	friend class self_relative_ptr;
+
+	/**
+	 * Type of the actual object with all qualifiers removed,
+	 * used for easy underlying type access.
+	 */
+	typedef typename pmem::detail::sp_element<T>::type element_type;
+
+	/**
+	 * Default constructor, equal to nullptr.
+	 */
+	self_relative_ptr() noexcept = default;
+
+	/**
+	 * Nullptr constructor.
+	 */
+	self_relative_ptr(std::nullptr_t) noexcept : base_type(nullptr)
+	{
+	}
+
+	/**
+	 * Volatile pointer constructor.
+	 *
+	 * @param ptr volatile pointer, pointing to persistent memory.
+	 */
+	self_relative_ptr(element_type *ptr) noexcept : base_type(ptr)
+	{
+		verify_type();
+	}
+
+	/**
+	 * Constructor from persistent_ptr<T>.
+	 */
+	self_relative_ptr(persistent_ptr<T> ptr) noexcept : base_type(ptr.get())
+	{
+		verify_type();
+	}
+
+	/**
+	 * Copy constructor.
+	 */
+	self_relative_ptr(const self_relative_ptr &ptr) noexcept
+	    : base_type(ptr)
+	{
+	}
+
+	/**
+	 * Copy constructor from a different self_relative_ptr<>.
+	 *
+	 * Available only for convertible types.
+	 */
+	template <typename U,
+		  typename = typename std::enable_if<
+			  !std::is_same<T, U>::value &&
+			  std::is_convertible<U *, T *>::value>::type>
+	self_relative_ptr(const self_relative_ptr<U> &r) noexcept
+	    : base_type(static_cast<element_type *>(r.get()))
+	{
+		verify_type();
+	}
+
+	/**
+	 * Get the direct pointer.
+	 *
+	 * @return the direct pointer to the object.
+	 */
+	element_type *
+	get() const noexcept
+	{
+		return static_cast<element_type *>(this->to_void_pointer());
+	}
+
+	/**
+	 * Conversion to persistent_ptr.
+	 */
+	persistent_ptr<T>
+	to_persistent_ptr() const
+	{
+		return persistent_ptr<T>{this->get()};
+	}
+
+	/**
+	 * Conversion operator to persistent_ptr.
+	 */
+	operator persistent_ptr<T>() const
+	{
+		return to_persistent_ptr();
+	}
+
+	/**
+	 * Bool conversion operator.
+	 */
+	explicit operator bool() const noexcept
+	{
+		return !this->is_null();
+	}
+
+	/**
+	 * Dereference operator.
+	 */
+	typename pmem::detail::sp_dereference<T>::type operator*() const
+		noexcept
+	{
+		return *(this->get());
+	}
+
+	/**
+	 * Member access operator.
+	 */
+	typename pmem::detail::sp_member_access<T>::type operator->() const
+		noexcept
+	{
+		return this->get();
+	}
+
+	/**
+	 * Array access operator.
+	 */
+	template <typename = typename std::enable_if<!std::is_void<T>::value>>
+	typename pmem::detail::sp_array_access<T>::type
+	operator[](difference_type i) const noexcept
+	{
+		return this->get()[i];
+	}
+
+	/**
+	 * Assignment operator.
+	 *
+	 * Self-relative pointer assignment within a transaction
+	 * automatically registers this operation so that a rollback
+	 * is possible.
+	 *
+	 * @throw pmem::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr &
+	operator=(const self_relative_ptr &r)
+	{
+		this->base_type::operator=(r);
+		return *this;
+	}
+
+	/**
+	 * Converting assignment operator from a different
+	 * self_relative_ptr<>.
+	 *
+	 * Available only for convertible types.
+	 *
+	 * @throw pmem::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	template <typename U,
+		  typename = typename std::enable_if<
+			  std::is_convertible<U *, T *>::value>::type>
+	self_relative_ptr &
+	operator=(const self_relative_ptr<U> &r)
+	{
+		this->base_type::operator=(self_relative_ptr(r));
+		return *this;
+	}
+
+	/**
+	 * Nullptr assignment operator.
+	 *
+	 * @throw pmem::transaction_error when adding the object to the
+	 *	transaction failed.
+	 */
+	self_relative_ptr &
+	operator=(std::nullptr_t)
+	{
+		this->base_type::operator=(nullptr);
+		return *this;
+	}
+
+	/**
+	 * Prefix increment operator.
+	 */
+	inline self_relative_ptr &
+	operator++()
+	{
+		detail::conditional_add_to_tx(this);
+		this->offset += static_cast<difference_type>(sizeof(T));
+
+		return *this;
+	}
+
+	/**
+	 * Postfix increment operator.
+	 */
+	inline self_relative_ptr
+	operator++(int)
+	{
+		self_relative_ptr copy(*this);
+		++(*this);
+
+		return copy;
+	}
+
+	/**
+	 * Prefix decrement operator.
+	 */
+	inline self_relative_ptr &
+	operator--()
+	{
+		detail::conditional_add_to_tx(this);
+		this->offset -= static_cast<difference_type>(sizeof(T));
+
+		return *this;
+	}
+
+	/**
+	 * Postfix decrement operator.
+	 */
+	inline self_relative_ptr
+	operator--(int)
+	{
+		self_relative_ptr copy(*this);
+		--(*this);
+
+		return copy;
+	}
+
+	/**
+	 * Addition assignment operator.
+	 */
+	inline self_relative_ptr &
+	operator+=(std::ptrdiff_t s)
+	{
+		detail::conditional_add_to_tx(this);
+		this->offset += s * static_cast<difference_type>(sizeof(T));
+
+		return *this;
+	}
+
+	/**
+	 * Subtraction assignment operator.
+	 */
+	inline self_relative_ptr &
+	operator-=(std::ptrdiff_t s)
+	{
+		detail::conditional_add_to_tx(this);
+		this->offset -= s * static_cast<difference_type>(sizeof(T));
+
+		return *this;
+	}
+
+	/**
+	 * Swaps two self_relative_ptr objects of the same type.
+	 *
+	 * @param[in,out] other the other self_relative_ptr to swap.
+	 */
+	void
+	swap(self_relative_ptr &other)
+	{
+		this->base_type::swap(other);
+	}
+
+	/*
+	 * Pointer traits related.
+	 */
+
+	/**
+	 * Create a self-relative pointer from a given reference.
+	 */
+	template <typename U = T,
+		  typename = typename std::enable_if<
+			  !std::is_void<U>::value>::type>
+	static self_relative_ptr<T>
+	pointer_to(U &ref)
+	{
+		return self_relative_ptr<T>(std::addressof(ref));
+	}
+
+	/**
+	 * Rebind to a different type of pointer.
+	 */
+	template <class U>
+	using rebind = self_relative_ptr<U>;
+
+	/**
+	 * The used bool_type.
+	 */
+	using bool_type = bool;
+
+	/**
+	 * Random access iterator requirements (members)
+	 */
+
+	/**
+	 * The self_relative_ptr iterator category.
+	 */
+	using iterator_category = std::random_access_iterator_tag;
+
+	/**
+	 * The type of the value pointed to by the self_relative_ptr.
+	 */
+	using value_type = T;
+
+	/**
+	 * The reference type of the value pointed to by the
+	 * self_relative_ptr.
+	 */
+	using reference = typename std::add_lvalue_reference<T>::type;
+
+	/**
+	 * The pointer type.
+	 */
+	using pointer = self_relative_ptr<T>;
+
+protected:
+	/**
+	 * Verify if element_type is not polymorphic
+	 */
+	void
+	verify_type()
+	{
+		static_assert(!std::is_polymorphic<element_type>::value,
+			      "Polymorphic types are not supported");
+	}
+};
+
+/**
+ * Swaps two self_relative_ptr objects of the same type.
+ *
+ * Non-member swap function as required by Swappable concept.
+ * en.cppreference.com/w/cpp/concept/Swappable
+ */
+template <class T>
+inline void
+swap(self_relative_ptr<T> &a, self_relative_ptr<T> &b)
+{
+	a.swap(b);
+}
+
+/**
+ * Equality operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator==(self_relative_ptr<T> const &lhs,
+	   self_relative_ptr<Y> const &rhs) noexcept
+{
+	return lhs.get() == rhs.get();
+}
+
+/**
+ * Inequality operator.
+ */
+template <typename T, typename Y>
+inline bool
+operator!=(self_relative_ptr<T> const &lhs,
+	   self_relative_ptr<Y> const &rhs) noexcept
+{
+	return !(lhs == rhs);
+}
+
+/**
+ * Equality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator==(self_relative_ptr<T> const &lhs, std::nullptr_t) noexcept
+{
+	return !bool(lhs);
+}
+
+/**
+ * Equality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator==(std::nullptr_t, self_relative_ptr<T> const &lhs) noexcept
+{
+	return !bool(lhs);
+}
+
+/**
+ * Inequality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator!=(self_relative_ptr<T> const &lhs, std::nullptr_t) noexcept
+{
+	return bool(lhs);
+}
+
+/**
+ * Inequality operator with nullptr.
+ */
+template <typename T>
+inline bool
+operator!=(std::nullptr_t, self_relative_ptr<T> const &lhs) noexcept
+{
+	return bool(lhs);
+}
+
+/**
+ * Less than operator.
+ *
+ * Compares the direct pointers, so it is meaningful only for pointers to
+ * elements of the same array.
+ */
+template <typename T, typename Y>
+inline bool
+operator<(self_relative_ptr<T> const &lhs,
+	  self_relative_ptr<Y> const &rhs) noexcept
+{
+	return lhs.get() < rhs.get();
+}
+
+/**
+ * Less or equal than operator.
+ *
+ * See less than operator for comparison rules.
+ */
+template <typename T, typename Y>
+inline bool
+operator<=(self_relative_ptr<T> const &lhs,
+	   self_relative_ptr<Y> const &rhs) noexcept
+{
+	return !(rhs < lhs);
+}
+
+/**
+ * Greater than operator.
+ *
+ * See less than operator for comparison rules.
+ */
+template <typename T, typename Y>
+inline bool
+operator>(self_relative_ptr<T> const &lhs,
+	  self_relative_ptr<Y> const &rhs) noexcept
+{
+	return rhs < lhs;
+}
+
+/**
+ * Greater or equal than operator.
+ *
+ * See less than operator for comparison rules.
+ */
+template <typename T, typename Y>
+inline bool
+operator>=(self_relative_ptr<T> const &lhs,
+	   self_relative_ptr<Y> const &rhs) noexcept
+{
+	return !(lhs < rhs);
+}
+
+/**
+ * Addition operator for self-relative pointers.
+ */
+template <typename T>
+inline self_relative_ptr<T>
+operator+(self_relative_ptr<T> const &lhs, std::ptrdiff_t s)
+{
+	return self_relative_ptr<T>(lhs.get() + s);
+}
+
+/**
+ * Subtraction operator for self-relative pointers.
+ */
+template <typename T>
+inline self_relative_ptr<T>
+operator-(self_relative_ptr<T> const &lhs, std::ptrdiff_t s)
+{
+	return self_relative_ptr<T>(lhs.get() - s);
+}
+
+/**
+ * Subtraction operator for self-relative pointers of identical type.
+ *
+ * Calculates the offset difference of the pointers, in number of elements.
+ */
+template <typename T, typename Y,
+	  typename = typename std::enable_if<
+		  std::is_same<typename std::remove_cv<T>::type,
+			       typename std::remove_cv<Y>::type>::value>>
+inline ptrdiff_t
+operator-(self_relative_ptr<T> const &lhs, self_relative_ptr<Y> const &rhs)
+{
+	return lhs.get() - rhs.get();
+}
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_SELF_RELATIVE_PTR_HPP */
@@ -0,0 +1,703 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Persistent-aware concurrent hash map partitioned into independent shards.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_SHARDED_CONCURRENT_HASH_MAP_HPP
+#define LIBPMEMOBJ_CPP_SHARDED_CONCURRENT_HASH_MAP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/stats.hpp>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Concurrent hash map partitioned by hash into N independent
+ * concurrent_hash_map shards.
+ *
+ * Every shard has its own mask, size counters, segment table and growth
+ * schedule, so rehashing, segment allocation and defragmentation of one
+ * shard stall only the operations on keys of that shard (about 1/N of the
+ * traffic). The shard of a key is chosen from the mixed bits of its hash,
+ * so the keys within a shard are still spread uniformly over its buckets.
+ *
+ * Operations on a single key are forwarded to the shard of the key and
+ * have the same guarantees as in concurrent_hash_map. size(), iteration,
+ * runtime_initialize(), clear() and defragment() cover all shards. Shards
+ * can also be accessed directly with shard() (e.g. to defragment them one
+ * at a time).
+ *
+ * Like concurrent_hash_map, the map has to be allocated in persistent
+ * memory (e.g. with make_persistent) and runtime_initialize() has to be
+ * called after every pool open.
+ */
+template <typename Key, typename T, std::size_t N,
+	  typename Hash = std::hash<Key>,
+	  typename KeyEqual = std::equal_to<Key>,
+	  typename MutexType = pmem::obj::shared_mutex,
+	  typename ScopedLockType = concurrent_hash_map_internal::
+		  shared_mutex_scoped_lock<MutexType>,
+	  typename LockPolicy = hash_map_node_lock>
+class sharded_concurrent_hash_map {
+	static_assert(N > 0, "number of shards must be positive");
+
+	template <bool IsConst>
+	class sharded_iterator;
+
+public:
+	using shard_type =
+		concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
+				    ScopedLockType, LockPolicy>;
+	using size_type = typename shard_type::size_type;
+	using key_type = typename shard_type::key_type;
+	using mapped_type = typename shard_type::mapped_type;
+	using value_type = typename shard_type::value_type;
+	using difference_type = typename shard_type::difference_type;
+	using pointer = typename shard_type::pointer;
+	using const_pointer = typename shard_type::const_pointer;
+	using reference = typename shard_type::reference;
+	using const_reference = typename shard_type::const_reference;
+	using hasher = typename shard_type::hasher;
+	using key_equal = typename shard_type::key_equal;
+	using accessor = typename shard_type::accessor;
+	using const_accessor = typename shard_type::const_accessor;
+	using iterator = sharded_iterator<false>;
+	using const_iterator = sharded_iterator<true>;
+
+	/**
+	 * Constructs N empty shards.
+	 */
+	sharded_concurrent_hash_map() = default;
+
+	sharded_concurrent_hash_map(const sharded_concurrent_hash_map &) =
+		delete;
+	sharded_concurrent_hash_map &
+	operator=(const sharded_concurrent_hash_map &) = delete;
+
+	/**
+	 * Initializes volatile state of all shards, using the given number
+	 * of threads (including the calling one). Must be called after every
+	 * pool open. Not thread safe.
+	 *
+	 * @param[in] threads number of threads, 0 means
+	 *	std::thread::hardware_concurrency(). At most N threads are used.
+	 *
+	 * @throw pmem::layout_error if any shard was created using an
+	 *	incompatible version of libpmemobj-cpp.
+	 * @throw rethrows the first exception thrown by runtime_initialize()
+	 *	of a shard.
+	 * @throw std::system_error if a thread cannot be started.
+	 */
+	void
+	runtime_initialize(size_type threads = 0)
+	{
+		for_each_shard_parallel(
+			[](shard_type &s) { s.runtime_initialize(); }, threads);
+	}
+
+	/**
+	 * @return the number of shards.
+	 */
+	static constexpr size_type
+	shard_count() noexcept
+	{
+		return N;
+	}
+
+	/**
+	 * @return the index of the shard of the given key.
+	 */
+	template <typename K>
+	size_type
+	shard_index(const K &key) const
+	{
+		return detail::hash_to_index(hasher{}(key), N);
+	}
+
+	/**
+	 * @return the shard at the given index.
+	 */
+	shard_type &
+	shard(size_type index)
+	{
+		assert(index < N);
+
+		return shards[index];
+	}
+
+	/**
+	 * @return the shard at the given index.
+	 */
+	const shard_type &
+	shard(size_type index) const
+	{
+		assert(index < N);
+
+		return shards[index];
+	}
+
+	/**
+	 * @return the shard of the given key.
+	 */
+	template <typename K>
+	shard_type &
+	shard_for(const K &key)
+	{
+		return shards[shard_index(key)];
+	}
+
+	/**
+	 * @return the shard of the given key.
+	 */
+	template <typename K>
+	const shard_type &
+	shard_for(const K &key) const
+	{
+		return shards[shard_index(key)];
+	}
+
+	/**
+	 * @returns an iterator to the beginning. Not thread safe.
+	 */
+	iterator
+	begin()
+	{
+		return iterator(this, 0);
+	}
+
+	/**
+	 * @returns an iterator to the end. Not thread safe.
+	 */
+	iterator
+	end()
+	{
+		return iterator(this, N);
+	}
+
+	/**
+	 * @returns an iterator to the beginning. Not thread safe.
+	 */
+	const_iterator
+	begin() const
+	{
+		return const_iterator(this, 0);
+	}
+
+	/**
+	 * @returns an iterator to the end. Not thread safe.
+	 */
+	const_iterator
+	end() const
+	{
+		return const_iterator(this, N);
+	}
+
+	/**
+	 * @returns number of items in all shards. The shards are visited one
+	 *	by one, so with concurrent modifications the result is only an
+	 *	estimate.
+	 */
+	size_type
+	size() const
+	{
+		size_type n = 0;
+		for (auto &s : shards)
+			n += s.size();
+
+		return n;
+	}
+
+	/**
+	 * @returns true if size()==0.
+	 */
+	bool
+	empty() const
+	{
+		return size() == 0;
+	}
+
+	/**
+	 * @returns the number of buckets in all shards.
+	 */
+	size_type
+	bucket_count() const
+	{
+		size_type n = 0;
+		for (auto &s : shards)
+			n += s.bucket_count();
+
+		return n;
+	}
+
+	/**
+	 * @return memory used by all shards. Not thread safe with respect to
+	 *	rehashing.
+	 */
+	memory_usage_stats
+	memory_usage() const
+	{
+		memory_usage_stats usage;
+		usage.data = 0;
+		usage.metadata = 0;
+		usage.slack = 0;
+
+		for (auto &s : shards) {
+			auto u = s.memory_usage();
+			usage.data += u.data;
+			usage.metadata += u.metadata;
+			usage.slack += u.slack;
+		}
+
+		return usage;
+	}
+
+	/**
+	 * Brings the metadata of all shards into the CPU cache, see
+	 * concurrent_hash_map::prefetch_metadata(). Thread safe.
+	 */
+	void
+	prefetch_metadata() const
+	{
+		for (auto &s : shards)
+			s.prefetch_metadata();
+	}
+
+	/**
+	 * Clears all shards. Not thread safe.
+	 *
+	 * @throw pmem::transaction_error in case of PMDK transaction failure.
+	 */
+	void
+	clear()
+	{
+		for (auto &s : shards)
+			s.clear();
+	}
+
+	/**
+	 * Frees the persistent data of all shards, see
+	 * concurrent_hash_map::free_data(). Not thread safe.
+	 */
+	void
+	free_data()
+	{
+		for (auto &s : shards)
+			s.free_data();
+	}
+
+	/**
+	 * Defragments the given range of buckets of every shard, one shard
+	 * at a time, so that only the operations on one shard are stalled
+	 * at a time.
+	 *
+	 * @param[in] start_percent and amount_percent as in
+	 *	concurrent_hash_map::defragment(), applied to every shard.
+	 *
+	 * @return summary of the relocated objects in all shards.
+	 *
+	 * @throw std::range_error if the range is incorrect.
+	 * @throw rethrows pmem::defrag_error when a failure during
+	 *	defragmentation of a shard occurs, the shards which follow it
+	 *	are not defragmented.
+	 */
+	pobj_defrag_result
+	defragment(double start_percent = 0, double amount_percent = 100)
+	{
+		pobj_defrag_result result;
+		result.total = 0;
+		result.relocated = 0;
+
+		for (auto &s : shards) {
+			auto r = s.defragment(start_percent, amount_percent);
+			result.total += r.total;
+			result.relocated += r.relocated;
+		}
+
+		return result;
+	}
+
+	/**
+	 * @return count of items with the given key (0 or 1).
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	template <typename K>
+	size_type
+	count(const K &key) const
+	{
+		return shard_for(key).count(key);
+	}
+
+	/**
+	 * Finds item and acquires a read lock on it.
+	 *
+	 * @return true if item is found, false otherwise.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	template <typename K>
+	bool
+	find(const_accessor &result, const K &key) const
+	{
+		return shard_for(key).find(result, key);
+	}
+
+	/**
+	 * Finds item and acquires a write lock on it.
+	 *
+	 * @return true if item is found, false otherwise.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	template <typename K>
+	bool
+	find(accessor &result, const K &key)
+	{
+		return shard_for(key).find(result, key);
+	}
+
+	/**
+	 * Inserts item (if not already present) and acquires a read lock on
+	 * it, see concurrent_hash_map::insert().
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(const_accessor &result, const Key &key)
+	{
+		return shard_for(key).insert(result, key);
+	}
+
+	/**
+	 * Inserts item (if not already present) and acquires a write lock on
+	 * it, see concurrent_hash_map::insert().
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(accessor &result, const Key &key)
+	{
+		return shard_for(key).insert(result, key);
+	}
+
+	/**
+	 * Inserts item by copying if there is no such key present already
+	 * and acquires a read lock on it.
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(const_accessor &result, const value_type &value)
+	{
+		return shard_for(value.first).insert(result, value);
+	}
+
+	/**
+	 * Inserts item by copying if there is no such key present already
+	 * and acquires a write lock on it.
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(accessor &result, const value_type &value)
+	{
+		return shard_for(value.first).insert(result, value);
+	}
+
+	/**
+	 * Inserts item by copying if there is no such key present already.
+	 *
+	 * @return true if item is inserted.
+	 */
+	bool
+	insert(const value_type &value)
+	{
+		return shard_for(value.first).insert(value);
+	}
+
+	/**
+	 * Inserts item by moving if there is no such key present already
+	 * and acquires a read lock on it.
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(const_accessor &result, value_type &&value)
+	{
+		auto &s = shard_for(value.first);
+		return s.insert(result, std::move(value));
+	}
+
+	/**
+	 * Inserts item by moving if there is no such key present already
+	 * and acquires a write lock on it.
+	 *
+	 * @return true if item is new.
+	 */
+	bool
+	insert(accessor &result, value_type &&value)
+	{
+		auto &s = shard_for(value.first);
+		return s.insert(result, std::move(value));
+	}
+
+	/**
+	 * Inserts item by moving if there is no such key present already.
+	 *
+	 * @return true if item is inserted.
+	 */
+	bool
+	insert(value_type &&value)
+	{
+		auto &s = shard_for(value.first);
+		return s.insert(std::move(value));
+	}
+
+	/**
+	 * Inserts items of the range [first, last).
+	 */
+	template <typename I>
+	void
+	insert(I first, I last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	/**
+	 * Inserts item if there is no such key present already, assigns
+	 * provided value otherwise.
+	 *
+	 * @return true if the insertion took place and false if the
+	 *	assignment took place.
+	 */
+	template <typename M>
+	bool
+	insert_or_assign(const key_type &key, M &&obj)
+	{
+		return shard_for(key).insert_or_assign(key,
+						       std::forward<M>(obj));
+	}
+
+	/**
+	 * Inserts item if there is no such key present already, assigns
+	 * provided value otherwise.
+	 *
+	 * @return true if the insertion took place and false if the
+	 *	assignment took place.
+	 */
+	template <typename M>
+	bool
+	insert_or_assign(key_type &&key, M &&obj)
+	{
+		auto &s = shard_for(key);
+		return s.insert_or_assign(std::move(key), std::forward<M>(obj));
+	}
+
+	/**
+	 * Removes element with the given key.
+	 *
+	 * @return true if element was deleted by this call.
+	 */
+	template <typename K>
+	bool
+	erase(const K &key)
+	{
+		return shard_for(key).erase(key);
+	}
+
+private:
+	/*
+	 * Calls f(shard) for every shard, shards are distributed dynamically
+	 * among the threads.
+	 */
+	template <typename F>
+	void
+	for_each_shard_parallel(F f, size_type threads)
+	{
+		if (threads == 0)
+			threads = (std::max)(
+				std::thread::hardware_concurrency(), 1U);
+		threads = (std::min)(threads, N);
+
+		std::atomic<size_type> next(0);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&] {
+			try {
+				size_type i;
+				while ((i = next.fetch_add(1)) < N)
+					f(shards[i]);
+			} catch (...) {
+				std::unique_lock<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+
+				/* stop other threads */
+				next.store(N);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+
+		try {
+			for (size_type i = 1; i < threads; ++i)
+				workers.emplace_back(worker);
+		} catch (...) {
+			next.store(N);
+			for (auto &t : workers)
+				t.join();
+			throw;
+		}
+
+		worker();
+
+		for (auto &t : workers)
+			t.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	shard_type shards[N];
+};
+
+/**
+ * Forward iterator over the elements of all shards, shard by shard.
+ */
+template <typename Key, typename T, std::size_t N, typename Hash,
+	  typename KeyEqual, typename MutexType, typename ScopedLockType,
+	  typename LockPolicy>
+template <bool IsConst>
+class sharded_concurrent_hash_map<
+	Key, T, N, Hash, KeyEqual, MutexType, ScopedLockType,
+	LockPolicy>::sharded_iterator {
+	using map_ptr =
+		typename std::conditional<IsConst,
+					  const sharded_concurrent_hash_map *,
+					  sharded_concurrent_hash_map *>::type;
+	using shard_iterator =
+		typename std::conditional<IsConst,
+					  typename shard_type::const_iterator,
+					  typename shard_type::iterator>::type;
+
+	friend class sharded_iterator<true>;
+
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = ptrdiff_t;
+	using value_type = typename shard_type::value_type;
+	using reference = typename shard_iterator::reference;
+	using pointer = typename shard_iterator::pointer;
+
+	sharded_iterator() = default;
+
+	/**
+	 * Constructs an iterator to the beginning of the given shard, or the
+	 * end iterator if index is N.
+	 */
+	sharded_iterator(map_ptr map, size_type index)
+	    : my_map(map), my_index(index)
+	{
+		if (my_index < N) {
+			my_it = my_map->shards[my_index].begin();
+			skip_empty();
+		}
+	}
+
+	/**
+	 * Conversion from iterator to const_iterator.
+	 */
+	template <bool C = IsConst, typename = typename std::enable_if<C>::type>
+	sharded_iterator(const sharded_iterator<false> &other)
+	    : my_map(other.my_map), my_index(other.my_index), my_it(other.my_it)
+	{
+	}
+
+	reference operator*() const
+	{
+		return *my_it;
+	}
+
+	pointer operator->() const
+	{
+		return &operator*();
+	}
+
+	sharded_iterator &
+	operator++()
+	{
+		++my_it;
+		skip_empty();
+
+		return *this;
+	}
+
+	sharded_iterator
+	operator++(int)
+	{
+		sharded_iterator old = *this;
+		operator++();
+
+		return old;
+	}
+
+	friend bool
+	operator==(const sharded_iterator &a, const sharded_iterator &b)
+	{
+		return a.my_map == b.my_map && a.my_index == b.my_index &&
+			(a.my_index == N || a.my_it == b.my_it);
+	}
+
+	friend bool
+	operator!=(const sharded_iterator &a, const sharded_iterator &b)
+	{
+		return !(a == b);
+	}
+
+private:
+	/* moves to the first element of the next non-empty shard */
+	void
+	skip_empty()
+	{
+		while (my_it == my_map->shards[my_index].end()) {
+			if (++my_index == N)
+				return;
+
+			my_it = my_map->shards[my_index].begin();
+		}
+	}
+
+	map_ptr my_map = nullptr;
+	size_type my_index = N;
+	shard_iterator my_it;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_SHARDED_CONCURRENT_HASH_MAP_HPP */
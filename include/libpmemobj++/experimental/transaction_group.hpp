@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Group commit of small transactions issued by concurrent threads.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_TRANSACTION_GROUP_HPP
+#define LIBPMEMOBJ_CPP_TRANSACTION_GROUP_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <type_traits>
+
+#include <libpmemobj++/detail/atomic_backoff.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj/tx_base.h>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+/**
+ * Executor which commits small transactions of concurrent threads in
+ * groups.
+ *
+ * Every call to run() publishes the closure in a lock-free list and
+ * returns once the closure is committed. One of the waiting threads (the
+ * combiner) takes all published closures and executes them, one after
+ * another, within a single pmemobj transaction. The cost of starting and
+ * committing a transaction, in particular the flushes of the undo log and
+ * the drains, is therefore shared by the whole group instead of being paid
+ * by every closure.
+ *
+ * Each closure is still atomic: the whole group is either committed or
+ * rolled back. If any closure throws, the group transaction is aborted and
+ * all closures of the group are executed again, each in its own
+ * transaction, so that the exception is delivered only to the thread
+ * which issued the failing closure. Because of that, a closure can be
+ * invoked more than once and must not have side effects outside of the
+ * transaction (e.g. on volatile data). Closures are executed by the
+ * combiner, which can be any of the waiting threads, so they must not
+ * depend on thread-local state either.
+ *
+ * The closures are executed sequentially, so no locking is needed for
+ * data modified only within the closures of one transaction_group.
+ *
+ * All closures passed to one transaction_group operate on the pool passed
+ * in the constructor.
+ */
+class transaction_group {
+public:
+	/**
+	 * Default maximum number of closures executed in a single
+	 * transaction.
+	 */
+	static constexpr size_t default_max_batch = 64;
+
+	/**
+	 * Creates an executor for transactions on the given pool.
+	 *
+	 * @param[in] pop pool in which the transactions will take place.
+	 * @param[in] max_batch maximum number of closures executed in a
+	 *	single transaction, limits the size of the undo log.
+	 */
+	transaction_group(pool_base pop, size_t max_batch = default_max_batch)
+	    : pop(pop),
+	      max_batch(max_batch == 0 ? 1 : max_batch),
+	      pending(nullptr)
+	{
+	}
+
+	transaction_group(const transaction_group &) = delete;
+	transaction_group &operator=(const transaction_group &) = delete;
+
+	/**
+	 * Executes the closure within a transaction, possibly together with
+	 * closures of other threads. Returns once the transaction is
+	 * committed.
+	 *
+	 * @param[in] tx a closure, which will perform operations within
+	 *	the transaction.
+	 *
+	 * @pre must be called outside of a transaction.
+	 *
+	 * @throw transaction_scope_error if called inside a transaction.
+	 * @throw transaction_error on any error pertaining the execution
+	 *	of the transaction.
+	 * @throw rethrows exception thrown by the closure.
+	 */
+	template <typename F>
+	void
+	run(F &&tx)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw pmem::transaction_scope_error(
+				"transaction_group::run called inside a "
+				"transaction");
+
+		using closure_type = typename std::remove_reference<F>::type;
+
+		request req(&invoke<closure_type>,
+			    const_cast<void *>(static_cast<const void *>(&tx)));
+
+		publish(req);
+
+		detail::atomic_backoff backoff;
+		while (!req.done.load(std::memory_order_acquire)) {
+			std::unique_lock<std::mutex> lock(combiner_mutex,
+							  std::try_to_lock);
+			if (lock.owns_lock())
+				combine();
+			else
+				backoff.pause();
+		}
+
+		if (req.error)
+			std::rethrow_exception(req.error);
+	}
+
+private:
+	/*
+	 * Published closure. It resides on the stack of the issuing thread,
+	 * which waits until 'done' is set, so the combiner must not access
+	 * it afterwards.
+	 */
+	struct request {
+		request(void (*fn)(void *), void *closure)
+		    : fn(fn), closure(closure), next(nullptr), done(false)
+		{
+		}
+
+		void (*fn)(void *);
+		void *closure;
+		request *next;
+		std::exception_ptr error;
+		std::atomic<bool> done;
+	};
+
+	template <typename F>
+	static void
+	invoke(void *closure)
+	{
+		(*static_cast<F *>(closure))();
+	}
+
+	void
+	publish(request &req) noexcept
+	{
+		request *head = pending.load(std::memory_order_relaxed);
+		do {
+			req.next = head;
+		} while (!pending.compare_exchange_weak(
+			head, &req, std::memory_order_release,
+			std::memory_order_relaxed));
+	}
+
+	/*
+	 * Takes all published requests and executes them in batches of at
+	 * most max_batch closures. Must be called with combiner_mutex held.
+	 */
+	void
+	combine() noexcept
+	{
+		request *list = pending.exchange(nullptr,
+						 std::memory_order_acquire);
+
+		/* restore the order of publication */
+		request *batch = nullptr;
+		while (list != nullptr) {
+			request *next = list->next;
+			list->next = batch;
+			batch = list;
+			list = next;
+		}
+
+		while (batch != nullptr) {
+			request *last = batch;
+			for (size_t n = 1; n < max_batch && last->next; ++n)
+				last = last->next;
+
+			request *rest = last->next;
+			last->next = nullptr;
+
+			execute(batch);
+
+			batch = rest;
+		}
+	}
+
+	/*
+	 * Executes a batch of requests in a single transaction. If it
+	 * fails, executes every request in a separate transaction.
+	 */
+	void
+	execute(request *batch) noexcept
+	{
+		if (batch->next != nullptr) {
+			try {
+				transaction::run(pop, [&] {
+					for (auto r = batch; r; r = r->next)
+						r->fn(r->closure);
+				});
+
+				complete(batch);
+				return;
+			} catch (...) {
+				/* the whole batch is rolled back */
+			}
+		}
+
+		for (auto r = batch; r; r = r->next) {
+			try {
+				transaction::run(pop,
+						 [&] { r->fn(r->closure); });
+			} catch (...) {
+				r->error = std::current_exception();
+			}
+		}
+
+		complete(batch);
+	}
+
+	static void
+	complete(request *batch) noexcept
+	{
+		while (batch != nullptr) {
+			request *next = batch->next;
+			batch->done.store(true, std::memory_order_release);
+			batch = next;
+		}
+	}
+
+	pool_base pop;
+	size_t max_batch;
+	std::atomic<request *> pending;
+	std::mutex combiner_mutex;
+};
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_TRANSACTION_GROUP_HPP */
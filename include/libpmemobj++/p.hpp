@@ -9,10 +9,13 @@
 #ifndef LIBPMEMOBJ_CPP_P_HPP
 #define LIBPMEMOBJ_CPP_P_HPP
 
+#include <atomic>
 #include <memory>
+#include <type_traits>
 
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/specialization.hpp>
+#include <libpmemobj/pool_base.h>
 
 namespace pmem
 {
@@ -130,6 +133,62 @@ public:
 		return this->val;
 	}
 
+	/**
+	 * Atomically stores the value and persists it, without a transaction.
+	 *
+	 * Available for trivially copyable types of at most 8 bytes which are
+	 * naturally aligned, whose stores are failure atomic: after a crash
+	 * the object holds either the old or the new value. A cheap way to
+	 * update durable flags and counters, but it cannot be undone, so it
+	 * must not be called inside a transaction.
+	 *
+	 * Concurrent readers can see the value before it is persisted. If
+	 * the object is not in a pool, the value is only stored.
+	 *
+	 * @param[in] value the new value.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside a
+	 *	transaction.
+	 */
+	void
+	store_persist(const T &value)
+	{
+		check_outside_tx();
+
+		atomic_val().store(value, std::memory_order_release);
+		persist_val();
+	}
+
+	/**
+	 * Atomically adds delta to the value and persists the result,
+	 * without a transaction. Thread safe with respect to other atomic
+	 * operations on this object. When it returns, the object holds at
+	 * least the new value also after a crash.
+	 *
+	 * Available for integral types, see store_persist().
+	 *
+	 * @param[in] delta the value to add.
+	 *
+	 * @return the value before the addition.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside a
+	 *	transaction.
+	 */
+	T
+	fetch_add_persist(T delta)
+	{
+		static_assert(std::is_integral<T>::value,
+			      "fetch_add_persist requires an integral type");
+
+		check_outside_tx();
+
+		T old = atomic_val().fetch_add(delta,
+					       std::memory_order_acq_rel);
+		persist_val();
+
+		return old;
+	}
+
 	/**
 	 * Swaps two p objects of the same type.
 	 *
@@ -145,6 +204,41 @@ public:
 	}
 
 private:
+	static void
+	check_outside_tx()
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw pmem::transaction_scope_error(
+				"Function called inside transaction scope.");
+	}
+
+	/* View of the value for failure atomic stores */
+	std::atomic<T> &
+	atomic_val() noexcept
+	{
+		static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "T must be trivially copyable");
+		static_assert(sizeof(T) == 1 || sizeof(T) == 2 ||
+				      sizeof(T) == 4 || sizeof(T) == 8,
+			      "T must be 1, 2, 4 or 8 bytes long");
+		static_assert(alignof(T) == sizeof(T),
+			      "T must be naturally aligned");
+		static_assert(sizeof(std::atomic<T>) == sizeof(T),
+			      "std::atomic<T> must have the layout of T");
+
+		return *reinterpret_cast<std::atomic<T> *>(&this->val);
+	}
+
+	/* Flushes the value and waits for it, if it is in a pool */
+	void
+	persist_val() noexcept
+	{
+		auto pop = pmemobj_pool_by_ptr(&this->val);
+
+		if (pop != nullptr)
+			pmemobj_persist(pop, &this->val, sizeof(T));
+	}
+
 	T val;
 };
 
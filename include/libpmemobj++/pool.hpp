@@ -11,7 +11,9 @@
 
 #include <cstddef>
 #include <functional>
+#include <future>
 #include <mutex>
+#include <stdexcept>
 #include <string>
 #include <sys/stat.h>
 #include <typeindex>
@@ -21,9 +23,11 @@
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/ctl.hpp>
 #include <libpmemobj++/detail/pool_data.hpp>
+#include <libpmemobj++/detail/pool_warmup.hpp>
 #include <libpmemobj++/p.hpp>
 #include <libpmemobj++/persistent_ptr_base.hpp>
 #include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/stats.hpp>
 #include <libpmemobj/atomic_base.h>
 #include <libpmemobj/pool_base.h>
 
@@ -35,6 +39,39 @@ namespace obj
 template <typename T>
 class persistent_ptr;
 
+/**
+ * Parameters of pool_base::warmup().
+ */
+struct warmup_options {
+	/** Number of threads which fault the pages in, at least 1. */
+	std::size_t threads = 1;
+
+	/**
+	 * Distance in bytes between touched addresses. The page size is
+	 * enough to fault the pages in, the cache line size also brings the
+	 * whole pool into the CPU cache (as far as it fits).
+	 */
+	std::size_t stride = 4096;
+
+	/**
+	 * Let the kernel populate the page tables in bulk with
+	 * madvise(MADV_POPULATE_READ) instead of touching every stride.
+	 * Ignored where not supported.
+	 */
+	bool populate = false;
+};
+
+/**
+ * Result of pool_base::warmup().
+ */
+struct warmup_result {
+	/** Number of bytes of the pool mapping which were faulted in. */
+	std::size_t bytes;
+
+	/** True if the warm-up was stopped by close(). */
+	bool cancelled;
+};
+
 /**
  * The non-template pool base class.
  *
@@ -264,11 +301,17 @@ public:
 		auto *user_data = static_cast<detail::pool_data *>(
 			pmemobj_get_user_data(this->pop));
 
+		user_data->stop_background();
+		user_data->release_all();
+
 		if (user_data->initialized.load())
 			user_data->cleanup();
 
 		delete user_data;
 
+		/* Pointers into this pool must not be served from caches */
+		detail::invalidate_caches();
+
 		pmemobj_close(this->pop);
 		this->pop = nullptr;
 	}
@@ -433,6 +476,88 @@ public:
 		return result;
 	}
 
+	/**
+	 * Reads statistics of the pool heap.
+	 *
+	 * Statistics are collected only when enabled, see "stats.enabled"
+	 * in pmemobj_ctl_get(3).
+	 *
+	 * @return heap_stats struct with the current values.
+	 *
+	 * @throw pmem::ctl_error when the statistics cannot be read.
+	 */
+	heap_stats
+	stats()
+	{
+		heap_stats s;
+		s.curr_allocated = ctl_get_detail<size_t>(
+			this->pop, "stats.heap.curr_allocated");
+		s.run_allocated = ctl_get_detail<size_t>(
+			this->pop, "stats.heap.run_allocated");
+		s.run_active = ctl_get_detail<size_t>(this->pop,
+						      "stats.heap.run_active");
+
+		return s;
+	}
+
+	/**
+	 * Starts faulting in the pages of the pool in the background, so that
+	 * the first accesses after the pool is opened do not pay for the page
+	 * faults. The pool is only read, so it can be used at the same time.
+	 *
+	 * The whole mapping of the pool is processed, including the free
+	 * space. It is found in /proc/self/maps, on other systems nothing is
+	 * done. For a pool set only the first part is processed.
+	 *
+	 * close() stops the warm-up and waits for it.
+	 *
+	 * @param[in] options number of threads and the way pages are touched.
+	 *
+	 * @return future which becomes ready when the warm-up is finished.
+	 *
+	 * @throw std::invalid_argument if options.threads or options.stride
+	 *	is 0.
+	 * @throw std::logic_error if the pool is closed or was not opened
+	 *	with the C++ API.
+	 * @throw std::system_error if a thread cannot be started.
+	 */
+	std::shared_future<warmup_result>
+	warmup(const warmup_options &options = warmup_options())
+	{
+		if (this->pop == nullptr)
+			throw std::logic_error("Pool is closed");
+
+		if (options.threads == 0 || options.stride == 0)
+			throw std::invalid_argument("Invalid warm-up options");
+
+		auto *data = static_cast<detail::pool_data *>(
+			pmemobj_get_user_data(this->pop));
+
+		if (data == nullptr)
+			throw std::logic_error(
+				"Pool was not opened with the C++ API");
+
+		auto range = detail::find_mapping(this->pop);
+
+		auto size = static_cast<std::size_t>(range.end - range.begin);
+
+		auto work = [=] {
+			warmup_result result;
+			result.bytes = detail::warmup_mapping(
+				range, options.threads, options.stride,
+				options.populate, data->closing);
+			result.cancelled = result.bytes < size;
+
+			return result;
+		};
+
+		auto task = std::async(std::launch::async, work).share();
+
+		data->add_background([task] { task.wait(); });
+
+		return task;
+	}
+
 protected:
 	/* The pool opaque handle */
 	PMEMobjpool *pop;
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/**
+ * @file
+ * Heap and container memory usage statistics.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_STATS_HPP
+#define LIBPMEMOBJ_CPP_STATS_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include <libpmemobj++/detail/template_helpers.hpp>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+/**
+ * Statistics of the pool heap, returned by pool_base::stats().
+ *
+ * The values come from libpmemobj "stats.heap.*" CTL entry points, which
+ * are updated only when statistics are enabled ("stats.enabled").
+ */
+struct heap_stats {
+	/** Number of bytes currently allocated in the heap. */
+	std::size_t curr_allocated;
+
+	/** Number of bytes allocated in runs (small allocations). */
+	std::size_t run_allocated;
+
+	/** Number of bytes in active runs, allocated or not. */
+	std::size_t run_active;
+
+	/**
+	 * @return number of bytes in active runs which are not allocated.
+	 */
+	std::size_t
+	run_free() const noexcept
+	{
+		return run_active > run_allocated ? run_active - run_allocated
+						  : 0;
+	}
+
+	/**
+	 * @return fraction of memory in active runs which is not allocated,
+	 *	0 if there are no active runs.
+	 */
+	double
+	fragmentation() const noexcept
+	{
+		if (run_active == 0)
+			return 0;
+
+		return static_cast<double>(run_free()) /
+			static_cast<double>(run_active);
+	}
+};
+
+/**
+ * Memory used by a container, returned by its memory_usage() method.
+ *
+ * Memory owned by the elements themselves (e.g. the buffer of a string
+ * stored in a vector) is not included.
+ */
+struct memory_usage_stats {
+	/** Number of bytes occupied by the elements. */
+	std::size_t data;
+
+	/** Number of bytes of internal structures of the container. */
+	std::size_t metadata;
+
+	/** Number of bytes allocated, but not used for elements yet. */
+	std::size_t slack;
+
+	/**
+	 * @return total number of bytes used by the container.
+	 */
+	std::size_t
+	total() const noexcept
+	{
+		return data + metadata + slack;
+	}
+};
+
+/**
+ * Hit and miss counters of a DRAM cache, like the one enabled by
+ * concurrent_hash_map::enable_cache().
+ */
+struct cache_stats {
+	/** Number of lookups served from the cache. */
+	std::size_t hits;
+
+	/** Number of lookups which had to access the container. */
+	std::size_t misses;
+
+	/**
+	 * @return fraction of lookups served from the cache.
+	 */
+	double
+	hit_ratio() const noexcept
+	{
+		if (hits + misses == 0)
+			return 0;
+
+		return static_cast<double>(hits) /
+			static_cast<double>(hits + misses);
+	}
+};
+
+} /* namespace obj */
+
+namespace detail
+{
+template <typename T>
+using t_has_memory_usage =
+	decltype(std::declval<const T &>().memory_usage());
+
+/*
+ * Returns number of bytes allocated by the object outside of itself.
+ */
+template <typename T>
+typename std::enable_if<supports<T, t_has_memory_usage>::value,
+			std::size_t>::type
+heap_usage(const T &t)
+{
+	auto usage = t.memory_usage();
+
+	return usage.total() - sizeof(T);
+}
+
+/*
+ * Specialization for objects which do not report memory usage.
+ */
+template <typename T>
+typename std::enable_if<!supports<T, t_has_memory_usage>::value,
+			std::size_t>::type
+heap_usage(const T &)
+{
+	return 0;
+}
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_STATS_HPP */
@@ -12,9 +12,11 @@
 #include <array>
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/snapshot_tracker.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj/tx_base.h>
@@ -93,6 +95,9 @@ public:
 						       TX_PARAM_CB,
 						       transaction::c_callback,
 						       nullptr, TX_PARAM_NONE);
+				if (ret == 0)
+					detail::snapshot_tracker::instance()
+						.start();
 			} else {
 				ret = pmemobj_tx_begin(pop.handle(), nullptr,
 						       TX_PARAM_NONE);
@@ -377,10 +382,13 @@ public:
 	 * data within a critical section, the locks have to be manually
 	 * acquired once again.
 	 *
+	 * The closure is invoked directly, without being converted to
+	 * std::function, so starting a transaction does not allocate memory.
+	 *
 	 * @param[in,out] pool the pool in which the transaction will take
 	 *	place.
-	 * @param[in] tx an std::function<void ()> which will perform
-	 *	operations within this transaction.
+	 * @param[in] tx a closure callable with no arguments, which will
+	 *	perform operations within this transaction.
 	 * @param[in,out] locks locks to be taken for the duration of
 	 *	the transaction.
 	 *
@@ -388,9 +396,9 @@ public:
 	 *	of the transaction.
 	 * @throw manual_tx_abort on manual transaction abort.
 	 */
-	template <typename... Locks>
+	template <typename F, typename... Locks>
 	static void
-	run(pool_base &pool, std::function<void()> tx, Locks &... locks)
+	run(pool_base &pool, F &&tx, Locks &... locks)
 	{
 		int ret = 0;
 
@@ -399,6 +407,8 @@ public:
 					       TX_PARAM_CB,
 					       transaction::c_callback, nullptr,
 					       TX_PARAM_NONE);
+			if (ret == 0)
+				detail::snapshot_tracker::instance().start();
 		} else {
 			ret = pmemobj_tx_begin(pool.handle(), nullptr,
 					       TX_PARAM_NONE);
@@ -487,16 +497,48 @@ public:
 			throw pmem::transaction_error(
 				"wrong stage for taking a snapshot.");
 
-		if (pmemobj_tx_add_range_direct(addr, sizeof(*addr) * num)) {
-			if (errno == ENOMEM)
-				throw pmem::transaction_out_of_memory(
-					"Could not take a snapshot of given memory range.")
-					.with_pmemobj_errormsg();
-			else
-				throw pmem::transaction_error(
-					"Could not take a snapshot of given memory range.")
-					.with_pmemobj_errormsg();
-		}
+		detail::snapshot_tracker::instance().add(
+			addr, sizeof(*addr) * num,
+			[](const void *ptr, size_t size) {
+				if (pmemobj_tx_add_range_direct(ptr, size)) {
+					if (errno == ENOMEM)
+						throw pmem::transaction_out_of_memory(
+							"Could not take a snapshot of given memory range.")
+							.with_pmemobj_errormsg();
+					else
+						throw pmem::transaction_error(
+							"Could not take a snapshot of given memory range.")
+							.with_pmemobj_errormsg();
+				}
+			});
+	}
+
+	/**
+	 * Counters of the snapshot requests of a thread.
+	 */
+	using snapshot_stats = detail::snapshot_stats;
+
+	/**
+	 * Returns the counters of snapshots requested by the calling thread
+	 * (with snapshot() and by the containers). Ranges which were already
+	 * snapshotted in the current transaction are not passed to
+	 * libpmemobj again, which is shown by the 'avoided' counter.
+	 *
+	 * @return counters of the calling thread.
+	 */
+	static snapshot_stats
+	snapshot_statistics() noexcept
+	{
+		return detail::snapshot_tracker::instance().statistics();
+	}
+
+	/**
+	 * Resets the counters of snapshots requested by the calling thread.
+	 */
+	static void
+	reset_snapshot_statistics() noexcept
+	{
+		detail::snapshot_tracker::instance().reset_statistics();
 	}
 
 	/**
@@ -532,7 +574,7 @@ public:
 				"register_callback must be called during a transaction");
 
 		get_tx_data()->callbacks[static_cast<size_t>(stg)].push_back(
-			cb);
+			std::move(cb));
 	}
 
 private:
@@ -581,6 +623,10 @@ private:
 	static void
 	c_callback(PMEMobjpool *pop, enum pobj_tx_stage obj_stage, void *arg)
 	{
+		/* no more ranges can be snapshotted in this transaction */
+		if (obj_stage != TX_STAGE_WORK)
+			detail::snapshot_tracker::instance().stop();
+
 		/*
 		 * We cannot do anything when in TX_STAGE_NONE because
 		 * pmemobj_tx_get_user_data() can only be called when there is
@@ -598,10 +644,10 @@ private:
 
 		/*
 		 * Callback for TX_STAGE_FINALLY is called as the last one so we
-		 * can free tx_data here
+		 * can release tx_data here
 		 */
 		if (obj_stage == TX_STAGE_FINALLY) {
-			delete data;
+			data->clear();
 			pmemobj_tx_set_user_data(NULL);
 		}
 	}
@@ -609,21 +655,48 @@ private:
 	/**
 	 * This data is stored along with the pmemobj transaction data using
 	 * pmemobj_tx_set_data().
+	 *
+	 * There is one instance per thread, reused by all transactions of the
+	 * thread, so that registering callbacks does not allocate memory once
+	 * the lists have grown to the size needed by the application.
 	 */
 	struct tx_data {
+		/*
+		 * Lists with a capacity above this limit are freed instead of
+		 * being cleared, so that a single big transaction does not
+		 * keep the memory for the lifetime of the thread.
+		 */
+		static constexpr size_t max_retained_capacity = 64;
+
+		void
+		clear() noexcept
+		{
+			for (auto &list : callbacks) {
+				if (list.capacity() > max_retained_capacity)
+					callbacks_list_type().swap(list);
+				else
+					list.clear();
+			}
+		}
+
 		callbacks_map_type callbacks;
 	};
 
 	/**
-	 * Gets tx user data from pmemobj or creates it if this is a first
-	 * call to this function inside a transaction.
+	 * Gets tx user data from pmemobj or attaches the thread's instance
+	 * if this is a first call to this function inside a transaction.
 	 */
 	static tx_data *
 	get_tx_data()
 	{
 		auto *data = static_cast<tx_data *>(pmemobj_tx_get_user_data());
 		if (data == nullptr) {
-			data = new tx_data;
+			static thread_local tx_data thread_data;
+
+			/* leftovers of a transaction whose callback threw */
+			thread_data.clear();
+
+			data = &thread_data;
 			pmemobj_tx_set_user_data(data);
 		}
 
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * atomic_p.cpp -- pmem::obj::experimental::atomic_p test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/atomic_p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#define LAYOUT "atomic_p"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t concurrency = 8;
+const size_t increments = 10000;
+
+struct root {
+	nvobjexp::atomic_p<uint64_t> counter;
+	nvobjexp::atomic_p<uint64_t> max;
+	nvobjexp::atomic_p<int> flag;
+};
+
+/*
+ * test_basic -- verifies single-threaded operations
+ */
+void
+test_basic(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERT(r->flag.is_lock_free());
+	UT_ASSERTeq(r->flag.load(), 0);
+
+	r->flag.store_persist(1);
+	UT_ASSERTeq(r->flag.load(), 1);
+
+	UT_ASSERTeq(r->flag.exchange_persist(2), 1);
+	UT_ASSERTeq(r->flag.fetch_add_persist(3), 2);
+	UT_ASSERTeq(r->flag.fetch_sub_persist(1), 5);
+
+	int expected = 1;
+	UT_ASSERT(!r->flag.compare_exchange_persist(expected, 10));
+	UT_ASSERTeq(expected, 4);
+	UT_ASSERT(r->flag.compare_exchange_persist(expected, 10));
+	UT_ASSERTeq(static_cast<int>(r->flag), 10);
+
+	r->flag = 0;
+	UT_ASSERTeq(r->flag.load(), 0);
+
+	/* the operations are also usable outside of a pool */
+	nvobjexp::atomic_p<uint64_t> volatile_counter(5);
+	UT_ASSERTeq(volatile_counter.fetch_add_persist(1), 5U);
+	UT_ASSERTeq(volatile_counter.load(), 6U);
+}
+
+/*
+ * test_concurrent -- threads concurrently increment the counter and update
+ * the maximum with compare_exchange_persist
+ */
+void
+test_concurrent(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	parallel_exec(concurrency, [&](size_t) {
+		for (size_t i = 0; i < increments; ++i) {
+			uint64_t v = r->counter.fetch_add_persist(1) + 1;
+
+			uint64_t cur = r->max.load();
+			while (cur < v &&
+			       !r->max.compare_exchange_persist(cur, v))
+				;
+
+			UT_ASSERT(r->max.load() >= v);
+		}
+	});
+
+	UT_ASSERTeq(r->counter.load(), concurrency * increments);
+	UT_ASSERTeq(r->max.load(), concurrency * increments);
+}
+
+/*
+ * test_reopen -- verifies the values after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->counter.runtime_initialize();
+	r->max.runtime_initialize();
+
+	UT_ASSERTeq(r->counter.load(), concurrency * increments);
+	UT_ASSERTeq(r->max.load(), concurrency * increments);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_basic(pop);
+	test_concurrent(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
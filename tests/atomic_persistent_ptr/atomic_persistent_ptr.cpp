@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * atomic_persistent_ptr.cpp -- pmem::obj::experimental::atomic_persistent_ptr
+ * test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/atomic_persistent_ptr.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <vector>
+
+#define LAYOUT "atomic_persistent_ptr"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t concurrency = 8;
+const size_t nodes_per_thread = 1000;
+const size_t nodes = concurrency * nodes_per_thread;
+
+struct node {
+	nvobjexp::self_relative_ptr<node> next;
+	nvobj::p<size_t> value;
+};
+
+struct root {
+	nvobj::persistent_ptr<node[nodes]> arr;
+	nvobjexp::atomic_persistent_ptr<node> head;
+	nvobjexp::atomic_persistent_ptr<node> lazy;
+};
+
+/*
+ * test_basic -- verifies single-threaded operations
+ */
+void
+test_basic(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	node *first = &r->arr[0];
+
+	static_assert(sizeof(nvobjexp::atomic_persistent_ptr<node>) == 8,
+		      "atomic_persistent_ptr must be 8 bytes long");
+
+	UT_ASSERT(r->head.is_lock_free());
+	UT_ASSERT(r->head.load() == nullptr);
+
+	r->head.store_persist(first);
+	UT_ASSERTeq(r->head.load().get(), first);
+
+	/* the lazily stored value is not seen as dirty after flush */
+	r->lazy.store(first + 1);
+	UT_ASSERTeq(r->lazy.load().get(), first + 1);
+	UT_ASSERTeq(r->lazy.load().get(), first + 1);
+
+	r->lazy.store(nullptr);
+	UT_ASSERT(r->lazy.load() == nullptr);
+
+	/* the comparison is not affected by the dirty flag */
+	r->lazy.store(first + 2);
+	nvobjexp::self_relative_ptr<node> expected = first + 2;
+	UT_ASSERT(r->lazy.compare_exchange_persist(expected, first + 3));
+	UT_ASSERTeq(r->lazy.load().get(), first + 3);
+
+	expected = first;
+	UT_ASSERT(!r->lazy.compare_exchange_persist(expected, first + 4));
+	UT_ASSERTeq(expected.get(), first + 3);
+
+	/* conversions from and to persistent_ptr */
+	nvobj::persistent_ptr<node> pptr = r->head.load();
+	UT_ASSERTeq(pptr.get(), first);
+	r->lazy = nvobjexp::self_relative_ptr<node>(pptr);
+	UT_ASSERTeq(static_cast<nvobjexp::self_relative_ptr<node>>(r->lazy)
+			    .get(),
+		    first);
+
+	r->head.store_persist(nullptr);
+}
+
+/*
+ * test_concurrent -- threads concurrently push nodes to a lock-free stack
+ * and read the top of the stack
+ */
+void
+test_concurrent(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	parallel_exec(concurrency, [&](size_t tid) {
+		for (size_t i = 0; i < nodes_per_thread; ++i) {
+			size_t idx = tid * nodes_per_thread + i;
+			node *n = &r->arr[static_cast<std::ptrdiff_t>(idx)];
+			n->value = idx;
+
+			auto head = r->head.load();
+			do {
+				n->next = head;
+				pop.persist(&n->next, sizeof(n->next));
+			} while (!r->head.compare_exchange_persist(head, n));
+
+			auto top = r->head.load();
+			UT_ASSERT(top != nullptr);
+		}
+	});
+
+	std::vector<bool> visited(nodes, false);
+	size_t count = 0;
+	for (auto n = r->head.load(); n; n = n->next) {
+		size_t idx = static_cast<size_t>(n.get() - &r->arr[0]);
+		UT_ASSERT(idx < nodes);
+		UT_ASSERTeq(n->value, idx);
+		UT_ASSERT(!visited[idx]);
+		visited[idx] = true;
+		++count;
+	}
+	UT_ASSERTeq(count, nodes);
+}
+
+/*
+ * test_reopen -- verifies the stack after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	size_t count = 0;
+	for (auto n = r->head.load(); n; n = n->next)
+		++count;
+	UT_ASSERTeq(count, nodes);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 2,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->arr = nvobj::make_persistent<node[nodes]>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_basic(pop);
+	test_concurrent(pop);
+
+	pop.persist(pop.root()->arr);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -72,6 +72,15 @@ typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::p<int>, string_hasher,
 				   nvobj::experimental::v<tbb::spin_rw_mutex>,
 				   tbb::spin_rw_mutex::scoped_lock>
 	persistent_map_type;
+#elif LIBPMEMOBJ_CPP_TEST_CACHED_HASH
+class cached_string_hasher : public string_hasher {
+public:
+	using cache_hash_code = void;
+};
+
+typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::p<int>,
+				   cached_string_hasher>
+	persistent_map_type;
 #else
 typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::p<int>, string_hasher>
 	persistent_map_type;
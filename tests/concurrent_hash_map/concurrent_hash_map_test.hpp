@@ -36,6 +36,14 @@ typedef nvobj::concurrent_hash_map<
 	pmem::obj::experimental::v<tbb::spin_rw_mutex>,
 	tbb::spin_rw_mutex::scoped_lock>
 	persistent_map_type;
+#elif LIBPMEMOBJ_CPP_TEST_BUCKET_LOCK
+typedef nvobj::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>, std::hash<nvobj::p<int>>,
+	std::equal_to<nvobj::p<int>>, pmem::obj::shared_mutex,
+	nvobj::concurrent_hash_map_internal::shared_mutex_scoped_lock<
+		pmem::obj::shared_mutex>,
+	nvobj::hash_map_bucket_lock>
+	persistent_map_type;
 #else
 typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>
 	persistent_map_type;
@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * concurrent_hash_map_cache.cpp -- pmem::obj::concurrent_hash_map
+ * DRAM cache of elements (enable_cache() and find_cached()) test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <vector>
+
+#define LAYOUT "concurrent_hash_map_cache"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+/* Identity hash, so that the slots of the keys are known */
+struct identity_hash {
+	size_t
+	operator()(const nvobj::p<int> &key) const
+	{
+		return static_cast<size_t>(key.get_ro());
+	}
+};
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+				   identity_hash>
+	persistent_map_type;
+
+typedef persistent_map_type::value_type value_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+const size_t capacity = 128;
+
+/* value of all elements after concurrent_test */
+const int updates_done = 100;
+
+/*
+ * expect_stats -- (internal) checks hit and miss counters of the cache
+ */
+void
+expect_stats(persistent_map_type &map, size_t hits, size_t misses)
+{
+	auto stats = map.get_cache_stats();
+
+	UT_ASSERTeq(stats.hits, hits);
+	UT_ASSERTeq(stats.misses, misses);
+}
+
+void
+basic_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	map.runtime_initialize();
+
+	for (int i = 0; i < static_cast<int>(capacity); ++i)
+		UT_ASSERT(map.insert(value_type(i, i)));
+
+	nvobj::p<int> value;
+
+	/* lookups without the cache are not counted */
+	UT_ASSERTeq(map.cache_capacity(), 0);
+	UT_ASSERT(map.find_cached(1, value));
+	UT_ASSERTeq(value, 1);
+	expect_stats(map, 0, 0);
+
+	map.enable_cache(capacity - 1);
+	UT_ASSERTeq(map.cache_capacity(), capacity);
+
+	/* first lookup admits the element, second one hits */
+	for (int i = 0; i < static_cast<int>(capacity); ++i) {
+		UT_ASSERT(map.find_cached(i, value));
+		UT_ASSERTeq(value, i);
+	}
+	expect_stats(map, 0, capacity);
+
+	for (int i = 0; i < static_cast<int>(capacity); ++i) {
+		UT_ASSERT(map.find_cached(i, value));
+		UT_ASSERTeq(value, i);
+	}
+	expect_stats(map, capacity, capacity);
+	UT_ASSERTeq(map.get_cache_stats().hit_ratio(), 0.5);
+
+	/* missing keys are not cached */
+	UT_ASSERT(!map.find_cached(static_cast<int>(capacity) + 1, value));
+	expect_stats(map, capacity, capacity + 1);
+
+	/* modification through accessor invalidates the element */
+	{
+		persistent_map_type::accessor acc;
+		UT_ASSERT(map.find(acc, 2));
+		nvobj::transaction::run(pop, [&] { acc->second = 20; });
+	}
+	UT_ASSERT(map.find_cached(2, value));
+	UT_ASSERTeq(value, 20);
+	expect_stats(map, capacity, capacity + 2);
+
+	map.insert_or_assign(3, 30);
+	UT_ASSERT(map.find_cached(3, value));
+	UT_ASSERTeq(value, 30);
+	UT_ASSERT(map.find_cached(3, value));
+	UT_ASSERTeq(value, 30);
+	expect_stats(map, capacity + 1, capacity + 3);
+
+	/* read-only access does not invalidate the element */
+	{
+		persistent_map_type::const_accessor acc;
+		UT_ASSERT(map.find(acc, 3));
+	}
+	UT_ASSERT(map.find_cached(3, value));
+	expect_stats(map, capacity + 2, capacity + 3);
+
+	/* erase invalidates the element */
+	UT_ASSERT(map.erase(4));
+	UT_ASSERT(!map.find_cached(4, value));
+	expect_stats(map, capacity + 2, capacity + 4);
+
+	map.clear();
+	UT_ASSERT(!map.find_cached(1, value));
+	expect_stats(map, capacity + 2, capacity + 5);
+
+	map.enable_cache(0);
+	UT_ASSERTeq(map.cache_capacity(), 0);
+	expect_stats(map, 0, 0);
+}
+
+void
+admission_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	/* keys a and b share the same slot */
+	int a = 1, b = static_cast<int>(capacity) + 1;
+
+	map.insert(value_type(a, a));
+	map.insert(value_type(b, b));
+
+	map.enable_cache(capacity);
+
+	nvobj::p<int> value;
+
+	UT_ASSERT(map.find_cached(a, value));
+	UT_ASSERT(map.find_cached(a, value));
+	expect_stats(map, 1, 1);
+
+	/* a was read since admission, it gets a second chance */
+	UT_ASSERT(map.find_cached(b, value));
+	expect_stats(map, 1, 2);
+	UT_ASSERT(map.find_cached(a, value));
+	expect_stats(map, 2, 2);
+
+	/* b replaces a, which was not read since the second chance */
+	UT_ASSERT(map.find_cached(b, value));
+	UT_ASSERT(map.find_cached(b, value));
+	expect_stats(map, 2, 4);
+	UT_ASSERT(map.find_cached(b, value));
+	UT_ASSERTeq(value, b);
+	expect_stats(map, 3, 4);
+
+	UT_ASSERT(map.find_cached(a, value));
+	UT_ASSERTeq(value, a);
+	expect_stats(map, 3, 5);
+
+	map.enable_cache(0);
+	map.clear();
+}
+
+/*
+ * concurrent_test -- (internal) readers must never see a value older than
+ * the one they have already seen, while a writer increments the values
+ */
+void
+concurrent_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	const int keys = 32;
+	const int updates = updates_done;
+	const size_t readers = 4;
+
+	for (int i = 0; i < keys; ++i)
+		map.insert(value_type(i, 0));
+
+	map.enable_cache(keys);
+
+	parallel_exec(readers + 1, [&](size_t thread_id) {
+		if (thread_id == 0) {
+			for (int u = 1; u <= updates; ++u) {
+				for (int i = 0; i < keys; ++i) {
+					persistent_map_type::accessor acc;
+					UT_ASSERT(map.find(acc, i));
+					nvobj::transaction::run(pop, [&] {
+						acc->second = u;
+					});
+				}
+			}
+		} else {
+			std::vector<int> seen(keys, 0);
+			nvobj::p<int> value;
+
+			for (int r = 0; r < updates * 4; ++r) {
+				for (int i = 0; i < keys; ++i) {
+					UT_ASSERT(map.find_cached(i, value));
+					UT_ASSERT(value >= seen[
+						static_cast<size_t>(i)]);
+					seen[static_cast<size_t>(i)] = value;
+				}
+			}
+		}
+	});
+
+	nvobj::p<int> value;
+	for (int i = 0; i < keys; ++i) {
+		UT_ASSERT(map.find_cached(i, value));
+		UT_ASSERTeq(value, updates);
+	}
+
+	auto stats = map.get_cache_stats();
+	UT_ASSERTeq(stats.hits + stats.misses,
+		    readers * updates * 4 * keys + keys);
+
+	/* runtime_initialize() frees the cache */
+	map.runtime_initialize();
+	UT_ASSERTeq(map.cache_capacity(), 0);
+	expect_stats(map, 0, 0);
+
+	/* the cache is freed on pool close */
+	map.enable_cache(capacity);
+	UT_ASSERT(map.find_cached(0, value));
+}
+
+/*
+ * reopen_test -- (internal) the cache of the previous open of the pool is
+ * not used
+ */
+void
+reopen_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	nvobj::p<int> value;
+
+	UT_ASSERT(map.find_cached(0, value));
+	UT_ASSERTeq(value, updates_done);
+	UT_ASSERTeq(map.cache_capacity(), 0);
+	expect_stats(map, 0, 0);
+
+	/* the cache is freed by the destructor */
+	map.enable_cache(capacity);
+	UT_ASSERT(map.find_cached(0, value));
+	expect_stats(map, 0, 1);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	basic_test(pop);
+	admission_test(pop);
+	concurrent_test(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	reopen_test(pop);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<persistent_map_type>(
+			pop.root()->cons);
+	});
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * concurrent_hash_map_bucket_lock_insert_erase.cpp --
+ *	pmem::obj::concurrent_hash_map test with hash_map_bucket_lock policy
+ *
+ */
+
+#define LIBPMEMOBJ_CPP_TEST_BUCKET_LOCK 1
+#include "concurrent_hash_map_insert_erase.cpp"
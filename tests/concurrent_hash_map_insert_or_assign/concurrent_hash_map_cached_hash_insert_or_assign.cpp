@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * concurrent_hash_map_cached_hash_insert_or_assign.cpp --
+ *	pmem::obj::concurrent_hash_map test with hash codes cached in nodes
+ *
+ */
+
+#define LIBPMEMOBJ_CPP_TEST_CACHED_HASH 1
+#include "concurrent_hash_map_insert_or_assign.cpp"
@@ -49,6 +49,52 @@ typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::string>
 typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::p<long long>>
 	persistent_map_type_mixed;
 
+typedef nvobj::concurrent_hash_map<
+	nvobj::p<long long>, nvobj::p<long long>,
+	std::hash<nvobj::p<long long>>, std::equal_to<nvobj::p<long long>>,
+	nvobj::shared_mutex,
+	nvobj::concurrent_hash_map_internal::shared_mutex_scoped_lock<
+		nvobj::shared_mutex>,
+	nvobj::hash_map_bucket_lock>
+	persistent_map_type_lockless;
+
+struct cached_hasher : public std::hash<nvobj::string> {
+	using cache_hash_code = void;
+};
+
+typedef nvobj::concurrent_hash_map<nvobj::string, nvobj::string,
+				   cached_hasher>
+	persistent_map_type_cached_hash;
+
+/*
+ * Opening a map with a different locking policy than the one it was created
+ * with has to fail, as the nodes have different layouts.
+ */
+static void
+check_layout_different_policy(nvobj::pool_base &pop)
+{
+	nvobj::persistent_ptr<persistent_map_type_lockless> lockless;
+	nvobj::transaction::run(pop, [&] {
+		lockless = nvobj::make_persistent<
+			persistent_map_type_lockless>();
+	});
+
+	nvobj::persistent_ptr<persistent_map_type> map = lockless.raw();
+
+	try {
+		map->runtime_initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<persistent_map_type_lockless>(
+			lockless);
+	});
+}
+
 struct root {
 };
 
@@ -89,6 +135,31 @@ test(int argc, char *argv[])
 
 	hashmap_test<persistent_map_type_mixed, 40>::check_layout(pop);
 
+	static_assert(
+		std::is_standard_layout<persistent_map_type_lockless>::value,
+		"");
+	static_assert(sizeof(persistent_map_type_lockless) == HASHMAP_SIZE,
+		      "");
+
+	hashmap_test<persistent_map_type_lockless, 16>::check_layout_lockless(
+		pop);
+	check_layout_different_policy(pop);
+
+	static_assert(
+		std::is_standard_layout<persistent_map_type_cached_hash>::value,
+		"");
+	static_assert(sizeof(persistent_map_type_cached_hash) == HASHMAP_SIZE,
+		      "");
+
+	hashmap_test<persistent_map_type_cached_hash,
+		     64>::check_layout_cached_hash(pop);
+
+	size_t saved = hashmap_test<persistent_map_type, 16>::NODE_SIZE -
+		hashmap_test<persistent_map_type_lockless,
+			     16>::LOCKLESS_NODE_SIZE;
+	UT_OUT("hash_map_bucket_lock saves %zu bytes per million entries",
+	       saved * 1000000);
+
 	pop.close();
 }
 
@@ -27,6 +27,7 @@ static constexpr std::size_t CACHELINE_SIZE = 64;
 template <typename MapType, std::size_t ValueSize>
 struct hashmap_test : public MapType {
 	static constexpr std::size_t NODE_SIZE = 72 + ValueSize;
+	static constexpr std::size_t LOCKLESS_NODE_SIZE = 8 + ValueSize;
 
 	using persistent_map_type = MapType;
 	using hash_map_base = typename MapType::hash_map_base;
@@ -49,6 +50,8 @@ struct hashmap_test : public MapType {
 		ASSERT_OFFSET_CHECKPOINT(T, 16 * CACHELINE_SIZE);
 		ASSERT_ALIGNED_FIELD(T, t, tls_ptr);
 		ASSERT_ALIGNED_FIELD(T, t, on_init_size);
+		ASSERT_ALIGNED_FIELD(T, t, my_cache);
+		ASSERT_ALIGNED_FIELD(T, t, my_filter);
 		ASSERT_ALIGNED_FIELD(T, t, reserved);
 		ASSERT_OFFSET_CHECKPOINT(T, 17 * CACHELINE_SIZE);
 		ASSERT_ALIGNED_FIELD(T, t, my_segment_enable_mutex);
@@ -114,6 +117,79 @@ struct hashmap_test : public MapType {
 		});
 	}
 
+	/*
+	 * Checks the layout of a map created with the given incompat features
+	 * and of its node, constructed from node_args. The fields of the node
+	 * depend on the features and are checked by check_node.
+	 */
+	template <std::size_t NodeSize, typename CheckNode,
+		  typename... NodeArgs>
+	static void
+	check_layout_features(nvobj::pool_base &pop, uint32_t incompat,
+			      CheckNode check_node, NodeArgs... node_args)
+	{
+		using node_type = typename persistent_map_type::node;
+
+		pmem::obj::persistent_ptr<hashmap_test> map;
+		pmem::obj::persistent_ptr<node_type> node;
+
+		pmem::obj::transaction::run(pop, [&] {
+			map = nvobj::make_persistent<hashmap_test>();
+
+			node = nvobj::make_persistent<node_type>(node_args...);
+		});
+
+		check_layout_hashmap_base(*map);
+		UT_ASSERTeq(map->layout_features.incompat, incompat);
+
+		static_assert(sizeof(typename persistent_map_type::bucket) ==
+				      BUCKET_SIZE,
+			      "");
+
+		static_assert(std::is_standard_layout<node_type>::value, "");
+		check_node(*node);
+		static_assert(sizeof(node_type) == NodeSize, "");
+
+		pmem::obj::transaction::run(pop, [&] {
+			nvobj::delete_persistent<hashmap_test>(map);
+			nvobj::delete_persistent<node_type>(node);
+		});
+	}
+
+	static void
+	check_layout_lockless(nvobj::pool_base &pop)
+	{
+		using node_type = typename persistent_map_type::node;
+
+		check_layout_features<LOCKLESS_NODE_SIZE>(
+			pop, hash_map_base::FEATURE_LOCKLESS_NODES,
+			[](node_type &node) {
+				ASSERT_ALIGNED_BEGIN(node_type, node);
+				ASSERT_ALIGNED_FIELD(node_type, node, next);
+				ASSERT_ALIGNED_FIELD(node_type, node, item);
+				ASSERT_ALIGNED_CHECK(node_type);
+			},
+			nullptr);
+	}
+
+	static void
+	check_layout_cached_hash(nvobj::pool_base &pop)
+	{
+		using node_type = typename persistent_map_type::node;
+
+		check_layout_features<NODE_SIZE + sizeof(size_t)>(
+			pop, hash_map_base::FEATURE_CACHED_HASH,
+			[](node_type &node) {
+				ASSERT_ALIGNED_BEGIN(node_type, node);
+				ASSERT_ALIGNED_FIELD(node_type, node, next);
+				ASSERT_ALIGNED_FIELD(node_type, node, mutex);
+				ASSERT_ALIGNED_FIELD(node_type, node, hash);
+				ASSERT_ALIGNED_FIELD(node_type, node, item);
+				ASSERT_ALIGNED_CHECK(node_type);
+			},
+			nullptr, size_t(0));
+	}
+
 	static void
 	check_layout_different_version(nvobj::pool_base &pop)
 	{
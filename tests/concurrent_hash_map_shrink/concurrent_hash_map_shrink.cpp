@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * concurrent_hash_map_shrink.cpp -- pmem::obj::concurrent_hash_map
+ * rehash_down() and shrink_to_fit() test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <iterator>
+
+#define LAYOUT "concurrent_hash_map_shrink"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>
+	persistent_map_type;
+
+typedef persistent_map_type::value_type value_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+/* number of buckets in the embedded segment and the first block */
+const size_t min_buckets = 256;
+
+const int elements = 20000;
+
+/*
+ * verify_elements -- (internal) checks that elements divisible by step
+ * (and only them) are in the map
+ */
+void
+verify_elements(persistent_map_type &map, int step)
+{
+	size_t expected = static_cast<size_t>((elements + step - 1) / step);
+
+	UT_ASSERTeq(map.size(), expected);
+	UT_ASSERTeq(static_cast<size_t>(std::distance(map.begin(), map.end())),
+		    expected);
+
+	for (int i = 0; i < elements; ++i) {
+		persistent_map_type::const_accessor acc;
+		bool found = map.find(acc, i);
+
+		UT_ASSERTeq(found, i % step == 0);
+		if (found)
+			UT_ASSERTeq(acc->second, i);
+	}
+}
+
+/*
+ * erase_elements -- (internal) erases all elements not divisible by step
+ */
+void
+erase_elements(persistent_map_type &map, int step)
+{
+	for (int i = 0; i < elements; ++i) {
+		if (i % step != 0)
+			UT_ASSERT(map.erase(i));
+	}
+}
+
+void
+shrink_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	map.runtime_initialize();
+
+	for (int i = 0; i < elements; ++i)
+		UT_ASSERT(map.insert(value_type(i, i)));
+
+	size_t buckets = map.bucket_count();
+	auto usage = map.memory_usage();
+	UT_ASSERT(buckets > static_cast<size_t>(elements));
+
+	/* nothing to free while all elements are there */
+	map.shrink_to_fit();
+	UT_ASSERTeq(map.bucket_count(), buckets);
+
+	erase_elements(map, 10);
+
+	/* the table cannot be shrunk below the requested size */
+	map.rehash_down(buckets / 2);
+	UT_ASSERTeq(map.bucket_count(), buckets / 2);
+	verify_elements(map, 10);
+
+	/* nor below the size required by the number of elements */
+	map.shrink_to_fit();
+	UT_ASSERT(map.bucket_count() < buckets / 2);
+	UT_ASSERT(map.bucket_count() > map.size());
+	UT_ASSERTeq(map.bucket_count(), 2048);
+	verify_elements(map, 10);
+
+	erase_elements(map, 1000);
+
+	map.rehash_down();
+	UT_ASSERTeq(map.bucket_count(), min_buckets);
+	UT_ASSERT(map.memory_usage().total() < usage.total());
+	verify_elements(map, 1000);
+}
+
+void
+reopen_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->cons;
+
+	map.runtime_initialize();
+
+	UT_ASSERTeq(map.bucket_count(), min_buckets);
+	verify_elements(map, 1000);
+
+	/* the table grows again */
+	for (int i = 0; i < elements; ++i) {
+		if (i % 1000 != 0)
+			UT_ASSERT(map.insert(value_type(i, i)));
+	}
+
+	UT_ASSERT(map.bucket_count() > static_cast<size_t>(elements));
+	verify_elements(map, 1);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	shrink_test(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	reopen_test(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
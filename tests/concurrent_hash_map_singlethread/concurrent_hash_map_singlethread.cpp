@@ -378,6 +378,52 @@ access_test(nvobj::pool<root> &pop)
 	pmem::detail::destroy<persistent_map_type>(*map1);
 }
 
+/*
+ * find_many_test -- (internal) test batched lookup
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+find_many_test(nvobj::pool<root> &pop)
+{
+	auto &map1 = pop.root()->map1;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	map1->runtime_initialize();
+
+	/* enough elements to cause rehashing of buckets */
+	for (int i = 0; i < 1000; i += 2) {
+		UT_ASSERT(map1->insert(value_type(i, i * 2)) == true);
+	}
+
+	/* more keys than a single batch, every second key is missing */
+	std::vector<nvobj::p<int>> keys;
+	for (int i = 0; i < 100; i++)
+		keys.emplace_back(i);
+
+	std::vector<int> values(keys.size(), -1);
+	auto found = map1->find_many(
+		keys.data(), keys.size(),
+		[&](size_t idx, const value_type &v) {
+			UT_ASSERT(v.first == keys[idx]);
+			values[idx] = v.second;
+		});
+
+	UT_ASSERTeq(found, keys.size() / 2);
+	for (size_t i = 0; i < keys.size(); i++) {
+		int expected = (i % 2 == 0) ? keys[i] * 2 : -1;
+		UT_ASSERTeq(values[i], expected);
+	}
+
+	UT_ASSERTeq(map1->find_many(keys.data(), 0,
+				    [](size_t, const value_type &) {
+					    UT_ASSERT(0);
+				    }),
+		    0);
+
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
+
 /*
  * insert_test -- (internal) test insert methods
  * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
@@ -630,6 +676,7 @@ test(int argc, char *argv[])
 	ctor_test(pop);
 	assignment_test(pop);
 	access_test(pop);
+	find_many_test(pop);
 	swap_test(pop);
 	insert_test(pop);
 	hetero_test(pop);
@@ -15,7 +15,9 @@
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pool.hpp>
 
+#include <algorithm>
 #include <iterator>
+#include <random>
 #include <string>
 #include <thread>
 #include <vector>
@@ -642,6 +644,48 @@ bound_test(nvobj::pool<root> &pop)
 	pmem::detail::destroy<persistent_map_type>(*map1);
 }
 
+/*
+ * find_many_test -- (internal) test batched lookup
+ * pmem::obj::concurrent_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+find_many_test(nvobj::pool<root> &pop)
+{
+	auto &map1 = pop.root()->map1;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	for (int i = 0; i < 300; i += 2) {
+		auto ret = map1->insert(value_type(i, i * 2));
+		UT_ASSERT(ret.second == true);
+	}
+
+	/* more keys than a single batch, in random order, every second key
+	 * and keys out of range are missing */
+	std::vector<nvobj::p<int>> keys;
+	for (int i = -10; i < 310; i++)
+		keys.emplace_back(i);
+	std::shuffle(keys.begin(), keys.end(), std::mt19937(0));
+
+	std::vector<persistent_map_type::iterator> results(keys.size());
+	map1->find_many(keys.data(), keys.size(), results.data());
+
+	std::vector<persistent_map_type::const_iterator> const_results(
+		keys.size());
+	const auto &cmap = *map1;
+	cmap.find_many(keys.data(), keys.size(), const_results.data());
+
+	for (size_t i = 0; i < keys.size(); i++) {
+		UT_ASSERT(results[i] == map1->find(keys[i]));
+		UT_ASSERT(const_results[i] == cmap.find(keys[i]));
+
+		if (results[i] != map1->end())
+			UT_ASSERTeq(results[i]->second, keys[i] * 2);
+	}
+
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
+
 /*
  * erase_test -- (internal) test erase methods
  * pmem::obj::concurrent_map<nvobj::p<int>, nvobj::p<int> >
@@ -812,6 +856,7 @@ test(int argc, char *argv[])
 	insert_test(pop);
 	emplace_test(pop);
 	bound_test(pop);
+	find_many_test(pop);
 	erase_test(pop);
 	hetero_test(pop);
 
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * concurrent_queue.cpp -- pmem::obj::experimental::concurrent_queue test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/concurrent_queue.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <iterator>
+#include <vector>
+
+#define LAYOUT "concurrent_queue"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+struct element {
+	uint64_t producer;
+	uint64_t index;
+};
+
+typedef nvobjexp::concurrent_queue<element> persistent_queue_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_queue_type> queue;
+};
+
+const size_t concurrency = 4;
+const uint64_t elements_per_thread = 20000;
+const uint64_t batch_size = 7;
+
+/* number of elements left in the queue before the pool is reopened */
+const uint64_t left = 5000;
+
+/*
+ * basic_test -- verifies FIFO order of single-threaded operations
+ */
+void
+basic_test(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+	element e;
+
+	UT_ASSERT(queue.empty());
+	UT_ASSERT(!queue.try_pop(e));
+
+	for (uint64_t i = 0; i < 10000; ++i)
+		queue.push(element{0, i});
+	UT_ASSERTeq(queue.size(), 10000);
+
+	for (uint64_t i = 0; i < 10000; ++i) {
+		UT_ASSERT(queue.try_pop(e));
+		UT_ASSERTeq(e.index, i);
+	}
+
+	UT_ASSERT(queue.empty());
+	UT_ASSERT(!queue.try_pop(e));
+
+	std::vector<element> batch;
+	for (uint64_t i = 0; i < 100; ++i)
+		batch.push_back(element{0, i});
+	queue.push_range(batch.begin(), batch.end());
+
+	std::vector<element> popped;
+	UT_ASSERTeq(queue.try_pop_many(std::back_inserter(popped), 30), 30);
+	UT_ASSERTeq(queue.try_pop_many(std::back_inserter(popped), 100), 70);
+	UT_ASSERTeq(queue.try_pop_many(std::back_inserter(popped), 100), 0);
+
+	UT_ASSERTeq(popped.size(), 100);
+	for (uint64_t i = 0; i < 100; ++i)
+		UT_ASSERTeq(popped[i].index, i);
+}
+
+/*
+ * concurrent_test -- producers push batches while consumers pop them,
+ * verifies that every element is popped once and that elements of every
+ * producer are popped in order
+ */
+void
+concurrent_test(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+	std::atomic<uint64_t> popped_count(0);
+	std::vector<std::vector<element>> popped(concurrency);
+
+	const uint64_t total = concurrency * elements_per_thread;
+
+	parallel_exec(concurrency * 2, [&](size_t tid) {
+		if (tid < concurrency) {
+			std::vector<element> batch;
+			for (uint64_t i = 0; i < elements_per_thread; ++i) {
+				batch.push_back(element{tid, i});
+
+				if (batch.size() == batch_size ||
+				    i == elements_per_thread - 1) {
+					queue.push_range(batch.begin(),
+							 batch.end());
+					batch.clear();
+				}
+			}
+		} else {
+			auto &out = popped[tid - concurrency];
+			element buf[16];
+
+			while (popped_count.load() < total - left) {
+				size_t n = queue.try_pop_many(buf, 16);
+				out.insert(out.end(), buf, buf + n);
+				popped_count += n;
+			}
+		}
+	});
+
+	std::vector<uint64_t> count(concurrency, 0);
+	for (auto &out : popped) {
+		std::vector<uint64_t> next(concurrency, 0);
+		for (auto &e : out) {
+			UT_ASSERT(e.producer < concurrency);
+			UT_ASSERT(e.index >= next[e.producer]);
+			next[e.producer] = e.index + 1;
+			++count[e.producer];
+		}
+	}
+
+	uint64_t sum = 0;
+	for (auto c : count)
+		sum += c;
+	UT_ASSERTeq(sum, popped_count.load());
+	UT_ASSERTeq(queue.size(), total - sum);
+}
+
+/*
+ * reopen_test -- verifies that the elements left in the queue are popped
+ * after the pool is reopened
+ */
+void
+reopen_test(nvobj::pool<root> &pop, uint64_t expected)
+{
+	auto &queue = *pop.root()->queue;
+
+	queue.runtime_initialize();
+
+	UT_ASSERTeq(queue.size(), expected);
+
+	std::vector<uint64_t> next(concurrency, 0);
+	std::vector<element> popped;
+	while (queue.try_pop_many(std::back_inserter(popped), 100) != 0)
+		;
+
+	UT_ASSERTeq(popped.size(), expected);
+	for (auto &e : popped) {
+		UT_ASSERT(e.index >= next[e.producer]);
+		next[e.producer] = e.index + 1;
+	}
+
+	/* the queue is still usable */
+	queue.push(element{1, 2});
+	element e;
+	UT_ASSERT(queue.try_pop(e));
+	UT_ASSERTeq(e.producer, 1);
+	UT_ASSERTeq(e.index, 2);
+	UT_ASSERT(queue.empty());
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->queue =
+				nvobj::make_persistent<persistent_queue_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	basic_test(pop);
+	concurrent_test(pop);
+
+	uint64_t expected = pop.root()->queue->size();
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	reopen_test(pop, expected);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<persistent_queue_type>(
+			pop.root()->queue);
+	});
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
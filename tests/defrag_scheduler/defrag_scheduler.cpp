@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * defrag_scheduler.cpp -- pmem::obj::experimental::defrag_scheduler test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/container/segment_vector.hpp>
+#include <libpmemobj++/container/string.hpp>
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/experimental/defrag_scheduler.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define LAYOUT "defrag_scheduler"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using map_type = nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::string>;
+using seg_vector_type = nvobj::segment_vector<int>;
+
+const int NUMBER_ITEMS = 2000;
+
+struct root {
+	nvobj::persistent_ptr<map_type> map;
+	nvobj::persistent_ptr<nvobj::vector<nvobj::vector<int>>> vectors;
+	nvobj::persistent_ptr<seg_vector_type> seg_vector;
+	nvobj::persistent_ptr<nvobj::string> str;
+	nvobj::persistent_ptr<nvobjexp::defrag_progress> progress;
+};
+
+std::string
+value(int i)
+{
+	return std::string(static_cast<size_t>(64 + i % 64), 'a' + i % 26);
+}
+
+/*
+ * Fills all containers with data, leaving a hole after each element,
+ * so that the heap becomes fragmented.
+ */
+void
+fill(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	nvobj::persistent_ptr<char[]> holes[NUMBER_ITEMS];
+
+	for (int i = 0; i < NUMBER_ITEMS; ++i) {
+		{
+			map_type::accessor acc;
+			r->map->insert(acc, i);
+			acc->second = value(i);
+		}
+
+		nvobj::transaction::run(pop, [&] {
+			r->vectors->emplace_back(static_cast<size_t>(i % 16),
+						 i);
+			if (i % 100 == 0)
+				r->seg_vector->push_back(i);
+			holes[i] = nvobj::make_persistent<char[]>(
+				static_cast<size_t>(64 + i % 64));
+		});
+	}
+
+	nvobj::transaction::run(pop, [&] {
+		*r->str = value(0) + value(1) + value(2);
+		for (int i = 0; i < NUMBER_ITEMS; ++i)
+			nvobj::delete_persistent<char[]>(
+				holes[i], static_cast<size_t>(64 + i % 64));
+	});
+}
+
+void
+verify(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERTeq(r->map->size(), static_cast<size_t>(NUMBER_ITEMS));
+	for (int i = 0; i < NUMBER_ITEMS; ++i) {
+		map_type::const_accessor acc;
+		UT_ASSERT(r->map->find(acc, i));
+		UT_ASSERT(acc->second.compare(value(i)) == 0);
+
+		auto &v = r->vectors->const_at(static_cast<size_t>(i));
+		UT_ASSERTeq(v.size(), static_cast<size_t>(i % 16));
+		for (auto &e : v)
+			UT_ASSERTeq(e, i);
+	}
+
+	UT_ASSERTeq(r->seg_vector->size(),
+		    static_cast<size_t>(NUMBER_ITEMS / 100));
+	for (int i = 0; i < NUMBER_ITEMS / 100; ++i)
+		UT_ASSERTeq(r->seg_vector->const_at(static_cast<size_t>(i)),
+			    i * 100);
+
+	UT_ASSERT(r->str->compare(value(0) + value(1) + value(2)) == 0);
+}
+
+void
+add_all(nvobj::pool<root> &pop, nvobjexp::defrag_scheduler &scheduler)
+{
+	auto r = pop.root();
+
+	scheduler.add(*r->map);
+	for (auto &v : *r->vectors)
+		scheduler.add(v);
+	scheduler.add(*r->vectors);
+	scheduler.add(*r->seg_vector);
+	scheduler.add(*r->str);
+}
+
+/*
+ * Runs slices until a whole pass is completed and checks
+ * that the fragmentation decreased.
+ */
+void
+test_slices(nvobj::pool<root> &pop)
+{
+	auto &progress = *pop.root()->progress;
+
+	nvobjexp::defrag_scheduler scheduler(pop, progress);
+	add_all(pop, scheduler);
+	scheduler.set_slice(std::chrono::microseconds(100));
+
+	double frag_before = scheduler.fragmentation();
+	UT_ASSERT(frag_before > 0);
+
+	size_t total = 0;
+	size_t relocated = 0;
+	size_t slices = 0;
+	while (progress.passes == 0) {
+		auto result = scheduler.run_slice();
+		total += result.total;
+		relocated += result.relocated;
+		++slices;
+	}
+
+	UT_ASSERT(slices > 1);
+	UT_ASSERT(total > 0);
+	UT_ASSERT(relocated > 0);
+	UT_ASSERT(total >= relocated);
+	UT_ASSERTeq(progress.relocated, relocated);
+	UT_ASSERTeq(progress.source, 0);
+	UT_ASSERTeq(progress.position, 0);
+
+	UT_ASSERT(scheduler.fragmentation() < frag_before);
+
+	verify(pop);
+}
+
+/*
+ * Interrupts a pass and checks if a new scheduler continues it.
+ */
+void
+test_resume(nvobj::pool<root> &pop)
+{
+	auto &progress = *pop.root()->progress;
+	uint64_t passes = progress.passes;
+
+	{
+		nvobjexp::defrag_scheduler scheduler(pop, progress);
+		add_all(pop, scheduler);
+		scheduler.set_slice(std::chrono::microseconds(0));
+
+		/* a slice always runs at least one step */
+		scheduler.run_slice();
+		UT_ASSERTeq(progress.passes, passes);
+		UT_ASSERTeq(progress.source, 0);
+		UT_ASSERTeq(progress.position, 1);
+	}
+
+	nvobjexp::defrag_scheduler scheduler(pop, progress);
+	add_all(pop, scheduler);
+
+	while (progress.passes == passes)
+		scheduler.run_slice();
+
+	UT_ASSERTeq(progress.passes, passes + 1);
+
+	verify(pop);
+}
+
+/*
+ * Runs the background thread while the hash map is being used.
+ */
+void
+test_background(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto &progress = *r->progress;
+	uint64_t passes = progress.passes;
+
+	nvobjexp::defrag_scheduler scheduler(pop, progress);
+	scheduler.add(*r->map);
+	scheduler.set_slice(std::chrono::microseconds(200));
+	scheduler.start(std::chrono::milliseconds(1));
+
+	try {
+		scheduler.start(std::chrono::milliseconds(1));
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERT(scheduler.running());
+
+	while (progress.passes < passes + 2) {
+		for (int i = 0; i < NUMBER_ITEMS; ++i) {
+			map_type::accessor acc;
+			UT_ASSERT(r->map->find(acc, i));
+			UT_ASSERT(acc->second.compare(value(i)) == 0);
+		}
+		std::this_thread::yield();
+	}
+
+	scheduler.stop();
+	UT_ASSERT(!scheduler.running());
+
+	verify(pop);
+}
+
+/*
+ * Runs the background thread while the vectors and the string are being
+ * modified under the scheduler lock.
+ */
+void
+test_background_lock(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto &progress = *r->progress;
+	uint64_t passes = progress.passes;
+	size_t str_size = r->str->size();
+
+	nvobjexp::defrag_scheduler scheduler(pop, progress);
+	scheduler.add(*r->vectors);
+	scheduler.add(*r->str);
+	scheduler.set_slice(std::chrono::microseconds(200));
+	scheduler.start(std::chrono::milliseconds(1));
+
+	while (progress.passes < passes + 2) {
+		{
+			auto lock = scheduler.lock();
+
+			nvobj::transaction::run(pop, [&] {
+				r->vectors->emplace_back(size_t(4),
+							 NUMBER_ITEMS);
+				r->str->append(value(3));
+			});
+
+			UT_ASSERTeq(r->vectors->size(),
+				    static_cast<size_t>(NUMBER_ITEMS + 1));
+
+			nvobj::transaction::run(pop, [&] {
+				r->vectors->pop_back();
+				r->str->erase(str_size);
+			});
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	scheduler.stop();
+
+	verify(pop);
+}
+
+void
+test_wrong_progress(nvobj::pool<root> &pop)
+{
+	nvobjexp::defrag_progress progress;
+
+	try {
+		nvobjexp::defrag_scheduler scheduler(pop, progress);
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						20 * PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	auto r = pop.root();
+	nvobj::transaction::run(pop, [&] {
+		r->map = nvobj::make_persistent<map_type>();
+		r->vectors = nvobj::make_persistent<
+			nvobj::vector<nvobj::vector<int>>>();
+		r->seg_vector = nvobj::make_persistent<seg_vector_type>();
+		r->str = nvobj::make_persistent<nvobj::string>();
+		r->progress =
+			nvobj::make_persistent<nvobjexp::defrag_progress>();
+	});
+
+	r->map->runtime_initialize();
+
+	fill(pop);
+
+	test_slices(pop);
+	test_resume(pop);
+	test_background(pop);
+	test_background_lock(pop);
+	test_wrong_progress(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
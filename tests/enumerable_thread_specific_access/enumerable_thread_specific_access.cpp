@@ -190,6 +190,53 @@ test_multiple_tls(nvobj::pool<struct root> &pop)
 	}
 }
 
+/*
+ * Checks that references returned by local() are not served from a stale
+ * per-thread cache after the container is cleared, destroyed or its pool is
+ * reopened. Must be called from a separate thread, so that the thread id is
+ * released before other tests run.
+ */
+void
+test_cached_local(nvobj::pool<struct root> &pop, const char *path)
+{
+	auto r = pop.root();
+
+	/* storage is resized up to the calling thread's index */
+	r->pptr->local() = 1;
+	UT_ASSERTeq(r->pptr->local(), 1);
+	UT_ASSERT(&r->pptr->local() == &*(r->pptr->end() - 1));
+
+	r->pptr->clear();
+	UT_ASSERTeq(r->pptr->size(), 0);
+	UT_ASSERTeq(r->pptr->local(), 0);
+	UT_ASSERT(&r->pptr->local() == &*(r->pptr->end() - 1));
+
+	r->pptr->local() = 2;
+
+	/* new container is likely to be allocated at the same address */
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<container_type>(r->pptr);
+		r->pptr = nvobj::make_persistent<container_type>();
+	});
+
+	UT_ASSERTeq(r->pptr->size(), 0);
+	UT_ASSERTeq(r->pptr->local(), 0);
+	UT_ASSERT(&r->pptr->local() == &*(r->pptr->end() - 1));
+
+	r->pptr->local() = 3;
+	pop.persist(&r->pptr->local(), sizeof(test_t));
+
+	pop.close();
+	pop = nvobj::pool<root>::open(
+		path, "TLSTest: enumerable_thread_specific_access");
+	r = pop.root();
+
+	UT_ASSERTeq(r->pptr->local(), 3);
+	UT_ASSERT(&r->pptr->local() == &*(r->pptr->end() - 1));
+
+	r->pptr->clear();
+}
+
 static void
 test(int argc, char *argv[])
 {
@@ -212,6 +259,11 @@ test(int argc, char *argv[])
 		});
 
 		test(pop);
+
+		std::thread t([&] { test_cached_local(pop, path); });
+		t.join();
+		r = pop.root();
+
 		test_multiple_tls(pop);
 		test_with_spin(pop, 16);
 
@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * lazy_initialize.cpp -- implicit runtime_initialize() of
+ * concurrent_hash_map and concurrent_map test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "lazy_initialize"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using hash_map_type =
+	nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>;
+using map_type = nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>;
+
+struct root {
+	nvobj::persistent_ptr<hash_map_type> hash_map;
+	nvobj::persistent_ptr<map_type> map;
+
+	/* never accessed after reopen before being deleted */
+	nvobj::persistent_ptr<hash_map_type> other_hash_map;
+	nvobj::persistent_ptr<map_type> other_map;
+};
+
+const size_t concurrency = 4;
+const int elements = 2000;
+
+nvobj::pool<root>
+open(const char *path)
+{
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	return pop;
+}
+
+/*
+ * verify -- (internal) checks that keys [0, n) are in both maps
+ */
+void
+verify(nvobj::pool<root> &pop, int n)
+{
+	auto r = pop.root();
+
+	UT_ASSERTeq(r->hash_map->size(), static_cast<size_t>(n));
+	UT_ASSERTeq(r->map->size(), static_cast<size_t>(n));
+
+	for (int i = 0; i < n; ++i) {
+		hash_map_type::const_accessor acc;
+		UT_ASSERT(r->hash_map->find(acc, i));
+		UT_ASSERTeq(acc->second, i);
+
+		auto it = r->map->find(i);
+		UT_ASSERT(it != r->map->end());
+		UT_ASSERTeq(it->second, i);
+	}
+}
+
+/*
+ * populate -- (internal) inserts the elements and enables the filters,
+ * whose pointers are not valid after reopen
+ */
+void
+populate(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+		r->other_hash_map = nvobj::make_persistent<hash_map_type>();
+		r->other_map = nvobj::make_persistent<map_type>();
+	});
+
+	/* no runtime_initialize() is needed for a new container */
+	for (int i = 0; i < elements; ++i) {
+		UT_ASSERT(r->hash_map->insert(hash_map_type::value_type(i, i)));
+		UT_ASSERT(r->map->insert(map_type::value_type(i, i)).second);
+	}
+
+	r->hash_map->enable_filter(elements);
+	r->map->enable_filter(elements);
+
+	for (int i = 0; i < 10; ++i) {
+		r->other_hash_map->insert(hash_map_type::value_type(i, i));
+		r->other_map->insert(map_type::value_type(i, i));
+	}
+
+	r->other_hash_map->enable_filter(10);
+	r->other_map->enable_filter(10);
+
+	verify(pop, elements);
+}
+
+/*
+ * concurrent_first_access -- (internal) many threads access the maps for
+ * the first time after reopen, without calling runtime_initialize()
+ */
+void
+concurrent_first_access(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		int id = static_cast<int>(thread_id);
+
+		for (int i = id; i < elements;
+		     i += static_cast<int>(concurrency)) {
+			hash_map_type::const_accessor acc;
+			UT_ASSERT(r->hash_map->find(acc, i));
+			UT_ASSERT(r->map->contains(i));
+		}
+
+		for (int i = elements + id; i < 2 * elements;
+		     i += static_cast<int>(concurrency)) {
+			UT_ASSERT(r->hash_map->insert(
+				hash_map_type::value_type(i, i)));
+			UT_ASSERT(r->map->emplace(i, i).second);
+		}
+	});
+
+	verify(pop, 2 * elements);
+}
+
+/*
+ * explicit_initialize -- (internal) explicit runtime_initialize() is
+ * still supported and is not repeated on the first access
+ */
+void
+explicit_initialize(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->hash_map->runtime_initialize();
+	r->map->runtime_initialize();
+
+	verify(pop, 2 * elements);
+
+	UT_ASSERT(r->hash_map->erase(0));
+	UT_ASSERTeq(r->map->unsafe_erase(0), 1);
+
+	UT_ASSERTeq(r->hash_map->size(), static_cast<size_t>(2 * elements - 1));
+	UT_ASSERTeq(r->map->size(), static_cast<size_t>(2 * elements - 1));
+}
+
+/*
+ * free_data -- (internal) free_data() as the first operation after reopen,
+ * the containers are destroyed in the next open of the pool
+ */
+void
+free_data(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->hash_map->free_data();
+	r->map->free_data();
+
+	/* calling it again is harmless */
+	r->hash_map->free_data();
+	r->map->free_data();
+}
+
+/*
+ * delete_without_access -- (internal) containers can be destroyed as the
+ * first operation after reopen, also if their data was freed with
+ * free_data() in an earlier open of the pool
+ */
+void
+delete_without_access(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->hash_map->free_data();
+	r->map->free_data();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<hash_map_type>(r->hash_map);
+		nvobj::delete_persistent<map_type>(r->map);
+		nvobj::delete_persistent<hash_map_type>(r->other_hash_map);
+		nvobj::delete_persistent<map_type>(r->other_map);
+	});
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						20 * PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	populate(pop);
+	pop.close();
+
+	pop = open(path);
+	concurrent_first_access(pop);
+	pop.close();
+
+	pop = open(path);
+	explicit_initialize(pop);
+	pop.close();
+
+	pop = open(path);
+	free_data(pop);
+	pop.close();
+
+	pop = open(path);
+	delete_without_access(pop);
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
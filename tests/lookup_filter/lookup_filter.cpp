@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * lookup_filter.cpp -- Bloom filters of concurrent_hash_map and
+ * concurrent_map (enable_filter()) test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/detail/bloom_filter.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#define LAYOUT "lookup_filter"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using hash_map_type =
+	nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>;
+using map_type = nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>;
+
+struct root {
+	nvobj::persistent_ptr<hash_map_type> hash_map;
+	nvobj::persistent_ptr<map_type> map;
+};
+
+const int elements = 10000;
+
+/*
+ * bloom_filter_test -- (internal) there are no false negatives and the
+ * false positive rate is close to the requested one
+ */
+void
+bloom_filter_test()
+{
+	const double rate = 0.01;
+	const size_t n = static_cast<size_t>(elements);
+	pmem::detail::bloom_filter filter(n, rate);
+
+	for (size_t i = 0; i < n; ++i)
+		UT_ASSERT(!filter.may_contain(i));
+
+	for (size_t i = 0; i < n; ++i)
+		filter.add(i);
+
+	for (size_t i = 0; i < n; ++i)
+		UT_ASSERT(filter.may_contain(i));
+
+	/* allow 3 times more false positives than requested */
+	size_t false_positives = 0;
+	for (size_t i = n; i < 11 * n; ++i) {
+		if (filter.may_contain(i))
+			++false_positives;
+	}
+
+	UT_ASSERT(static_cast<double>(false_positives) < 10 * n * rate * 3);
+
+	filter.clear();
+	for (size_t i = 0; i < elements; ++i)
+		UT_ASSERT(!filter.may_contain(i));
+
+	try {
+		pmem::detail::bloom_filter f(elements, 1.0);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+void
+hash_map_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->hash_map;
+	map.runtime_initialize();
+
+	for (int i = 0; i < elements; i += 2)
+		map.insert(hash_map_type::value_type(i, i));
+
+	map.enable_filter(elements);
+
+	/* elements inserted before and after enabling the filter are found */
+	parallel_exec(4, [&](size_t thread_id) {
+		int offset = static_cast<int>(thread_id);
+		for (int i = 1 + 2 * offset; i < elements; i += 8)
+			map.insert(hash_map_type::value_type(i, i));
+	});
+
+	for (int i = 0; i < elements; ++i) {
+		hash_map_type::const_accessor acc;
+		UT_ASSERT(map.find(acc, i));
+		UT_ASSERTeq(acc->second, i);
+	}
+
+	for (int i = elements; i < 2 * elements; ++i) {
+		UT_ASSERTeq(map.count(i), 0);
+		UT_ASSERT(!map.erase(i));
+	}
+
+	std::vector<hash_map_type::key_type> keys;
+	for (int i = 0; i < 2 * elements; ++i)
+		keys.emplace_back(i);
+
+	size_t found = map.find_many(
+		keys.data(), keys.size(),
+		[&](size_t i, const hash_map_type::value_type &e) {
+			UT_ASSERTeq(e.first, keys[i]);
+		});
+	UT_ASSERTeq(found, static_cast<size_t>(elements));
+
+	/* erased keys stay in the filter, but are not found */
+	UT_ASSERT(map.erase(0));
+	UT_ASSERTeq(map.count(0), 0);
+
+	/* clear() does not invalidate the filter */
+	map.clear();
+	map.insert(hash_map_type::value_type(1, 1));
+	UT_ASSERTeq(map.count(1), 1);
+
+	map.enable_filter(0);
+	UT_ASSERTeq(map.count(1), 1);
+	UT_ASSERTeq(map.count(2), 0);
+
+	/* the filter is freed by free_data() */
+	map.enable_filter(elements, 0.001);
+	map.free_data();
+}
+
+void
+map_test(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->map;
+	map.runtime_initialize();
+
+	for (int i = 0; i < elements; i += 2)
+		map.insert(map_type::value_type(i, i));
+
+	map.enable_filter(elements);
+
+	parallel_exec(4, [&](size_t thread_id) {
+		int offset = static_cast<int>(thread_id);
+		for (int i = 1 + 2 * offset; i < elements; i += 8)
+			map.emplace(i, i);
+	});
+
+	for (int i = 0; i < elements; ++i) {
+		auto it = map.find(i);
+		UT_ASSERT(it != map.end());
+		UT_ASSERTeq(it->second, i);
+		UT_ASSERT(map.contains(i));
+	}
+
+	for (int i = elements; i < 2 * elements; ++i) {
+		UT_ASSERT(map.find(i) == map.end());
+		UT_ASSERTeq(map.count(i), 0);
+	}
+
+	std::vector<map_type::key_type> keys;
+	for (int i = 0; i < 2 * elements; ++i)
+		keys.emplace_back(i);
+
+	std::vector<map_type::iterator> results(keys.size());
+	map.find_many(keys.data(), keys.size(), results.data());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (keys[i] < elements)
+			UT_ASSERTeq(results[i]->first, keys[i]);
+		else
+			UT_ASSERT(results[i] == map.end());
+	}
+
+	UT_ASSERTeq(map.unsafe_erase(0), 1);
+	UT_ASSERT(map.find(0) == map.end());
+
+	/* keys added by other methods are in the filter as well */
+	map.clear();
+	map.insert(map_type::value_type(1, 1));
+	map.try_emplace(2, 2);
+	map.emplace(3, 3);
+	for (int i = 1; i <= 3; ++i)
+		UT_ASSERT(map.find(i) != map.end());
+
+	map.enable_filter(0);
+	UT_ASSERT(map.find(1) != map.end());
+	UT_ASSERT(map.find(4) == map.end());
+
+	/* the filter is freed by free_data() */
+	map.enable_filter(elements);
+	map.free_data();
+}
+
+/*
+ * release_test -- (internal) runtime_initialize() frees the filters,
+ * filters left enabled are freed on pool close
+ */
+void
+release_test(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<hash_map_type>(r->hash_map);
+		nvobj::delete_persistent<map_type>(r->map);
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+	});
+
+	for (int i = 0; i < 10; ++i) {
+		r->hash_map->insert(hash_map_type::value_type(i, i));
+		r->map->insert(map_type::value_type(i, i));
+	}
+
+	r->hash_map->enable_filter(10);
+	r->map->enable_filter(10);
+
+	r->hash_map->runtime_initialize();
+	r->map->runtime_initialize();
+
+	UT_ASSERTeq(r->hash_map->count(1), 1);
+	UT_ASSERTeq(r->map->count(1), 1);
+
+	r->hash_map->enable_filter(10);
+	r->map->enable_filter(10);
+}
+
+/*
+ * reopen_test -- (internal) the filters of the previous open of the pool
+ * are not used
+ */
+void
+reopen_test(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	for (int i = 0; i < 20; ++i) {
+		UT_ASSERTeq(r->hash_map->count(i), i < 10 ? 1U : 0U);
+		UT_ASSERTeq(r->map->count(i), i < 10 ? 1U : 0U);
+	}
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						20 * PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	auto r = pop.root();
+	nvobj::transaction::run(pop, [&] {
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+	});
+
+	bloom_filter_test();
+	hash_map_test(pop);
+	map_test(pop);
+	release_test(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	reopen_test(pop);
+
+	r = pop.root();
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<hash_map_type>(r->hash_map);
+		nvobj::delete_persistent<map_type>(r->map);
+	});
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
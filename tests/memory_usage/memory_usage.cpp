@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * memory_usage.cpp -- pool_base::stats() and containers' memory_usage() test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/container/segment_vector.hpp>
+#include <libpmemobj++/container/string.hpp>
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/stats.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "memory_usage"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using vector_type = nvobj::vector<int>;
+using seg_vector_type = nvobj::segment_vector<int>;
+using hash_map_type =
+	nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>;
+using map_type = nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>;
+
+struct root {
+	nvobj::persistent_ptr<vector_type> vec;
+	nvobj::persistent_ptr<seg_vector_type> seg_vec;
+	nvobj::persistent_ptr<nvobj::string> str;
+	nvobj::persistent_ptr<hash_map_type> hash_map;
+	nvobj::persistent_ptr<map_type> map;
+};
+
+void
+test_pool_stats(nvobj::pool<root> &pop)
+{
+	auto before = pop.stats();
+	UT_ASSERT(before.run_allocated <= before.run_active);
+	UT_ASSERTeq(before.run_free(),
+		    before.run_active - before.run_allocated);
+	UT_ASSERT(before.fragmentation() >= 0);
+	UT_ASSERT(before.fragmentation() < 1);
+
+	nvobj::persistent_ptr<char[]> ptr;
+	nvobj::transaction::run(
+		pop, [&] { ptr = nvobj::make_persistent<char[]>(1024); });
+
+	auto after = pop.stats();
+	UT_ASSERT(after.curr_allocated >= before.curr_allocated + 1024);
+	UT_ASSERT(after.run_allocated >= before.run_allocated + 1024);
+
+	nvobj::transaction::run(
+		pop, [&] { nvobj::delete_persistent<char[]>(ptr, 1024); });
+
+	UT_ASSERT(pop.stats().curr_allocated < after.curr_allocated);
+
+	nvobj::heap_stats empty = {0, 0, 0};
+	UT_ASSERT(empty.fragmentation() == 0);
+}
+
+void
+test_vector(nvobj::pool<root> &pop)
+{
+	auto &v = *pop.root()->vec;
+
+	auto usage = v.memory_usage();
+	UT_ASSERTeq(usage.data, 0);
+	UT_ASSERTeq(usage.metadata, sizeof(vector_type));
+	UT_ASSERTeq(usage.slack, 0);
+
+	v.reserve(100);
+	v.resize(10);
+
+	usage = v.memory_usage();
+	UT_ASSERTeq(usage.data, 10 * sizeof(int));
+	UT_ASSERTeq(usage.metadata, sizeof(vector_type));
+	UT_ASSERT(usage.slack >= 90 * sizeof(int));
+	UT_ASSERTeq(usage.total(),
+		    sizeof(vector_type) +
+			    pmemobj_alloc_usable_size(pmemobj_oid(v.data())));
+
+	v.free_data();
+}
+
+void
+test_segment_vector(nvobj::pool<root> &pop)
+{
+	auto &v = *pop.root()->seg_vec;
+
+	v.resize(1000);
+
+	auto usage = v.memory_usage();
+	UT_ASSERTeq(usage.data, 1000 * sizeof(int));
+	UT_ASSERT(usage.metadata > sizeof(seg_vector_type));
+	UT_ASSERT(usage.slack >= (v.capacity() - v.size()) * sizeof(int));
+
+	/* capacity is kept after clear */
+	v.clear();
+
+	auto cleared = v.memory_usage();
+	UT_ASSERTeq(cleared.data, 0);
+	UT_ASSERTeq(cleared.total(), usage.total());
+
+	v.free_data();
+}
+
+void
+test_string(nvobj::pool<root> &pop)
+{
+	auto &s = *pop.root()->str;
+
+	s = "abc";
+
+	auto usage = s.memory_usage();
+	UT_ASSERTeq(usage.data, 3);
+	UT_ASSERTeq(usage.slack, nvobj::string::sso_capacity - 3);
+	UT_ASSERTeq(usage.total(), sizeof(nvobj::string));
+
+	s = std::string(1000, 'a');
+
+	usage = s.memory_usage();
+	UT_ASSERTeq(usage.data, 1000);
+	UT_ASSERTeq(usage.metadata, sizeof(nvobj::string) + 1);
+	UT_ASSERTeq(usage.total(),
+		    sizeof(nvobj::string) +
+			    pmemobj_alloc_usable_size(pmemobj_oid(s.data())));
+
+	s.free_data();
+}
+
+void
+test_hash_map(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->hash_map;
+	map.runtime_initialize();
+
+	auto empty = map.memory_usage();
+	UT_ASSERTeq(empty.data, 0);
+	UT_ASSERT(empty.metadata >= sizeof(hash_map_type));
+	UT_ASSERTeq(empty.slack, 0);
+
+	const int n = 1000;
+	for (int i = 0; i < n; ++i)
+		map.insert(hash_map_type::value_type(i, i));
+
+	auto usage = map.memory_usage();
+	UT_ASSERTeq(usage.data, n * sizeof(hash_map_type::value_type));
+	UT_ASSERT(usage.metadata > empty.metadata);
+	UT_ASSERTeq(usage.slack, 0);
+}
+
+void
+test_map(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->map;
+	map.runtime_initialize();
+
+	auto empty = map.memory_usage();
+	UT_ASSERTeq(empty.data, 0);
+	UT_ASSERT(empty.metadata > sizeof(map_type));
+	UT_ASSERTeq(empty.slack, 0);
+
+	const int n = 1000;
+	for (int i = 0; i < n; ++i)
+		map.insert(map_type::value_type(i, i));
+
+	auto usage = map.memory_usage();
+	UT_ASSERTeq(usage.data, n * sizeof(map_type::value_type));
+	/* each node has at least a header and one next pointer */
+	UT_ASSERT(usage.metadata >=
+		  empty.metadata + n * 2 * sizeof(uint64_t));
+	UT_ASSERTeq(usage.slack, 0);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						10 * PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	/* enable both transient and persistent statistics */
+	pop.ctl_set<int>("stats.enabled", 1);
+
+	auto r = pop.root();
+	nvobj::transaction::run(pop, [&] {
+		r->vec = nvobj::make_persistent<vector_type>();
+		r->seg_vec = nvobj::make_persistent<seg_vector_type>();
+		r->str = nvobj::make_persistent<nvobj::string>();
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+	});
+
+	test_pool_stats(pop);
+	test_vector(pop);
+	test_segment_vector(pop);
+	test_string(pop);
+	test_hash_map(pop);
+	test_map(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
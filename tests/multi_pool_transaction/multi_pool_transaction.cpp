@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * multi_pool_transaction.cpp --
+ * pmem::obj::experimental::multi_pool_coordinator test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/multi_pool_transaction.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#define LAYOUT "multi_pool_transaction"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+#ifndef _WIN32
+/* snapshots of this address fail, used to inject a failure of applying
+ * the logged values */
+static const void *fail_snapshot_of = nullptr;
+
+extern "C" {
+
+int __real_pmemobj_tx_add_range_direct(const void *ptr, size_t size);
+
+/*
+ * __wrap_pmemobj_tx_add_range_direct -- fails for fail_snapshot_of
+ */
+int
+__wrap_pmemobj_tx_add_range_direct(const void *ptr, size_t size)
+{
+	if (ptr == fail_snapshot_of) {
+		errno = EIO;
+		return -1;
+	}
+
+	return __real_pmemobj_tx_add_range_direct(ptr, size);
+}
+}
+#endif
+
+namespace
+{
+
+const size_t concurrency = 4;
+const uint64_t transfers = 500;
+const uint64_t initial_balance = 1000000;
+
+struct root {
+	nvobjexp::multi_pool_log log;
+	nvobj::p<uint64_t> balance;
+	/* two halves of the same 8-byte word */
+	nvobj::p<int32_t> left;
+	nvobj::p<int32_t> right;
+	char name[16];
+};
+
+/*
+ * test_basic -- verifies atomic updates of both pools
+ */
+void
+test_basic(nvobj::pool<root> &pop1, nvobj::pool<root> &pop2)
+{
+	auto r1 = pop1.root();
+	auto r2 = pop2.root();
+
+	nvobjexp::multi_pool_coordinator coordinator({&r1->log, &r2->log});
+
+	coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+		tx.write(r1->balance, initial_balance);
+		tx.write(r2->balance, tx.read(r1->balance));
+		tx.write_range(r2->name, "second", sizeof("second"));
+
+		/* nothing is modified before commit */
+		UT_ASSERTeq(r1->balance, 0);
+		UT_ASSERTeq(r2->balance, 0);
+		UT_ASSERTeq(tx.size(), 3);
+	});
+
+	UT_ASSERTeq(r1->balance, initial_balance);
+	UT_ASSERTeq(r2->balance, initial_balance);
+	UT_ASSERT(std::strcmp(r2->name, "second") == 0);
+	UT_ASSERTeq(r1->log.state, 0);
+	UT_ASSERTeq(r2->log.state, 0);
+	UT_ASSERT(r1->log.entries == nullptr);
+	UT_ASSERT(r2->log.entries == nullptr);
+
+	/* aborted transaction does not modify any pool */
+	try {
+		coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+			tx.write(r1->balance, uint64_t(0));
+			tx.write(r2->balance, uint64_t(0));
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	UT_ASSERTeq(r1->balance, initial_balance);
+	UT_ASSERTeq(r2->balance, initial_balance);
+
+	/* volatile data cannot be written */
+	uint64_t volatile_value = 0;
+	try {
+		coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+			tx.write(volatile_value, uint64_t(1));
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	/* cannot be called inside a transaction */
+	try {
+		nvobj::transaction::run(pop1, [&] {
+			coordinator.run(
+				[&](nvobjexp::multi_pool_transaction &) {});
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	}
+}
+
+/*
+ * test_concurrent -- threads concurrently transfer balance between the
+ * pools, the sum of the balances is constant
+ */
+void
+test_concurrent(nvobj::pool<root> &pop1, nvobj::pool<root> &pop2)
+{
+	auto r1 = pop1.root();
+	auto r2 = pop2.root();
+
+	nvobjexp::multi_pool_coordinator coordinator({&r1->log, &r2->log});
+	std::mutex balance_mutex;
+
+	parallel_exec(concurrency, [&](size_t tid) {
+		for (uint64_t i = 0; i < transfers; ++i) {
+			std::lock_guard<std::mutex> lock(balance_mutex);
+
+			coordinator.run(
+				[&](nvobjexp::multi_pool_transaction &tx) {
+					auto from = tid % 2 ? r1 : r2;
+					auto to = tid % 2 ? r2 : r1;
+
+					tx.write(from->balance,
+						 tx.read(from->balance) - i);
+					tx.write(to->balance,
+						 tx.read(to->balance) + i);
+				});
+		}
+	});
+
+	UT_ASSERTeq(r1->balance + r2->balance, 2 * initial_balance);
+	UT_ASSERTeq(r1->log.last_txid, 1 + concurrency * transfers);
+}
+
+/*
+ * test_recovery -- verifies that an interrupted transaction is applied
+ * if the coordinator's log is committed and discarded otherwise
+ */
+void
+test_recovery(nvobj::pool<root> &pop1, nvobj::pool<root> &pop2)
+{
+	auto r1 = pop1.root();
+	auto r2 = pop2.root();
+
+	auto offset = static_cast<uint64_t>(
+		reinterpret_cast<char *>(&r2->balance) -
+		reinterpret_cast<char *>(pop2.handle()));
+
+	/* prepared log of the second pool */
+	auto prepare = [&](uint64_t txid, uint64_t value) {
+		nvobj::transaction::run(pop2, [&] {
+			r2->log.entries =
+				nvobj::make_persistent<uint64_t[]>(3);
+			r2->log.entries[0] = offset;
+			r2->log.entries[1] = value;
+			r2->log.entries[2] = ~uint64_t(0);
+			r2->log.count = 1;
+			r2->log.txid = txid;
+			r2->log.state = 1;
+		});
+	};
+
+	uint64_t txid = r1->log.last_txid + 1;
+
+	/* crash before the commit point */
+	prepare(txid, 1);
+	{
+		nvobjexp::multi_pool_coordinator coordinator(
+			{&r1->log, &r2->log});
+	}
+	UT_ASSERTeq(r2->balance + r1->balance, 2 * initial_balance);
+	UT_ASSERTeq(r2->log.state, 0);
+	UT_ASSERT(r2->log.entries == nullptr);
+
+	/* crash after the commit point */
+	prepare(txid, 2);
+	nvobj::transaction::run(pop1, [&] {
+		r1->log.txid = txid;
+		r1->log.last_txid = txid;
+		r1->log.state = 2;
+	});
+	{
+		nvobjexp::multi_pool_coordinator coordinator(
+			{&r1->log, &r2->log});
+	}
+	UT_ASSERTeq(r2->balance, 2);
+	UT_ASSERTeq(r1->log.state, 0);
+	UT_ASSERTeq(r2->log.state, 0);
+	UT_ASSERT(r2->log.entries == nullptr);
+}
+
+#ifndef _WIN32
+/*
+ * test_apply_failure -- verifies that a transaction which failed after the
+ * commit point is finished by the next run(), before its closure is called
+ */
+void
+test_apply_failure(nvobj::pool<root> &pop1, nvobj::pool<root> &pop2)
+{
+	auto r1 = pop1.root();
+	auto r2 = pop2.root();
+
+	nvobjexp::multi_pool_coordinator coordinator({&r1->log, &r2->log});
+
+	uint64_t balance1 = r1->balance;
+	uint64_t balance2 = r2->balance;
+
+	fail_snapshot_of = &r2->balance;
+
+	try {
+		coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+			tx.write(r1->balance, balance1 + 1);
+			tx.write(r2->balance, balance2 + 1);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_error &) {
+	}
+
+	/* the commit point was reached, the values are logged */
+	UT_ASSERTeq(r1->log.state, 2);
+	UT_ASSERTeq(r2->log.state, 1);
+	UT_ASSERTeq(r1->balance, balance1);
+	UT_ASSERTeq(r2->balance, balance2);
+
+	/* the failed transaction cannot be finished yet */
+	try {
+		coordinator.run([&](nvobjexp::multi_pool_transaction &) {
+			UT_ASSERT(0);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_error &) {
+	}
+
+	fail_snapshot_of = nullptr;
+
+	coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+		/* the failed transaction is already applied */
+		UT_ASSERTeq(r1->balance, balance1 + 1);
+		UT_ASSERTeq(r2->balance, balance2 + 1);
+		UT_ASSERTeq(r1->log.state, 0);
+		UT_ASSERTeq(r2->log.state, 0);
+		UT_ASSERT(r1->log.entries == nullptr);
+		UT_ASSERT(r2->log.entries == nullptr);
+
+		tx.write(r1->balance, balance1);
+		tx.write(r2->balance, balance2);
+	});
+
+	UT_ASSERTeq(r1->balance, balance1);
+	UT_ASSERTeq(r2->balance, balance2);
+	UT_ASSERTeq(r1->log.state, 0);
+	UT_ASSERTeq(r2->log.state, 0);
+	UT_ASSERT(r1->log.entries == nullptr);
+	UT_ASSERT(r2->log.entries == nullptr);
+}
+
+/*
+ * test_partial_word -- verifies that applying a logged write of a part of
+ * a word keeps the updates of the rest of the word made after the write
+ * was logged
+ */
+void
+test_partial_word(nvobj::pool<root> &pop1, nvobj::pool<root> &pop2)
+{
+	auto r1 = pop1.root();
+	auto r2 = pop2.root();
+
+	nvobjexp::multi_pool_coordinator coordinator({&r1->log, &r2->log});
+
+	fail_snapshot_of = &r2->left;
+
+	try {
+		coordinator.run([&](nvobjexp::multi_pool_transaction &tx) {
+			tx.write(r1->left, int32_t(1));
+			tx.write(r2->left, int32_t(2));
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_error &) {
+	}
+
+	fail_snapshot_of = nullptr;
+
+	UT_ASSERTeq(r1->left, 0);
+	UT_ASSERTeq(r2->left, 0);
+
+	/* the other half of the word is modified before the logged write
+	 * is applied */
+	nvobj::transaction::run(pop2, [&] { r2->right = 3; });
+
+	coordinator.run([&](nvobjexp::multi_pool_transaction &) {});
+
+	UT_ASSERTeq(r1->left, 1);
+	UT_ASSERTeq(r1->right, 0);
+	UT_ASSERTeq(r2->left, 2);
+	UT_ASSERTeq(r2->right, 3);
+}
+#endif
+}
+
+static nvobj::pool<root>
+create(const std::string &path)
+{
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path.c_str());
+	}
+
+	return pop;
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	std::string path = argv[1];
+
+	auto pop1 = create(path);
+	auto pop2 = create(path + "_2");
+
+	test_basic(pop1, pop2);
+	test_concurrent(pop1, pop2);
+	test_recovery(pop1, pop2);
+#ifndef _WIN32
+	test_apply_failure(pop1, pop2);
+	test_partial_word(pop1, pop2);
+#endif
+
+	pop1.close();
+	pop2.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * numa_pool_set.cpp -- pmem::obj::experimental::numa_pool_set test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/numa_pool_set.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define LAYOUT "numa_pool_set"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t concurrency = 4;
+const size_t keys = 1000;
+
+struct root {
+	nvobj::p<uint64_t> counter;
+};
+
+using pool_set = nvobjexp::numa_pool_set<root>;
+
+uint64_t
+total_accesses(pool_set &set)
+{
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < set.size(); ++i) {
+		auto stats = set.statistics(i);
+		total += stats.local_accesses + stats.remote_accesses;
+	}
+
+	return total;
+}
+
+uint64_t
+total_counter(pool_set &set)
+{
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < set.size(); ++i)
+		total += set.get(i).root()->counter;
+
+	return total;
+}
+
+/*
+ * test_routing -- every key is routed to the same pool and the keys are
+ * spread over all pools
+ */
+void
+test_routing(pool_set &set)
+{
+	std::vector<size_t> per_pool(set.size(), 0);
+
+	for (size_t key = 0; key < keys; ++key) {
+		auto index = set.index_for(key);
+		UT_ASSERT(index < set.size());
+		UT_ASSERTeq(index, set.index_for(key));
+
+		++per_pool[index];
+	}
+
+	for (auto n : per_pool)
+		UT_ASSERT(n > 0);
+
+	set.reset_statistics();
+
+	for (size_t key = 0; key < keys; ++key) {
+		auto &pop = set.route(key);
+		UT_ASSERT(pop.handle() ==
+			  set.get(set.index_for(key)).handle());
+	}
+
+	for (size_t i = 0; i < set.size(); ++i) {
+		auto stats = set.statistics(i);
+		UT_ASSERTeq(stats.local_accesses + stats.remote_accesses,
+			    per_pool[i]);
+	}
+
+	try {
+		set.statistics(set.size());
+		UT_ASSERT(0);
+	} catch (std::out_of_range &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+/*
+ * test_local -- a thread bound to the node of a pool gets a local pool
+ */
+void
+test_local(pool_set &set)
+{
+	for (size_t i = 0; i < set.size(); ++i)
+		UT_ASSERT(pool_set::node_of(i) < pool_set::nodes());
+
+	UT_ASSERT(set.local_index() < set.size());
+
+	/* binding is not supported on every platform */
+	if (!set.bind_thread(0))
+		return;
+
+	UT_ASSERTeq(pool_set::node_of(set.local_index()), 0);
+
+	set.reset_statistics();
+	set.local();
+
+	UT_ASSERTeq(set.statistics(set.local_index()).local_accesses, 1);
+}
+
+/*
+ * test_concurrent -- threads update the counters in the pools chosen by key
+ */
+void
+test_concurrent(pool_set &set)
+{
+	set.reset_statistics();
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (size_t key = thread_id; key < keys; key += concurrency) {
+			auto &pop = set.route(key);
+			auto r = pop.root();
+
+			nvobj::transaction::run(
+				pop, [&] { r->counter = r->counter + 1; });
+		}
+	});
+
+	UT_ASSERTeq(total_counter(set), keys);
+	UT_ASSERTeq(total_accesses(set), keys);
+}
+
+/*
+ * test_open_error -- pools opened before a failure are closed
+ */
+void
+test_open_error(const std::vector<std::string> &paths)
+{
+	try {
+		pool_set::open({}, LAYOUT);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	try {
+		pool_set::open({paths[0], paths[0] + "_nonexistent"},
+			       LAYOUT);
+		UT_ASSERT(0);
+	} catch (pmem::pool_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	std::vector<std::string> paths = {argv[1],
+					  std::string(argv[1]) + "_2"};
+
+	pool_set set;
+
+	try {
+		set = pool_set::create(paths, LAYOUT, PMEMOBJ_MIN_POOL,
+				       S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool_set::create: %s %s", pe.what(), argv[1]);
+	}
+
+	UT_ASSERTeq(set.size(), paths.size());
+
+	test_routing(set);
+	test_local(set);
+	test_concurrent(set);
+
+	set.close();
+
+	test_open_error(paths);
+
+	set = pool_set::open(paths, LAYOUT);
+
+	UT_ASSERTeq(total_counter(set), keys);
+	UT_ASSERTeq(total_accesses(set), 0);
+
+	set.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
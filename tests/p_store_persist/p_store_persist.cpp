@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * p_store_persist.cpp -- p<>::store_persist() and p<>::fetch_add_persist()
+ * test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <cstdint>
+
+#define LAYOUT "p_store_persist"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+const size_t concurrency = 8;
+const uint64_t increments = 1000;
+
+struct root {
+	nvobj::p<uint64_t> counter;
+	nvobj::p<int32_t> flag;
+	nvobj::p<double> value;
+	nvobj::p<unsigned char> byte;
+};
+
+/*
+ * test_store -- (internal) values are stored outside of a transaction
+ */
+void
+test_store(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->flag.store_persist(1);
+	r->value.store_persist(2.5);
+	r->byte.store_persist(3);
+
+	UT_ASSERTeq(r->flag, 1);
+	UT_ASSERT(r->value == 2.5);
+	UT_ASSERTeq(r->byte, 3);
+
+	/* works for objects outside of a pool as well */
+	nvobj::p<uint64_t> volatile_counter(5);
+	volatile_counter.store_persist(6);
+	UT_ASSERTeq(volatile_counter.fetch_add_persist(1), 6);
+	UT_ASSERTeq(volatile_counter, 7);
+}
+
+/*
+ * test_fetch_add -- (internal) concurrent increments are not lost
+ */
+void
+test_fetch_add(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	parallel_exec(concurrency, [&](size_t) {
+		for (uint64_t i = 0; i < increments; ++i) {
+			auto old = r->counter.fetch_add_persist(1);
+			UT_ASSERT(old < concurrency * increments);
+		}
+	});
+
+	UT_ASSERTeq(r->counter, concurrency * increments);
+}
+
+/*
+ * test_in_tx -- (internal) the operations cannot be undone, so they are
+ * refused inside a transaction
+ */
+void
+test_in_tx(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	try {
+		nvobj::transaction::run(pop, [&] { r->flag.store_persist(2); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	try {
+		nvobj::transaction::run(
+			pop, [&] { r->counter.fetch_add_persist(1); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(r->flag, 1);
+	UT_ASSERTeq(r->counter, concurrency * increments);
+}
+
+void
+verify(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERTeq(r->counter, concurrency * increments);
+	UT_ASSERTeq(r->flag, 1);
+	UT_ASSERT(r->value == 2.5);
+	UT_ASSERTeq(r->byte, 3);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_store(pop);
+	test_fetch_add(pop);
+	test_in_tx(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	verify(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * parallel_for_each.cpp -- ranges of concurrent_hash_map and concurrent_map
+ * and pmem::obj::experimental::parallel_for_each test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/experimental/parallel_for_each.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#define LAYOUT "parallel_for_each"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using hash_map_type =
+	nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>;
+using map_type = nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>;
+
+struct root {
+	nvobj::persistent_ptr<hash_map_type> hash_map;
+	nvobj::persistent_ptr<map_type> map;
+};
+
+const int elements = 10000;
+
+/*
+ * split_all -- (internal) recursively splits the range and checks that
+ * the subranges together contain each element exactly once
+ */
+template <typename Range>
+void
+split_all(const Range &range, std::vector<int> &seen)
+{
+	std::vector<Range> ranges(1, range);
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		while (ranges[i].is_divisible()) {
+			Range r(ranges[i], pmem::detail::split());
+			UT_ASSERT(!r.empty());
+			UT_ASSERT(!ranges[i].empty());
+			ranges.push_back(r);
+		}
+	}
+
+	UT_ASSERT(ranges.size() > 1);
+
+	for (auto &r : ranges) {
+		for (auto &e : r)
+			seen[static_cast<size_t>(static_cast<int>(e.first))]++;
+	}
+
+	for (auto count : seen)
+		UT_ASSERTeq(count, 1);
+}
+
+template <typename Container>
+void
+check_parallel_for_each(Container &c, size_t threads)
+{
+	std::atomic<long long> sum(0);
+	std::atomic<int> count(0);
+
+	nvobjexp::parallel_for_each(
+		c,
+		[&](typename Container::value_type &e) {
+			sum += e.second;
+			++count;
+		},
+		threads);
+
+	UT_ASSERTeq(count.load(), elements);
+	UT_ASSERTeq(sum.load(),
+		    static_cast<long long>(elements) * (elements - 1));
+
+	/* elements are modifiable through non-const ranges */
+	nvobjexp::parallel_for_each(
+		c, [&](typename Container::value_type &e) { e.second = 1; },
+		threads);
+
+	const Container &cc = c;
+	count = 0;
+	nvobjexp::parallel_for_each(
+		cc,
+		[&](const typename Container::value_type &e) {
+			UT_ASSERTeq(e.second, 1);
+			++count;
+		},
+		threads);
+	UT_ASSERTeq(count.load(), elements);
+
+	try {
+		nvobjexp::parallel_for_each(
+			cc,
+			[&](const typename Container::value_type &e) {
+				if (e.first == elements / 2)
+					throw std::runtime_error("stop");
+			},
+			threads);
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+void
+test_hash_map(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->hash_map;
+	map.runtime_initialize();
+
+	for (int i = 0; i < elements; ++i)
+		map.insert(hash_map_type::value_type(i, i * 2));
+
+	std::vector<int> seen(elements, 0);
+	split_all(map.range(), seen);
+
+	/* ranges smaller than grainsize buckets are not split */
+	auto range = map.range(map.bucket_count());
+	UT_ASSERT(!range.is_divisible());
+	UT_ASSERTeq(std::distance(range.begin(), range.end()), elements);
+
+	hash_map_type::const_range_type const_range = map.range();
+	UT_ASSERT(const_range.begin() == map.begin());
+	UT_ASSERT(const_range.end() == map.end());
+
+	check_parallel_for_each(map, 1);
+	check_parallel_for_each(map, 8);
+}
+
+void
+test_map(nvobj::pool<root> &pop)
+{
+	auto &map = *pop.root()->map;
+	map.runtime_initialize();
+
+	for (int i = 0; i < elements; ++i)
+		map.insert(map_type::value_type(i, i * 2));
+
+	std::vector<int> seen(elements, 0);
+	split_all(map.range(), seen);
+
+	map_type::const_range_type const_range = map.range();
+	UT_ASSERT(const_range.begin() == map.begin());
+	UT_ASSERT(const_range.end() == map.end());
+
+	check_parallel_for_each(map, 1);
+	check_parallel_for_each(map, 8);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						10 * PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	auto r = pop.root();
+	nvobj::transaction::run(pop, [&] {
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+	});
+
+	test_hash_map(pop);
+	test_map(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * pool_warmup.cpp -- pool_base::warmup() and prefetch_metadata() of
+ * concurrent containers test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#define LAYOUT "pool_warmup"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using hash_map_type =
+	nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>;
+using map_type = nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>;
+
+struct root {
+	nvobj::persistent_ptr<hash_map_type> hash_map;
+	nvobj::persistent_ptr<map_type> map;
+};
+
+const size_t concurrency = 4;
+const int elements = 4000;
+const size_t pool_size = 20 * PMEMOBJ_MIN_POOL;
+
+nvobj::pool<root>
+open(const char *path)
+{
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	return pop;
+}
+
+void
+populate(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		r->hash_map = nvobj::make_persistent<hash_map_type>();
+		r->map = nvobj::make_persistent<map_type>();
+	});
+
+	for (int i = 0; i < elements; ++i) {
+		UT_ASSERT(r->hash_map->insert(hash_map_type::value_type(i, i)));
+		UT_ASSERT(r->map->insert(map_type::value_type(i, i)).second);
+	}
+}
+
+void
+check_result(const nvobj::warmup_result &result)
+{
+	UT_ASSERT(!result.cancelled);
+#ifdef __linux__
+	UT_ASSERT(result.bytes >= pool_size);
+#else
+	UT_ASSERTeq(result.bytes, 0);
+#endif
+}
+
+/*
+ * test_invalid -- (internal) invalid options are rejected
+ */
+void
+test_invalid(nvobj::pool<root> &pop)
+{
+	nvobj::warmup_options options;
+	options.threads = 0;
+
+	try {
+		pop.warmup(options);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	options.threads = 1;
+	options.stride = 0;
+
+	try {
+		pop.warmup(options);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+/*
+ * test_concurrent -- (internal) the pool and the containers are warmed up
+ * while they are being used
+ */
+void
+test_concurrent(nvobj::pool<root> &pop, bool populate)
+{
+	auto r = pop.root();
+
+	nvobj::warmup_options options;
+	options.threads = concurrency;
+	options.populate = populate;
+
+	auto warmup = pop.warmup(options);
+
+	std::thread prefetch([&] {
+		r->hash_map->prefetch_metadata();
+		r->map->prefetch_metadata();
+	});
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		int id = static_cast<int>(thread_id);
+
+		for (int i = id; i < elements;
+		     i += static_cast<int>(concurrency)) {
+			hash_map_type::const_accessor acc;
+			UT_ASSERT(r->hash_map->find(acc, i));
+			UT_ASSERTeq(acc->second, i);
+
+			auto it = r->map->find(i);
+			UT_ASSERT(it != r->map->end());
+			UT_ASSERTeq(it->second, i);
+		}
+	});
+
+	prefetch.join();
+
+	check_result(warmup.get());
+}
+
+/*
+ * test_close -- (internal) close() stops the warm-up and waits for it
+ */
+void
+test_close(nvobj::pool<root> &pop)
+{
+	nvobj::warmup_options options;
+	options.stride = 64;
+
+	auto warmup = pop.warmup(options);
+
+	pop.close();
+
+	UT_ASSERT(warmup.wait_for(std::chrono::seconds(0)) ==
+		  std::future_status::ready);
+
+	auto result = warmup.get();
+#ifdef __linux__
+	UT_ASSERT(result.cancelled || result.bytes >= pool_size);
+#else
+	UT_ASSERTeq(result.bytes, 0);
+#endif
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	populate(pop);
+	pop.close();
+
+	pop = open(path);
+	test_invalid(pop);
+	test_concurrent(pop, false);
+	pop.close();
+
+	pop = open(path);
+	test_concurrent(pop, true);
+	test_close(pop);
+
+	pop = open(path);
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<hash_map_type>(pop.root()->hash_map);
+		nvobj::delete_persistent<map_type>(pop.root()->map);
+	});
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
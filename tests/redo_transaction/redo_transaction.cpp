@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * redo_transaction.cpp -- pmem::obj::experimental::redo_transaction test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/redo_transaction.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <cstring>
+#include <stdexcept>
+
+#define LAYOUT "redo_transaction"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const char initial[] = "abcdefghijklmno";
+const char modified[] = "abcdefghXYZWVUT";
+
+struct root {
+	char text[sizeof(initial)];
+	nvobj::p<uint64_t> counter;
+	/* two halves of the same 8-byte word */
+	nvobj::p<int32_t> left;
+	nvobj::p<int32_t> right;
+};
+
+/*
+ * test_write_read -- verifies that the writes are buffered until commit
+ * and that reads through the transaction observe them
+ */
+void
+test_write_read(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::transaction::snapshot(r->text, sizeof(r->text));
+		std::memcpy(r->text, initial, sizeof(initial));
+		r->counter = 1;
+		r->left = 2;
+		r->right = 2;
+	});
+
+	nvobjexp::redo_transaction tx(pop);
+
+	/* repeated writes to the same word cost one log entry */
+	for (uint64_t i = 0; i < 100; ++i)
+		tx.write(r->counter, i);
+	UT_ASSERTeq(tx.size(), 1);
+
+	tx.write_range(&r->text[8], "XYZWVUT", 8);
+
+	UT_ASSERTeq(tx.read(r->counter), 99);
+	UT_ASSERTeq(r->counter, 1);
+
+	char text[sizeof(initial)];
+	tx.read_range(text, r->text, sizeof(text));
+	UT_ASSERT(std::memcmp(text, modified, sizeof(modified)) == 0);
+	UT_ASSERT(std::memcmp(r->text, initial, sizeof(initial)) == 0);
+
+	tx.commit();
+	UT_ASSERTeq(tx.size(), 0);
+
+	UT_ASSERTeq(r->counter, 99);
+	UT_ASSERTeq(r->left, 2);
+	UT_ASSERT(std::memcmp(r->text, modified, sizeof(modified)) == 0);
+
+	/* a volatile object cannot be written */
+	uint64_t volatile_value = 0;
+	try {
+		tx.write(volatile_value, uint64_t(1));
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+}
+
+/*
+ * test_abort -- verifies that aborted writes are discarded
+ */
+void
+test_abort(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	try {
+		nvobjexp::redo_transaction::run(
+			pop, [&](nvobjexp::redo_transaction &tx) {
+				tx.write(r->left, int32_t(10));
+				tx.write(r->right, int32_t(10));
+				throw std::runtime_error("abort");
+			});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+	UT_ASSERTeq(r->left, 2);
+
+	nvobjexp::redo_transaction tx(pop);
+	tx.write(r->left, int32_t(11));
+	tx.abort();
+	tx.commit();
+	UT_ASSERTeq(r->left, 2);
+}
+
+/*
+ * test_partial_word -- verifies that a word which was not written
+ * completely is not committed, so the update of the other half of the
+ * word cannot be reverted
+ */
+void
+test_partial_word(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobjexp::redo_transaction tx(pop);
+	tx.write(r->left, int32_t(4));
+	UT_ASSERTeq(tx.read(r->left), 4);
+
+	try {
+		tx.commit();
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	}
+	UT_ASSERTeq(tx.size(), 0);
+	UT_ASSERTeq(r->left, 2);
+
+	/* the other half is modified in place after the commit */
+	nvobj::transaction::run(pop, [&] {
+		tx.write(r->left, int32_t(5));
+
+		try {
+			tx.commit();
+			UT_ASSERT(0);
+		} catch (std::invalid_argument &) {
+		}
+
+		r->right = 6;
+	});
+	UT_ASSERTeq(r->left, 2);
+	UT_ASSERTeq(r->right, 6);
+
+	/* both halves written make a complete word */
+	tx.write(r->left, int32_t(7));
+	tx.write(r->right, int32_t(8));
+	UT_ASSERTeq(tx.size(), 1);
+	tx.commit();
+
+	UT_ASSERTeq(r->left, 7);
+	UT_ASSERTeq(r->right, 8);
+}
+
+/*
+ * test_nested -- verifies that the writes committed within
+ * pmem::obj::transaction are applied with the outer transaction
+ */
+void
+test_nested(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobjexp::redo_transaction::run(
+			pop, [&](nvobjexp::redo_transaction &tx) {
+				tx.write(r->left, int32_t(3));
+				tx.write(r->right, int32_t(3));
+				tx.write(r->counter, tx.read(r->counter) + 1);
+			});
+	});
+
+	UT_ASSERTeq(r->left, 3);
+	UT_ASSERTeq(r->right, 3);
+	UT_ASSERTeq(r->counter, 100);
+}
+
+/*
+ * test_reopen -- verifies the values after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERTeq(r->left, 3);
+	UT_ASSERTeq(r->right, 3);
+	UT_ASSERTeq(r->counter, 100);
+	UT_ASSERT(std::memcmp(r->text, modified, sizeof(modified)) == 0);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_write_read(pop);
+	test_abort(pop);
+	test_partial_word(pop);
+	test_nested(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+#include "list_wrapper.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+
+#include <iterator>
+#include <vector>
+
+namespace nvobj = pmem::obj;
+
+using C = container_t<int>;
+
+struct root {
+	nvobj::persistent_ptr<C> v1;
+	nvobj::persistent_ptr<C> v2;
+};
+
+static const size_t concurrency = 8;
+
+/* Random access iterator which throws when dereferenced at given index */
+struct throwing_iterator : std::vector<int>::const_iterator {
+	using base = std::vector<int>::const_iterator;
+
+	throwing_iterator(base it, base throw_at) : base(it), throw_at(throw_at)
+	{
+	}
+
+	const int &operator*() const
+	{
+		if (static_cast<const base &>(*this) == throw_at)
+			throw std::runtime_error("iterator");
+		return base::operator*();
+	}
+
+	throwing_iterator
+	operator+(difference_type n) const
+	{
+		return throwing_iterator(static_cast<const base &>(*this) + n,
+					 throw_at);
+	}
+
+	base throw_at;
+};
+
+void
+check_vector(C &v, size_t count, int value)
+{
+	UT_ASSERTeq(v.size(), count);
+
+	for (size_t i = 0; i < count; ++i)
+		UT_ASSERTeq(v.const_at(i), value);
+}
+
+/**
+ * Test pmem::obj::segment_vector parallel_assign() methods
+ *
+ * Checks if contents match serial assign() for the fill, range and copy
+ * versions, both when growing and shrinking the container.
+ */
+void
+test_assign(nvobj::pool<struct root> &pop)
+{
+	auto r = pop.root();
+
+	r->v1->parallel_assign(100000, 7, concurrency);
+	check_vector(*r->v1, 100000, 7);
+
+	r->v1->parallel_assign(1000, 3, concurrency);
+	check_vector(*r->v1, 1000, 3);
+
+	std::vector<int> src(250000);
+	for (size_t i = 0; i < src.size(); ++i)
+		src[i] = static_cast<int>(i);
+
+	r->v1->parallel_assign(src.begin(), src.end(), concurrency);
+	UT_ASSERT(*r->v1 == src);
+
+	r->v2->parallel_assign(*r->v1, concurrency);
+	UT_ASSERT(*r->v2 == *r->v1);
+
+	r->v2->parallel_assign(0, 1, concurrency);
+	UT_ASSERT(r->v2->empty());
+
+	/* concurrency 0 means the calling thread only */
+	r->v2->parallel_assign(*r->v1, 0);
+	UT_ASSERT(*r->v2 == src);
+}
+
+/**
+ * Test pmem::obj::segment_vector parallel_assign() methods
+ *
+ * Checks if container's state is reverted when transaction aborts or
+ * when one of the threads throws.
+ */
+void
+test_txabort(nvobj::pool<struct root> &pop)
+{
+	auto r = pop.root();
+
+	r->v1->parallel_assign(10, 1, concurrency);
+
+	bool exception_thrown = false;
+	try {
+		nvobj::transaction::run(pop, [&] {
+			r->v1->parallel_assign(100000, 2, concurrency);
+			check_vector(*r->v1, 100000, 2);
+			nvobj::transaction::abort(EINVAL);
+		});
+	} catch (pmem::manual_tx_abort &) {
+		exception_thrown = true;
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERT(exception_thrown);
+	check_vector(*r->v1, 10, 1);
+
+	std::vector<int> src(100000, 2);
+	throwing_iterator first(src.cbegin(), src.cbegin() + 99999);
+	throwing_iterator last(src.cend(), src.cbegin() + 99999);
+
+	exception_thrown = false;
+	try {
+		r->v1->parallel_assign(first, last, concurrency);
+	} catch (std::runtime_error &) {
+		exception_thrown = true;
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERT(exception_thrown);
+	check_vector(*r->v1, 10, 1);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+	auto path = argv[1];
+	auto pop = nvobj::pool<root>::create(
+		path, "SegmentVectorTest: parallel_assign",
+		20 * PMEMOBJ_MIN_POOL, S_IWUSR | S_IRUSR);
+
+	auto r = pop.root();
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			r->v1 = nvobj::make_persistent<C>();
+			r->v2 = nvobj::make_persistent<C>();
+		});
+
+		test_assign(pop);
+		test_txabort(pop);
+
+		nvobj::transaction::run(pop, [&] {
+			nvobj::delete_persistent<C>(r->v1);
+			nvobj::delete_persistent<C>(r->v2);
+		});
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
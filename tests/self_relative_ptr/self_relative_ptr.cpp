@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * self_relative_ptr.cpp -- pmem::obj::experimental::self_relative_ptr test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "self_relative_ptr"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const int array_size = 10;
+
+struct foo {
+	nvobj::p<int> bar;
+};
+
+struct node {
+	nvobjexp::self_relative_ptr<node> next;
+	nvobj::p<int> value;
+};
+
+struct root {
+	nvobj::persistent_ptr<foo[array_size]> arr;
+	nvobjexp::self_relative_ptr<foo> ptr;
+	nvobjexp::self_relative_ptr<node> list;
+};
+
+/*
+ * test_null -- verifies if the pointer correctly behaves like a nullptr-value
+ */
+void
+test_null()
+{
+	static_assert(sizeof(nvobjexp::self_relative_ptr<foo>) == 8,
+		      "self_relative_ptr must be 8 bytes long");
+
+	nvobjexp::self_relative_ptr<foo> default_null;
+	nvobjexp::self_relative_ptr<foo> explicit_null = nullptr;
+	nvobjexp::self_relative_ptr<foo> copy_null = default_null;
+
+	for (auto *ptr : {&default_null, &explicit_null, &copy_null}) {
+		UT_ASSERT(!*ptr);
+		UT_ASSERT(*ptr == nullptr);
+		UT_ASSERT(nullptr == *ptr);
+		UT_ASSERTeq(ptr->get(), nullptr);
+		UT_ASSERT(ptr->to_persistent_ptr() == nullptr);
+	}
+}
+
+/*
+ * test_conversions -- verifies conversions to and from persistent_ptr and
+ * copying of the pointer to a different address
+ */
+void
+test_conversions(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		r->arr = nvobj::make_persistent<foo[array_size]>();
+		for (int i = 0; i < array_size; ++i)
+			r->arr[i].bar = i;
+
+		r->ptr = nvobjexp::self_relative_ptr<foo>(&r->arr[3]);
+	});
+
+	UT_ASSERT(r->ptr);
+	UT_ASSERTeq(r->ptr->bar, 3);
+	UT_ASSERTeq((*r->ptr).bar, 3);
+	UT_ASSERTeq(r->ptr[2].bar, 5);
+
+	/* the copy points to the same object, from a different address */
+	nvobjexp::self_relative_ptr<foo> copy = r->ptr;
+	UT_ASSERTeq(copy.get(), r->ptr.get());
+	UT_ASSERT(copy == r->ptr);
+
+	nvobj::persistent_ptr<foo> pptr = r->ptr;
+	UT_ASSERTeq(pptr.get(), r->ptr.get());
+	UT_ASSERT(pptr.raw().pool_uuid_lo == r->arr.raw().pool_uuid_lo);
+
+	nvobjexp::self_relative_ptr<foo> from_pptr = pptr;
+	UT_ASSERT(from_pptr == r->ptr);
+
+	nvobjexp::self_relative_ptr<void> vptr = r->ptr;
+	UT_ASSERTeq(vptr.get(), static_cast<void *>(r->ptr.get()));
+
+	nvobjexp::self_relative_ptr<const foo> cptr = r->ptr;
+	UT_ASSERTeq(cptr->bar, 3);
+}
+
+/*
+ * test_arithmetic -- verifies pointer arithmetic and comparison operators
+ */
+void
+test_arithmetic(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobjexp::self_relative_ptr<foo> first(&r->arr[0]);
+	nvobjexp::self_relative_ptr<foo> it = first;
+
+	for (int i = 0; i < array_size; ++i, ++it) {
+		UT_ASSERTeq(it->bar, i);
+		UT_ASSERTeq(it - first, i);
+	}
+
+	UT_ASSERTeq((--it)->bar, array_size - 1);
+	UT_ASSERTeq((it--)->bar, array_size - 1);
+	UT_ASSERTeq((it++)->bar, array_size - 2);
+
+	it -= 4;
+	UT_ASSERTeq(it->bar, array_size - 5);
+	it += 2;
+	UT_ASSERTeq(it->bar, array_size - 3);
+	UT_ASSERTeq((it + 1)->bar, array_size - 2);
+	UT_ASSERTeq((it - 1)->bar, array_size - 4);
+
+	UT_ASSERT(first < it);
+	UT_ASSERT(first <= it);
+	UT_ASSERT(it > first);
+	UT_ASSERT(it >= first);
+	UT_ASSERT(first != it);
+
+	nvobjexp::self_relative_ptr<foo> a(&r->arr[1]);
+	nvobjexp::self_relative_ptr<foo> b(&r->arr[2]);
+	swap(a, b);
+	UT_ASSERTeq(a->bar, 2);
+	UT_ASSERTeq(b->bar, 1);
+}
+
+/*
+ * test_list -- builds a list of self_relative_ptr linked nodes
+ */
+void
+test_list(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	const int nodes = 100;
+
+	for (int i = 0; i < nodes; ++i) {
+		nvobj::transaction::run(pop, [&] {
+			nvobj::persistent_ptr<node> n =
+				nvobj::make_persistent<node>();
+			n->value = i;
+			n->next = r->list;
+			r->list = n;
+		});
+	}
+
+	int expected = nodes;
+	for (auto n = r->list; n; n = n->next)
+		UT_ASSERTeq(n->value, --expected);
+	UT_ASSERTeq(expected, 0);
+}
+
+/*
+ * test_tx_abort -- verifies that modifications of the pointer are rolled
+ * back when the transaction is aborted
+ */
+void
+test_tx_abort(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	foo *before = r->ptr.get();
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			r->ptr = nullptr;
+			UT_ASSERT(r->ptr == nullptr);
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+	UT_ASSERTeq(r->ptr.get(), before);
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			++r->ptr;
+			r->ptr += 3;
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+	UT_ASSERTeq(r->ptr.get(), before);
+}
+
+/*
+ * test_reopen -- verifies that the pointers are valid after the pool is
+ * reopened, possibly at a different address
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERT(r->ptr.get() == &r->arr[3]);
+	UT_ASSERTeq(r->ptr->bar, 3);
+
+	int expected = 100;
+	for (auto n = r->list; n; n = n->next)
+		UT_ASSERTeq(n->value, --expected);
+	UT_ASSERTeq(expected, 0);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_null();
+	test_conversions(pop);
+	test_arithmetic(pop);
+	test_list(pop);
+	test_tx_abort(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * self_relative_ptr_atomic.cpp -- std::atomic<self_relative_ptr> test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/atomic_self_relative_ptr.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <vector>
+
+#define LAYOUT "self_relative_ptr_atomic"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t concurrency = 8;
+const size_t nodes_per_thread = 1000;
+const size_t nodes = concurrency * nodes_per_thread;
+
+struct node {
+	nvobjexp::self_relative_ptr<node> next;
+	nvobj::p<size_t> value;
+};
+
+struct root {
+	nvobj::persistent_ptr<node[nodes]> arr;
+	std::atomic<nvobjexp::self_relative_ptr<node>> head;
+	std::atomic<nvobjexp::self_relative_ptr<node>> cursor;
+};
+
+/*
+ * test_basic -- verifies single-threaded atomic operations
+ */
+void
+test_basic(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	node *first = &r->arr[0];
+
+	UT_ASSERT(r->head.is_lock_free());
+	UT_ASSERT(r->head.load() == nullptr);
+
+	r->head.store(first);
+	UT_ASSERTeq(r->head.load().get(), first);
+
+	auto old = r->head.exchange(first + 1);
+	UT_ASSERTeq(old.get(), first);
+
+	nvobjexp::self_relative_ptr<node> expected = first;
+	UT_ASSERT(!r->head.compare_exchange_strong(expected, first + 2));
+	UT_ASSERTeq(expected.get(), first + 1);
+	UT_ASSERT(r->head.compare_exchange_strong(expected, first + 2));
+	UT_ASSERTeq(r->head.load().get(), first + 2);
+
+	UT_ASSERTeq(r->head.fetch_add(3).get(), first + 2);
+	UT_ASSERTeq(r->head.fetch_sub(1).get(), first + 5);
+	UT_ASSERTeq((++r->head).get(), first + 5);
+	UT_ASSERTeq((r->head--).get(), first + 5);
+	UT_ASSERTeq((r->head -= 4).get(), first);
+
+	r->head = nullptr;
+	UT_ASSERT(r->head.load() == nullptr);
+	pop.persist(&r->head, sizeof(r->head));
+}
+
+/*
+ * test_concurrent -- threads concurrently claim nodes using fetch_add and
+ * push them to a lock-free stack
+ */
+void
+test_concurrent(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	r->cursor.store(&r->arr[0]);
+
+	parallel_exec(concurrency, [&](size_t) {
+		for (size_t i = 0; i < nodes_per_thread; ++i) {
+			auto n = r->cursor.fetch_add(1);
+			n->value = static_cast<size_t>(n.get() - &r->arr[0]);
+
+			auto head = r->head.load();
+			do {
+				n->next = head;
+			} while (!r->head.compare_exchange_weak(head, n));
+		}
+	});
+
+	UT_ASSERTeq(r->cursor.load().get(), &r->arr[0] + nodes);
+
+	std::vector<bool> visited(nodes, false);
+	size_t count = 0;
+	for (auto n = r->head.load(); n; n = n->next) {
+		size_t idx = static_cast<size_t>(n.get() - &r->arr[0]);
+		UT_ASSERT(idx < nodes);
+		UT_ASSERTeq(n->value, idx);
+		UT_ASSERT(!visited[idx]);
+		visited[idx] = true;
+		++count;
+	}
+	UT_ASSERTeq(count, nodes);
+}
+
+/*
+ * test_reopen -- verifies the stack after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	size_t count = 0;
+	for (auto n = r->head.load(); n; n = n->next) {
+		UT_ASSERT(n.get() >= &r->arr[0]);
+		UT_ASSERT(n.get() < &r->arr[0] + nodes);
+		++count;
+	}
+	UT_ASSERTeq(count, nodes);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 2,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->arr = nvobj::make_persistent<node[nodes]>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_basic(pop);
+	test_concurrent(pop);
+
+	pop.persist(pop.root()->arr);
+	pop.persist(&pop.root()->head, sizeof(pop.root()->head));
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * sharded_concurrent_hash_map.cpp --
+ * pmem::obj::experimental::sharded_concurrent_hash_map test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/sharded_concurrent_hash_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <iterator>
+#include <vector>
+
+#define LAYOUT "sharded_concurrent_hash_map"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t shards = 4;
+const size_t concurrency = 4;
+const int elements = 4000;
+
+typedef nvobjexp::sharded_concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+					      shards>
+	persistent_map_type;
+
+typedef persistent_map_type::value_type value_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+/*
+ * verify_elements -- (internal) checks that elements divisible by step
+ * (and only them) are in the map, with value i * factor
+ */
+void
+verify_elements(const persistent_map_type &map, int step, int factor)
+{
+	size_t expected = static_cast<size_t>((elements + step - 1) / step);
+
+	UT_ASSERTeq(map.size(), expected);
+	UT_ASSERTeq(static_cast<size_t>(std::distance(map.begin(), map.end())),
+		    expected);
+
+	std::vector<bool> seen(elements, false);
+	for (auto &e : map) {
+		int key = e.first;
+		UT_ASSERT(key >= 0 && key < elements);
+		UT_ASSERT(!seen[static_cast<size_t>(key)]);
+		UT_ASSERTeq(e.second, key * factor);
+		seen[static_cast<size_t>(key)] = true;
+	}
+
+	for (int i = 0; i < elements; ++i) {
+		persistent_map_type::const_accessor acc;
+		bool found = map.find(acc, i);
+
+		UT_ASSERTeq(found, i % step == 0);
+		UT_ASSERTeq(map.count(i), found ? 1U : 0U);
+		if (found)
+			UT_ASSERTeq(acc->second, i * factor);
+	}
+}
+
+void
+insert_test(persistent_map_type &map)
+{
+	map.runtime_initialize();
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (int i = static_cast<int>(thread_id); i < elements;
+		     i += static_cast<int>(concurrency))
+			UT_ASSERT(map.insert(value_type(i, i)));
+	});
+
+	verify_elements(map, 1, 1);
+
+	/* every shard got its part of the keys and grew on its own */
+	size_t total = 0;
+	size_t buckets = 0;
+	for (size_t s = 0; s < map.shard_count(); ++s) {
+		auto &shard = map.shard(s);
+		UT_ASSERT(shard.size() > 0);
+		UT_ASSERT(shard.size() < static_cast<size_t>(elements));
+
+		for (auto &e : shard)
+			UT_ASSERTeq(map.shard_index(e.first), s);
+
+		total += shard.size();
+		buckets += shard.bucket_count();
+	}
+	UT_ASSERTeq(total, static_cast<size_t>(elements));
+	UT_ASSERTeq(buckets, map.bucket_count());
+
+	UT_ASSERT(!map.insert(value_type(0, 0)));
+
+	persistent_map_type::const_iterator it = map.begin();
+	UT_ASSERT(it == map.begin());
+	UT_ASSERT(++it != map.begin());
+}
+
+void
+modify_test(nvobj::pool<root> &pop, persistent_map_type &map)
+{
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (int i = static_cast<int>(thread_id); i < elements;
+		     i += static_cast<int>(concurrency)) {
+			if (i % 2 != 0) {
+				UT_ASSERT(map.erase(i));
+				continue;
+			}
+
+			persistent_map_type::accessor acc;
+			UT_ASSERT(map.find(acc, i));
+
+			nvobj::transaction::run(
+				pop, [&] { acc->second = i * 2; });
+		}
+	});
+
+	verify_elements(map, 2, 2);
+
+	UT_ASSERT(!map.insert_or_assign(0, 0));
+	UT_ASSERT(map.insert_or_assign(1, 2));
+	UT_ASSERT(map.erase(1));
+	UT_ASSERT(!map.erase(1));
+
+	auto result = map.defragment();
+	UT_ASSERT(result.relocated <= result.total);
+
+	verify_elements(map, 2, 2);
+}
+
+void
+reopen_test(persistent_map_type &map)
+{
+	map.runtime_initialize(2);
+
+	verify_elements(map, 2, 2);
+
+	map.clear();
+	UT_ASSERT(map.empty());
+	UT_ASSERT(map.begin() == map.end());
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	insert_test(*pop.root()->cons);
+	modify_test(pop, *pop.root()->cons);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	reopen_test(*pop.root()->cons);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * transaction_group.cpp -- pmem::obj::experimental::transaction_group test
+ *
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/transaction_group.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <stdexcept>
+
+#define LAYOUT "transaction_group"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const size_t concurrency = 8;
+const size_t increments = 1000;
+
+/* closures of odd threads with index divisible by 4 throw */
+const size_t failures = (concurrency / 2) * (increments / 4);
+
+struct root {
+	nvobj::p<uint64_t> counter;
+	nvobj::p<uint64_t> per_thread[concurrency];
+};
+
+/*
+ * test_basic -- verifies single-threaded operations
+ */
+void
+test_basic(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	nvobjexp::transaction_group group(pop);
+
+	group.run([&] { r->counter = 1; });
+	UT_ASSERTeq(r->counter, 1);
+
+	try {
+		group.run([&] {
+			r->counter = 2;
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+	UT_ASSERTeq(r->counter, 1);
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			group.run([&] { r->counter = 3; });
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	}
+	UT_ASSERTeq(r->counter, 1);
+
+	nvobj::transaction::run(pop, [&] { r->counter = 0; });
+}
+
+/*
+ * test_concurrent -- threads concurrently increment shared and private
+ * counters, every fourth closure of odd threads throws
+ */
+void
+test_concurrent(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	nvobjexp::transaction_group group(pop, 16);
+
+	parallel_exec(concurrency, [&](size_t tid) {
+		size_t failed = 0;
+
+		for (size_t i = 0; i < increments; ++i) {
+			bool fail = (tid % 2 == 1) && (i % 4 == 0);
+
+			try {
+				group.run([&] {
+					r->counter = r->counter + 1;
+					r->per_thread[tid] =
+						r->per_thread[tid] + 1;
+					if (fail)
+						throw std::runtime_error(
+							"abort");
+				});
+				UT_ASSERT(!fail);
+			} catch (std::runtime_error &) {
+				UT_ASSERT(fail);
+				++failed;
+			}
+		}
+
+		UT_ASSERTeq(r->per_thread[tid], increments - failed);
+	});
+
+	UT_ASSERTeq(r->counter, concurrency * increments - failures);
+}
+
+/*
+ * test_reopen -- verifies the counters after the pool is reopened
+ */
+void
+test_reopen(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	UT_ASSERTeq(r->counter, concurrency * increments - failures);
+	for (size_t i = 0; i < concurrency; ++i)
+		UT_ASSERTeq(r->per_thread[i],
+			    i % 2 == 1 ? increments * 3 / 4 : increments);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_basic(pop);
+	test_concurrent(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	test_reopen(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
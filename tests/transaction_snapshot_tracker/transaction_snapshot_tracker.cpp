@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2020, Intel Corporation */
+
+/*
+ * transaction_snapshot_tracker.cpp -- test of filtering of the ranges
+ * already snapshotted in a transaction
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <stdexcept>
+
+#define LAYOUT "transaction_snapshot_tracker"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+const size_t array_size = 64;
+
+struct root {
+	nvobj::p<uint64_t> counter;
+	uint64_t arr[array_size];
+};
+
+/*
+ * test_avoided -- verifies that repeated and covered snapshots are not
+ * forwarded to libpmemobj
+ */
+void
+test_avoided(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::reset_snapshot_statistics();
+
+	nvobj::transaction::run(pop, [&] {
+		for (uint64_t i = 0; i < 10; ++i)
+			r->counter = r->counter + i;
+
+		/* the halves of the array, then the whole array */
+		nvobj::transaction::snapshot(r->arr, array_size / 2);
+		nvobj::transaction::snapshot(r->arr + array_size / 2,
+					     array_size / 2);
+		nvobj::transaction::snapshot(r->arr, array_size);
+
+		for (size_t i = 0; i < array_size; ++i) {
+			nvobj::transaction::snapshot(&r->arr[i]);
+			r->arr[i] = i;
+		}
+	});
+
+	auto stats = nvobj::transaction::snapshot_statistics();
+	UT_ASSERTeq(stats.requested, 10 + 3 + array_size);
+	UT_ASSERTeq(stats.forwarded, 3);
+	UT_ASSERTeq(stats.avoided, 9 + 1 + array_size);
+
+	/* the ranges are forgotten at the end of the transaction */
+	nvobj::transaction::reset_snapshot_statistics();
+	nvobj::transaction::run(pop, [&] { r->counter = 0; });
+
+	stats = nvobj::transaction::snapshot_statistics();
+	UT_ASSERTeq(stats.forwarded, 1);
+	UT_ASSERTeq(stats.avoided, 0);
+}
+
+/*
+ * test_abort -- verifies that the data snapshotted with partially covered
+ * ranges is restored on abort
+ */
+void
+test_abort(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			nvobj::transaction::snapshot(r->arr + 8, 8);
+			nvobj::transaction::snapshot(r->arr + 24, 8);
+
+			/* only the gaps are forwarded */
+			nvobj::transaction::snapshot(r->arr, array_size);
+
+			for (size_t i = 0; i < array_size; ++i)
+				r->arr[i] = 0;
+			r->counter = 1;
+
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	UT_ASSERTeq(r->counter, 0);
+	for (size_t i = 0; i < array_size; ++i)
+		UT_ASSERTeq(r->arr[i], i);
+}
+
+/*
+ * test_nested -- verifies that ranges snapshotted in a nested transaction
+ * are filtered in the outer one
+ */
+void
+test_nested(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::reset_snapshot_statistics();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::transaction::run(pop, [&] { r->counter = 1; });
+		r->counter = 2;
+	});
+
+	auto stats = nvobj::transaction::snapshot_statistics();
+	UT_ASSERTeq(stats.forwarded, 1);
+	UT_ASSERTeq(stats.avoided, 1);
+	UT_ASSERTeq(r->counter, 2);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_avoided(pop);
+	test_abort(pop);
+	test_nested(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -304,6 +304,66 @@ test_mt_same_element(nvobj::pool<root> &pop, size_t concurrency)
 	UT_ASSERT(v2_initialized == 0);
 }
 
+void
+test_mt_different_elements(nvobj::pool<root> &pop, size_t concurrency)
+{
+	constexpr size_t NUM_ELEMENTS = 128;
+
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		r->vec_obj_ptr =
+			nvobj::make_persistent<nvobj::vector<pmem_obj>>(
+				NUM_ELEMENTS);
+	});
+
+	v2_initialized = 0;
+
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency);
+
+	auto &vec = *r->vec_obj_ptr;
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back(
+			[&](size_t thread_id) {
+				for (size_t n = 0; n < 10 * NUM_ELEMENTS; n++) {
+					auto idx =
+						(n + thread_id) % NUM_ELEMENTS;
+					auto oid =
+						pmemobj_oid(&vec.const_at(idx));
+					auto *data = v_state::get<v_data2>(oid);
+
+					UT_ASSERT(*data->val == VALUE);
+				}
+			},
+			i);
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	UT_ASSERT(v2_initialized == NUM_ELEMENTS);
+
+	/* element looked up before must not be returned after destroy */
+	auto oid = pmemobj_oid(&vec.const_at(0));
+	UT_ASSERT(v_state::get_if_exists<v_data2>(oid) != nullptr);
+	UT_ASSERT(v_state::get_if_exists<v_data2>(oid) != nullptr);
+
+	v_state::destroy(oid);
+
+	UT_ASSERT(v2_initialized == NUM_ELEMENTS - 1);
+	UT_ASSERT(v_state::get_if_exists<v_data2>(oid) == nullptr);
+
+	nvobj::transaction::run(pop, [&] {
+		pmem::obj::delete_persistent<nvobj::vector<pmem_obj>>(
+			r->vec_obj_ptr);
+	});
+
+	UT_ASSERT(v2_initialized == 0);
+}
+
 void
 test_vector_of_elements(nvobj::pool<root> &pop)
 {
@@ -408,6 +468,7 @@ test(int argc, char *argv[])
 	test_volatile_state_lifecycle_tx(pop);
 	test_volatile_state_lifecycle_tx_abort(pop);
 	test_mt_same_element(pop, 8);
+	test_mt_different_elements(pop, 8);
 	test_vector_of_elements(pop);
 	test_multiple_pool(pop, path);
 